@@ -0,0 +1,71 @@
+#ifndef ARROWFORMAT_H
+#define ARROWFORMAT_H
+
+#include <cstdint>
+
+/*!
+ * \brief constants of the Apache Arrow IPC file format (Schema.fbs, Message.fbs, File.fbs)
+ *
+ * Only the subset used by ArrowWriter and ArrowTableModel is defined.
+ * Numbers are little-endian, as are the hosts the application is built for.
+ */
+namespace Arrow {
+
+const char Magic[] = "ARROW1";
+const int MagicSize = 6;
+const int32_t Continuation = -1;    ///< precedes the length of an encapsulated message
+
+const int16_t MetadataV5 = 4;
+
+enum MessageHeader : uint8_t
+{
+    SchemaMessage = 1,
+    DictionaryBatchMessage = 2,
+    RecordBatchMessage = 3
+};
+
+enum Type : uint8_t
+{
+    NullType = 1,
+    IntType = 2,
+    FloatingPointType = 3,
+    BinaryType = 4,
+    Utf8Type = 5,
+    BoolType = 6,
+    DecimalType = 7,
+    DateType = 8,
+    TimeType = 9,
+    TimestampType = 10,
+    IntervalType = 11,
+    ListType = 12,
+    StructType = 13,
+    UnionType = 14,
+    FixedSizeBinaryType = 15,
+    FixedSizeListType = 16,
+    MapType = 17,
+    DurationType = 18,
+    LargeBinaryType = 19,
+    LargeUtf8Type = 20,
+    LargeListType = 21
+};
+
+enum Precision : int16_t { Half = 0, Single = 1, Double = 2 };
+enum DateUnit : int16_t { Day = 0, DateMillisecond = 1 };
+enum TimeUnit : int16_t { Second = 0, Millisecond = 1, Microsecond = 2, Nanosecond = 3 };
+
+// table field ids
+namespace MessageField { enum { Version, HeaderType, Header, BodyLength }; }
+namespace SchemaField { enum { Endianness, Fields }; }
+namespace FieldField { enum { Name, Nullable, TypeType, Type, Dictionary, Children }; }
+namespace RecordBatchField { enum { Length, Nodes, Buffers, Compression }; }
+namespace FooterField { enum { Version, Schema, Dictionaries, RecordBatches }; }
+
+const int FieldNodeSize = 16;   ///< struct FieldNode { long length; long null_count; }
+const int BufferSize = 16;      ///< struct Buffer { long offset; long length; }
+const int BlockSize = 24;       ///< struct Block { long offset; int metaDataLength; long bodyLength; }
+
+const int64_t UnixEpochJulianDay = 2440588;
+
+}
+
+#endif // ARROWFORMAT_H
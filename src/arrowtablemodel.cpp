@@ -0,0 +1,534 @@
+#include "arrowtablemodel.h"
+#include "arrowformat.h"
+#include "tablemodel.h"
+#include <QBrush>
+#include <QDateTime>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+
+// max length of the text displayed within a cell (the whole value is available via RawDataRole)
+#define CELL_PREVIEW_LENGTH 1000
+
+namespace {
+
+/*!
+ * \brief bounds-checked access to flatbuffers tables within the mapped file
+ *
+ * Positions are file offsets. Anything pointing outside of the file throws.
+ */
+class FlatReader
+{
+public:
+    FlatReader(const uchar *data, qint64 size) : _data(data), _size(size) {}
+
+    void check(qint64 pos, qint64 length) const
+    {
+        if (pos < 0 || length < 0 || pos > _size || length > _size - pos)
+            throw ArrowTableModel::tr("malformed Arrow file");
+    }
+
+    template <typename T> T read(qint64 pos) const
+    {
+        check(pos, sizeof(T));
+        T value;
+        memcpy(&value, _data + pos, sizeof(T));
+        return value;
+    }
+
+    qint64 root(qint64 pos) const { return pos + read<uint32_t>(pos); }
+
+    /// position of a table field (0 if it is absent)
+    qint64 field(qint64 table, int id) const
+    {
+        if (!table)
+            return 0;
+        qint64 vtable = table - read<int32_t>(table);
+        uint16_t vtableSize = read<uint16_t>(vtable);
+        if (4 + 2 * id + 2 > vtableSize)
+            return 0;
+        uint16_t offset = read<uint16_t>(vtable + 4 + 2 * id);
+        return offset ? table + offset : 0;
+    }
+
+    template <typename T> T scalar(qint64 table, int id, T defaultValue) const
+    {
+        qint64 pos = field(table, id);
+        return pos ? read<T>(pos) : defaultValue;
+    }
+
+    /// position of a table, vector or string referred by a field (0 if it is absent)
+    qint64 offset(qint64 table, int id) const
+    {
+        qint64 pos = field(table, id);
+        return pos ? pos + read<uint32_t>(pos) : 0;
+    }
+
+    uint32_t length(qint64 vector) const { return vector ? read<uint32_t>(vector) : 0; }
+
+    /// position of an element of a vector of tables
+    qint64 table(qint64 vector, uint32_t i) const
+    {
+        if (i >= length(vector))
+            throw ArrowTableModel::tr("malformed Arrow file");
+        qint64 pos = vector + 4 + 4 * qint64(i);
+        return pos + read<uint32_t>(pos);
+    }
+
+    /// position of an element of a vector of structs
+    qint64 structAt(qint64 vector, uint32_t i, int structSize) const
+    {
+        if (i >= length(vector))
+            throw ArrowTableModel::tr("malformed Arrow file");
+        return vector + 4 + qint64(structSize) * i;
+    }
+
+    QString string(qint64 str) const
+    {
+        if (!str)
+            return QString();
+        uint32_t len = read<uint32_t>(str);
+        check(str + 4, len);
+        return QString::fromUtf8(reinterpret_cast<const char*>(_data + str + 4), len);
+    }
+
+private:
+    const uchar *_data;
+    qint64 _size;
+};
+
+}
+
+template <typename T> static bool readAt(const uchar *data, qint64 length, qint64 i, T &value)
+{
+    if (i < 0 || (i + 1) * qint64(sizeof(T)) > length)
+        return false;
+    memcpy(&value, data + i * sizeof(T), sizeof(T));
+    return true;
+}
+
+static bool readInt(const uchar *data, qint64 length, qint64 i, int width, qint64 &value)
+{
+    switch (width)
+    {
+    case 1: { qint8 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 2: { qint16 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 4: { qint32 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 8: return readAt(data, length, i, value);
+    }
+    return false;
+}
+
+static bool readUInt(const uchar *data, qint64 length, qint64 i, int width, quint64 &value)
+{
+    switch (width)
+    {
+    case 1: { quint8 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 2: { quint16 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 4: { quint32 v; if (!readAt(data, length, i, v)) return false; value = v; return true; }
+    case 8: return readAt(data, length, i, value);
+    }
+    return false;
+}
+
+static qint64 toMSecs(qint64 value, qint64 perMSec)
+{
+    if (!perMSec)
+        return value * 1000;
+    // rounded down, also for times before the epoch
+    return value / perMSec - (value % perMSec < 0 ? 1 : 0);
+}
+
+static qint64 unitsPerMSec(int16_t unit)
+{
+    switch (unit)
+    {
+    case Arrow::Second:
+        return 0;
+    case Arrow::Microsecond:
+        return 1000;
+    case Arrow::Nanosecond:
+        return 1000000;
+    default:
+        return 1;
+    }
+}
+
+ArrowTableModel::ArrowTableModel(QObject *parent) :
+    QAbstractItemModel(parent), _map(nullptr), _size(0), _rowCount(0)
+{
+}
+
+ArrowTableModel::~ArrowTableModel()
+{
+    close();
+}
+
+void ArrowTableModel::close()
+{
+    if (_map)
+        _file.unmap(_map);
+    _map = nullptr;
+    _file.close();
+    _columns.clear();
+    _batches.clear();
+    _size = _rowCount = 0;
+}
+
+void ArrowTableModel::open(const QString &fileName)
+{
+    beginResetModel();
+    close();
+    try
+    {
+        _file.setFileName(fileName);
+        if (!_file.open(QIODevice::ReadOnly))
+            throw _file.errorString();
+        _size = _file.size();
+        // leading magic (padded to 8 bytes), footer length, trailing magic
+        if (_size < 8 + 4 + Arrow::MagicSize)
+            throw tr("not an Arrow file");
+        _map = _file.map(0, _size);
+        if (!_map)
+            throw _file.errorString();
+        if (memcmp(_map, Arrow::Magic, Arrow::MagicSize) ||
+                memcmp(_map + _size - Arrow::MagicSize, Arrow::Magic, Arrow::MagicSize))
+            throw tr("not an Arrow file");
+
+        FlatReader fb(_map, _size);
+        qint64 footerEnd = _size - Arrow::MagicSize - 4;
+        qint64 footer = fb.root(footerEnd - fb.read<int32_t>(footerEnd));
+        readSchema(fb.offset(footer, Arrow::FooterField::Schema));
+        qint64 blocks = fb.offset(footer, Arrow::FooterField::RecordBatches);
+        for (uint32_t i = 0; i < fb.length(blocks); ++i)
+        {
+            qint64 block = fb.structAt(blocks, i, Arrow::BlockSize);
+            readBatch(fb.read<int64_t>(block), fb.read<int32_t>(block + 8), fb.read<int64_t>(block + 16));
+        }
+    }
+    catch (const QString &)
+    {
+        close();
+        endResetModel();
+        throw;
+    }
+    endResetModel();
+}
+
+void ArrowTableModel::readSchema(qint64 schema)
+{
+    FlatReader fb(_map, _size);
+    if (!schema)
+        throw tr("malformed Arrow file");
+    qint64 fields = fb.offset(schema, Arrow::SchemaField::Fields);
+    for (uint32_t i = 0; i < fb.length(fields); ++i)
+    {
+        qint64 field = fb.table(fields, i);
+        if (fb.length(fb.offset(field, Arrow::FieldField::Children)))
+            throw tr("nested Arrow columns are not supported");
+        Column col = { fb.string(fb.offset(field, Arrow::FieldField::Name)), Unsupported, 0, 1, Qt::AlignLeft };
+        qint64 type = fb.offset(field, Arrow::FieldField::Type);
+        switch (fb.scalar<uint8_t>(field, Arrow::FieldField::TypeType, 0))
+        {
+        case Arrow::NullType:
+            col.kind = Null;
+            break;
+        case Arrow::IntType:
+            col.width = fb.scalar<int32_t>(type, 0, 0) / 8;
+            col.kind = fb.scalar<uint8_t>(type, 1, 0) ? Int : UInt;
+            break;
+        case Arrow::FloatingPointType:
+            switch (fb.scalar<int16_t>(type, 0, Arrow::Half))
+            {
+            case Arrow::Single:
+                col.kind = Float;
+                col.width = 4;
+                break;
+            case Arrow::Double:
+                col.kind = Float;
+                col.width = 8;
+                break;
+            }
+            break;
+        case Arrow::BoolType:
+            col.kind = Bool;
+            break;
+        case Arrow::Utf8Type:
+            col.kind = Utf8;
+            break;
+        case Arrow::BinaryType:
+            col.kind = Binary;
+            break;
+        case Arrow::LargeUtf8Type:
+            col.kind = LargeUtf8;
+            break;
+        case Arrow::LargeBinaryType:
+            col.kind = LargeBinary;
+            break;
+        case Arrow::DateType:
+            col.kind = fb.scalar<int16_t>(type, 0, Arrow::DateMillisecond) == Arrow::Day ? Date32 : Date64;
+            break;
+        case Arrow::TimeType:
+            col.kind = Time;
+            col.perMSec = unitsPerMSec(fb.scalar<int16_t>(type, 0, Arrow::Millisecond));
+            col.width = fb.scalar<int32_t>(type, 1, 32) / 8;
+            break;
+        case Arrow::TimestampType:
+            col.kind = Timestamp;
+            col.perMSec = unitsPerMSec(fb.scalar<int16_t>(type, 0, Arrow::Second));
+            break;
+        }
+        // dictionary encoded columns store indices
+        if (fb.offset(field, Arrow::FieldField::Dictionary))
+            col.kind = Unsupported;
+        if (col.kind == Int || col.kind == UInt || col.kind == Float)
+            col.alignment = Qt::AlignRight;
+        _columns.append(col);
+    }
+}
+
+void ArrowTableModel::readBatch(qint64 offset, qint64 metaDataLength, qint64 bodyLength)
+{
+    FlatReader fb(_map, _size);
+    // the metadata length prefix may lack the continuation marker (older writers)
+    qint64 meta = fb.read<int32_t>(offset) == Arrow::Continuation ? offset + 8 : offset + 4;
+    qint64 message = fb.root(meta);
+    if (fb.scalar<uint8_t>(message, Arrow::MessageField::HeaderType, 0) != Arrow::RecordBatchMessage)
+        throw tr("malformed Arrow file");
+    qint64 batch = fb.offset(message, Arrow::MessageField::Header);
+    if (!batch)
+        throw tr("malformed Arrow file");
+    if (fb.offset(batch, Arrow::RecordBatchField::Compression))
+        throw tr("compressed Arrow files are not supported");
+    qint64 body = offset + metaDataLength;
+    fb.check(body, bodyLength);
+
+    Batch b;
+    b.firstRow = _rowCount;
+    b.length = fb.scalar<int64_t>(batch, Arrow::RecordBatchField::Length, 0);
+    if (b.length < 0)
+        throw tr("malformed Arrow file");
+    qint64 nodes = fb.offset(batch, Arrow::RecordBatchField::Nodes);
+    qint64 buffers = fb.offset(batch, Arrow::RecordBatchField::Buffers);
+    uint32_t buffer = 0;
+    auto nextBuffer = [&]() {
+        qint64 pos = fb.structAt(buffers, buffer++, Arrow::BufferSize);
+        qint64 start = fb.read<int64_t>(pos);
+        qint64 length = fb.read<int64_t>(pos + 8);
+        if (start < 0 || length < 0 || start > bodyLength || length > bodyLength - start)
+            throw tr("malformed Arrow file");
+        return Buffer{ length ? _map + body + start : nullptr, length };
+    };
+    for (int c = 0; c < _columns.size(); ++c)
+    {
+        if (fb.read<int64_t>(fb.structAt(nodes, c, Arrow::FieldNodeSize)) != b.length)
+            throw tr("malformed Arrow file");
+        ColumnChunk chunk = {};
+        switch (_columns[c].kind)
+        {
+        case Null:
+            break;
+        case Utf8:
+        case Binary:
+        case LargeUtf8:
+        case LargeBinary:
+            chunk.validity = nextBuffer();
+            chunk.offsets = nextBuffer();
+            chunk.values = nextBuffer();
+            break;
+        default:
+            chunk.validity = nextBuffer();
+            chunk.values = nextBuffer();
+            break;
+        }
+        b.columns.append(chunk);
+    }
+    _batches.append(b);
+    _rowCount += b.length;
+}
+
+QVariant ArrowTableModel::value(int row, int column, int maxBytes) const
+{
+    // the last batch starting at the row or before it (empty batches are skipped this way)
+    auto it = std::upper_bound(_batches.begin(), _batches.end(), qint64(row), [](qint64 r, const Batch &b) {
+        return r < b.firstRow;
+    });
+    if (it == _batches.begin())
+        return QVariant();
+    --it;
+    qint64 i = row - it->firstRow;
+    const Column &col = _columns.at(column);
+    const ColumnChunk &chunk = it->columns.at(column);
+    // no validity buffer means no nulls
+    if (col.kind == Null || (chunk.validity.data &&
+                             (i / 8 >= chunk.validity.length || !(chunk.validity.data[i / 8] & (1 << (i % 8))))))
+        return QVariant();
+
+    const uchar *data = chunk.values.data;
+    qint64 length = chunk.values.length;
+    switch (col.kind)
+    {
+    case Int:
+    {
+        qint64 v;
+        if (readInt(data, length, i, col.width, v))
+            return qlonglong(v);
+        break;
+    }
+    case UInt:
+    {
+        quint64 v;
+        if (readUInt(data, length, i, col.width, v))
+            return qulonglong(v);
+        break;
+    }
+    case Float:
+        if (col.width == 4)
+        {
+            float v;
+            if (readAt(data, length, i, v))
+                return double(v);
+        }
+        else
+        {
+            double v;
+            if (readAt(data, length, i, v))
+                return v;
+        }
+        break;
+    case Bool:
+        if (i / 8 < length)
+            return bool(data[i / 8] & (1 << (i % 8)));
+        break;
+    case Utf8:
+    case Binary:
+    case LargeUtf8:
+    case LargeBinary:
+    {
+        qint64 start = 0, end = 0;
+        if (col.kind == Utf8 || col.kind == Binary)
+        {
+            qint32 s, e;
+            if (!readAt(chunk.offsets.data, chunk.offsets.length, i, s) ||
+                    !readAt(chunk.offsets.data, chunk.offsets.length, i + 1, e))
+                break;
+            start = s;
+            end = e;
+        }
+        else if (!readAt(chunk.offsets.data, chunk.offsets.length, i, start) ||
+                 !readAt(chunk.offsets.data, chunk.offsets.length, i + 1, end))
+            break;
+        if (start < 0 || start > end || end > length)
+            break;
+        int bytes = int(qMin(end - start, maxBytes < 0 ? qint64(INT_MAX) : qint64(maxBytes)));
+        const char *str = reinterpret_cast<const char*>(data + start);
+        if (col.kind == Utf8 || col.kind == LargeUtf8)
+            return QString::fromUtf8(str, bytes);
+        return QByteArray(str, bytes);
+    }
+    case Date32:
+    {
+        qint32 v;
+        if (readAt(data, length, i, v))
+            return QDate::fromJulianDay(v + Arrow::UnixEpochJulianDay);
+        break;
+    }
+    case Date64:
+    {
+        qint64 v;
+        if (readAt(data, length, i, v))
+            return QDateTime::fromMSecsSinceEpoch(v, Qt::UTC).date();
+        break;
+    }
+    case Time:
+    {
+        qint64 v;
+        if (readInt(data, length, i, col.width, v))
+            return QTime::fromMSecsSinceStartOfDay(int(toMSecs(v, col.perMSec)));
+        break;
+    }
+    case Timestamp:
+    {
+        // wall clock time: timezones are not applied
+        qint64 v;
+        if (readAt(data, length, i, v))
+            return QDateTime::fromMSecsSinceEpoch(toMSecs(v, col.perMSec), Qt::UTC);
+        break;
+    }
+    case Null:
+        break;
+    case Unsupported:
+        return tr("(unsupported type)");
+    }
+    return QVariant();
+}
+
+QModelIndex ArrowTableModel::parent(const QModelIndex &) const
+{
+    return QModelIndex();
+}
+
+int ArrowTableModel::rowCount(const QModelIndex &) const
+{
+    return int(qMin(_rowCount, qint64(INT_MAX)));
+}
+
+int ArrowTableModel::columnCount(const QModelIndex &) const
+{
+    return _columns.size();
+}
+
+QModelIndex ArrowTableModel::index(int row, int column, const QModelIndex &) const
+{
+    return createIndex(row, column);
+}
+
+QVariant ArrowTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    switch (role)
+    {
+    case Qt::TextAlignmentRole:
+        return int(_columns.at(index.column()).alignment | Qt::AlignVCenter);
+    case Qt::BackgroundRole:
+        if (value(index.row(), index.column(), 0).isNull())
+            return QBrush(QColor(0, 0, 0, 15));
+        return QVariant();
+    case TableModel::RawDataRole:
+        return value(index.row(), index.column());
+    case Qt::DisplayRole:
+    {
+        // long values are decoded partially, a UTF-8 char takes up to 4 bytes
+        QVariant res = value(index.row(), index.column(), CELL_PREVIEW_LENGTH * 4);
+        switch ((QMetaType::Type)res.type())
+        {
+        case QMetaType::QString:
+        case QMetaType::QByteArray:
+        case QMetaType::QTime:
+        case QMetaType::QDateTime:
+            return TableModel::toText(res, CELL_PREVIEW_LENGTH);
+        default:
+            return res;
+        }
+    }
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ArrowTableModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+
+    return QAbstractItemModel::flags(index);
+}
+
+QVariant ArrowTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Horizontal)
+        return _columns.value(section).name;
+    return QString::number(section + 1);
+}
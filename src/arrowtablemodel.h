@@ -0,0 +1,83 @@
+#ifndef ARROWTABLEMODEL_H
+#define ARROWTABLEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QFile>
+
+/*!
+ * \brief read-only model of a memory-mapped Arrow IPC file (Feather v2)
+ *
+ * Opening reads the footer and record batch metadata only. Cell values are
+ * decoded from the mapped buffers when views request them, so a file of any
+ * size opens instantly. Flat schemas of primitive, string, binary and temporal
+ * columns are supported; compressed files are not.
+ */
+class ArrowTableModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    explicit ArrowTableModel(QObject *parent = 0);
+    ~ArrowTableModel();
+
+    /*!
+     * \brief map a file
+     * \throw QString if it can not be read
+     */
+    void open(const QString &fileName);
+    qint64 rows() const { return _rowCount; }
+
+    virtual QModelIndex parent(const QModelIndex &) const override;
+    virtual int rowCount(const QModelIndex & = QModelIndex()) const override;
+    virtual int columnCount(const QModelIndex & = QModelIndex()) const override;
+    virtual QModelIndex index(int row, int column, const QModelIndex & = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    virtual Qt::ItemFlags flags(const QModelIndex &index) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    enum Kind { Null, Int, UInt, Float, Bool, Utf8, Binary, LargeUtf8, LargeBinary,
+                Date32, Date64, Time, Timestamp, Unsupported };
+    struct Column
+    {
+        QString name;
+        Kind kind;
+        int width;          ///< value size in bytes (fixed width types)
+        qint64 perMSec;     ///< time units per millisecond (temporal types, 0 if units are seconds)
+        Qt::Alignment alignment;
+    };
+    struct Buffer
+    {
+        const uchar *data;
+        qint64 length;
+    };
+    struct ColumnChunk
+    {
+        Buffer validity;
+        Buffer offsets;
+        Buffer values;
+    };
+    struct Batch
+    {
+        qint64 firstRow;
+        qint64 length;
+        QVector<ColumnChunk> columns;
+    };
+
+    QFile _file;
+    uchar *_map;
+    qint64 _size;
+    QVector<Column> _columns;
+    QVector<Batch> _batches;
+    qint64 _rowCount;
+
+    void close();
+    void readSchema(qint64 schema);
+    void readBatch(qint64 offset, qint64 metaDataLength, qint64 bodyLength);
+    /*!
+     * \brief decode a value
+     * \param maxBytes strings and binaries are cut (-1 means full value)
+     */
+    QVariant value(int row, int column, int maxBytes = -1) const;
+};
+
+#endif // ARROWTABLEMODEL_H
@@ -0,0 +1,543 @@
+#include "arrowwriter.h"
+#include "arrowformat.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include <QIODevice>
+#include <QThread>
+#include <QDateTime>
+#include <vector>
+#include <cstring>
+
+// rows per record batch
+#define ARROW_BATCH_ROWS 65536
+// a record batch is written earlier if its buffers grow larger (bytes)
+#define ARROW_BATCH_MAX_BYTES (256 * 1024 * 1024)
+// how long to wait for more rows of a resultset being fetched (ms)
+#define ARROW_POLL_INTERVAL 50
+
+namespace {
+
+/*!
+ * \brief minimal flatbuffers builder
+ *
+ * As in the reference implementation the buffer is filled back to front and
+ * offsets are counted from its end. Nested objects must be created before the
+ * table referring them is started.
+ */
+class FlatBuilder
+{
+public:
+    FlatBuilder() : _buf(1024), _head(_buf.size()), _minAlign(1), _tableStart(0) {}
+
+    uint32_t size() const { return uint32_t(_buf.size() - _head); }
+
+    uint32_t createString(const QByteArray &str)
+    {
+        preAlign(str.size() + 1, 4);
+        pad(1);
+        pushBytes(str.constData(), str.size());
+        push<uint32_t>(str.size());
+        return size();
+    }
+
+    uint32_t createVector(const QVector<uint32_t> &offsets)
+    {
+        preAlign(offsets.size() * 4, 4);
+        for (int i = offsets.size() - 1; i >= 0; --i)
+            pushOffset(offsets[i]);
+        push<uint32_t>(offsets.size());
+        return size();
+    }
+
+    uint32_t createStructVector(const std::vector<int64_t> &data, int structSize)
+    {
+        size_t bytes = data.size() * sizeof(int64_t);
+        preAlign(bytes, 4);
+        preAlign(bytes, 8);
+        pushBytes(data.data(), bytes);
+        push<uint32_t>(uint32_t(bytes / structSize));
+        return size();
+    }
+
+    void startTable()
+    {
+        _fields.clear();
+        _tableStart = size();
+    }
+
+    template <typename T> void addScalar(int id, T value)
+    {
+        preAlign(sizeof(T), sizeof(T));
+        push<T>(value);
+        _fields.append(qMakePair(id, size()));
+    }
+
+    void addOffset(int id, uint32_t offset)
+    {
+        pushOffset(offset);
+        _fields.append(qMakePair(id, size()));
+    }
+
+    uint32_t endTable()
+    {
+        preAlign(4, 4);
+        push<int32_t>(0);   // patched below
+        uint32_t table = size();
+        int maxId = -1;
+        for (const auto &field: _fields)
+            maxId = qMax(maxId, field.first);
+        QVector<uint16_t> offsets(maxId + 1, 0);
+        for (const auto &field: _fields)
+            offsets[field.first] = uint16_t(table - field.second);
+        for (int i = maxId; i >= 0; --i)
+            push<uint16_t>(offsets[i]);
+        push<uint16_t>(uint16_t(table - _tableStart));
+        push<uint16_t>(uint16_t(4 + 2 * (maxId + 1)));
+        // the vtable precedes the table
+        int32_t vtable = int32_t(size() - table);
+        memcpy(&_buf[_buf.size() - table], &vtable, sizeof(vtable));
+        return table;
+    }
+
+    QByteArray finish(uint32_t root)
+    {
+        preAlign(4, _minAlign);
+        pushOffset(root);
+        return QByteArray(reinterpret_cast<const char*>(&_buf[_head]), size());
+    }
+
+private:
+    std::vector<uint8_t> _buf;
+    size_t _head;
+    size_t _minAlign;
+    uint32_t _tableStart;
+    QVector<QPair<int, uint32_t>> _fields;  ///< field id, field offset
+
+    void reserve(size_t len)
+    {
+        if (_head >= len)
+            return;
+        size_t used = size();
+        std::vector<uint8_t> buf(qMax(_buf.size() * 2, used + len));
+        memcpy(&buf[buf.size() - used], &_buf[_head], used);
+        _buf.swap(buf);
+        _head = _buf.size() - used;
+    }
+
+    void pad(size_t len)
+    {
+        reserve(len);
+        _head -= len;
+        memset(&_buf[_head], 0, len);
+    }
+
+    void pushBytes(const void *data, size_t len)
+    {
+        if (!len)
+            return;
+        reserve(len);
+        _head -= len;
+        memcpy(&_buf[_head], data, len);
+    }
+
+    template <typename T> void push(T value)
+    {
+        pushBytes(&value, sizeof(T));
+    }
+
+    void pushOffset(uint32_t offset)
+    {
+        preAlign(4, 4);
+        push<uint32_t>(size() + 4 - offset);
+    }
+
+    /// pads so that len bytes pushed next end aligned
+    void preAlign(size_t len, size_t alignment)
+    {
+        _minAlign = qMax(_minAlign, alignment);
+        pad((~(size() + len) + 1) & (alignment - 1));
+    }
+};
+
+enum ColumnKind { Int64, UInt64, Float64, Bool, Utf8, Binary, Timestamp, Date32, Time32 };
+
+static ColumnKind kindOf(QMetaType::Type type)
+{
+    switch (type)
+    {
+    case QMetaType::Bool:
+        return Bool;
+    case QMetaType::Char:
+    case QMetaType::SChar:
+    case QMetaType::Short:
+    case QMetaType::Int:
+    case QMetaType::Long:
+    case QMetaType::LongLong:
+        return Int64;
+    case QMetaType::UChar:
+    case QMetaType::UShort:
+    case QMetaType::UInt:
+    case QMetaType::ULong:
+    case QMetaType::ULongLong:
+        return UInt64;
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return Float64;
+    case QMetaType::QDateTime:
+        return Timestamp;
+    case QMetaType::QDate:
+        return Date32;
+    case QMetaType::QTime:
+        return Time32;
+    case QMetaType::QByteArray:
+        return Binary;
+    default:
+        return Utf8;
+    }
+}
+
+/*!
+ * \brief kind of a column by its declared type, unless its stored values are not of that type
+ *
+ * Drivers may return date and time values as text (e.g. with time zones). Such a temporal
+ * column is written as Utf8, so values are not lost. It is decided by the first not null
+ * value stored by the time the export starts.
+ */
+static ColumnKind kindOf(const DataTable *table, int column)
+{
+    QMetaType::Type type = table->getColumn(column).variantType();
+    ColumnKind kind = kindOf(type);
+    if (kind != Timestamp && kind != Date32 && kind != Time32)
+        return kind;
+    QVector<DataRow*> rows = table->rows();
+    for (const DataRow *row: rows)
+    {
+        const QVariant &value = row->at(column);
+        if (!value.isNull())
+            return (QMetaType::Type)value.type() == type ? kind : Utf8;
+    }
+    return kind;
+}
+
+/*!
+ * \brief buffers of a column in the record batch being built
+ */
+struct ColumnBuilder
+{
+    ColumnKind kind;
+    QByteArray validity;
+    QByteArray offsets;     ///< int32, utf8 and binary only
+    QByteArray data;
+    qint64 length;
+    qint64 nullCount;
+
+    explicit ColumnBuilder(ColumnKind k = Utf8) : kind(k) { clear(); }
+
+    void clear()
+    {
+        validity.resize(0);
+        offsets.resize(0);
+        data.resize(0);
+        length = nullCount = 0;
+        if (kind == Utf8 || kind == Binary)
+            appendValue<int32_t>(offsets, 0);
+    }
+
+    qint64 bytes() const { return validity.size() + offsets.size() + data.size(); }
+
+    template <typename T> static void appendValue(QByteArray &buf, T value)
+    {
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static void appendBit(QByteArray &bits, qint64 index, bool bit)
+    {
+        if (index % 8 == 0)
+            bits.append('\0');
+        if (bit)
+            bits.data()[index / 8] |= char(1 << (index % 8));
+    }
+
+    void append(const QVariant &value)
+    {
+        bool valid = !value.isNull();
+        // values that do not convert to a valid date or time (e.g. text) are written as nulls
+        QDateTime dt;
+        if (valid && kind == Timestamp)
+        {
+            dt = value.toDateTime();
+            valid = dt.isValid();
+        }
+        else if (valid && kind == Date32)
+            valid = value.toDate().isValid();
+        else if (valid && kind == Time32)
+            valid = value.toTime().isValid();
+        appendBit(validity, length, valid);
+        if (!valid)
+            ++nullCount;
+        switch (kind)
+        {
+        case Int64:
+            appendValue<qint64>(data, valid ? value.toLongLong() : 0);
+            break;
+        case UInt64:
+            appendValue<quint64>(data, valid ? value.toULongLong() : 0);
+            break;
+        case Float64:
+            appendValue<double>(data, valid ? value.toDouble() : 0);
+            break;
+        case Bool:
+            appendBit(data, length, valid && value.toBool());
+            break;
+        case Timestamp:
+        {
+            // naive wall clock time as timezone is not known
+            appendValue<qint64>(data, valid ? QDateTime(dt.date(), dt.time(), Qt::UTC).toMSecsSinceEpoch() : 0);
+            break;
+        }
+        case Date32:
+            appendValue<int32_t>(data, valid ? int32_t(value.toDate().toJulianDay() - Arrow::UnixEpochJulianDay) : 0);
+            break;
+        case Time32:
+            appendValue<int32_t>(data, valid ? value.toTime().msecsSinceStartOfDay() : 0);
+            break;
+        case Utf8:
+            if (valid)
+                data.append((QMetaType::Type)value.type() == QMetaType::QString ?
+                                value.toString().toUtf8() : TableModel::toText(value).toUtf8());
+            appendValue<int32_t>(offsets, data.size());
+            break;
+        case Binary:
+            if (valid)
+                data.append(value.toByteArray());
+            appendValue<int32_t>(offsets, data.size());
+            break;
+        }
+        ++length;
+    }
+};
+
+struct Block
+{
+    qint64 offset;
+    int32_t metaDataLength;
+    qint64 bodyLength;
+};
+
+static uint32_t buildSchema(FlatBuilder &b, const DataTable *table, const QVector<ColumnBuilder> &columns)
+{
+    QVector<uint32_t> fields;
+    for (int c = 0; c < columns.size(); ++c)
+    {
+        uint32_t name = b.createString(table->getColumn(c).name().toUtf8());
+        uint32_t children = b.createVector(QVector<uint32_t>());
+        Arrow::Type typeType = Arrow::Utf8Type;
+        b.startTable();
+        switch (columns[c].kind)
+        {
+        case Int64:
+        case UInt64:
+            typeType = Arrow::IntType;
+            b.addScalar<int32_t>(0, 64);    // bitWidth
+            b.addScalar<uint8_t>(1, columns[c].kind == Int64);  // is_signed
+            break;
+        case Float64:
+            typeType = Arrow::FloatingPointType;
+            b.addScalar<int16_t>(0, Arrow::Double);
+            break;
+        case Bool:
+            typeType = Arrow::BoolType;
+            break;
+        case Utf8:
+            typeType = Arrow::Utf8Type;
+            break;
+        case Binary:
+            typeType = Arrow::BinaryType;
+            break;
+        case Timestamp:
+            typeType = Arrow::TimestampType;
+            b.addScalar<int16_t>(0, Arrow::Millisecond);
+            break;
+        case Date32:
+            typeType = Arrow::DateType;
+            b.addScalar<int16_t>(0, Arrow::Day);
+            break;
+        case Time32:
+            typeType = Arrow::TimeType;
+            b.addScalar<int16_t>(0, Arrow::Millisecond);
+            b.addScalar<int32_t>(1, 32);    // bitWidth
+            break;
+        }
+        uint32_t type = b.endTable();
+        b.startTable();
+        b.addOffset(Arrow::FieldField::Name, name);
+        b.addScalar<uint8_t>(Arrow::FieldField::Nullable, 1);
+        b.addScalar<uint8_t>(Arrow::FieldField::TypeType, typeType);
+        b.addOffset(Arrow::FieldField::Type, type);
+        b.addOffset(Arrow::FieldField::Children, children);
+        fields.append(b.endTable());
+    }
+    uint32_t fieldVector = b.createVector(fields);
+    b.startTable();
+    b.addScalar<int16_t>(Arrow::SchemaField::Endianness, 0);    // little
+    b.addOffset(Arrow::SchemaField::Fields, fieldVector);
+    return b.endTable();
+}
+
+static QByteArray message(FlatBuilder &b, Arrow::MessageHeader headerType, uint32_t header, qint64 bodyLength)
+{
+    b.startTable();
+    b.addScalar<int64_t>(Arrow::MessageField::BodyLength, bodyLength);
+    b.addOffset(Arrow::MessageField::Header, header);
+    b.addScalar<int16_t>(Arrow::MessageField::Version, Arrow::MetadataV5);
+    b.addScalar<uint8_t>(Arrow::MessageField::HeaderType, headerType);
+    return b.finish(b.endTable());
+}
+
+static void padTo8(QByteArray &buf)
+{
+    buf.append(int((8 - buf.size() % 8) % 8), '\0');
+}
+
+/*!
+ * \brief encapsulated message: continuation, metadata length, metadata padded to 8 bytes, body
+ */
+static bool writeMessage(QIODevice &file, QByteArray meta, const QByteArray &body, qint64 &pos, Block &block)
+{
+    padTo8(meta);
+    QByteArray prefix;
+    ColumnBuilder::appendValue<int32_t>(prefix, Arrow::Continuation);
+    ColumnBuilder::appendValue<int32_t>(prefix, meta.size());
+    if (file.write(prefix) != prefix.size() || file.write(meta) != meta.size() ||
+            file.write(body) != body.size())
+        return false;
+    block = { pos, int32_t(prefix.size() + meta.size()), body.size() };
+    pos += prefix.size() + meta.size() + body.size();
+    return true;
+}
+
+static bool writeBatch(QIODevice &file, QVector<ColumnBuilder> &columns, qint64 &pos, QVector<Block> &blocks)
+{
+    std::vector<int64_t> nodes, buffers;
+    QByteArray body;
+    auto addBuffer = [&body, &buffers](const QByteArray &buf) {
+        buffers.push_back(body.size());
+        buffers.push_back(buf.size());
+        body.append(buf);
+        padTo8(body);
+    };
+    qint64 rows = columns.isEmpty() ? 0 : columns.first().length;
+    for (ColumnBuilder &column: columns)
+    {
+        nodes.push_back(column.length);
+        nodes.push_back(column.nullCount);
+        addBuffer(column.nullCount ? column.validity : QByteArray());
+        if (column.kind == Utf8 || column.kind == Binary)
+            addBuffer(column.offsets);
+        addBuffer(column.data);
+        column.clear();
+    }
+    FlatBuilder b;
+    uint32_t nodeVector = b.createStructVector(nodes, Arrow::FieldNodeSize);
+    uint32_t bufferVector = b.createStructVector(buffers, Arrow::BufferSize);
+    b.startTable();
+    b.addScalar<int64_t>(Arrow::RecordBatchField::Length, rows);
+    b.addOffset(Arrow::RecordBatchField::Nodes, nodeVector);
+    b.addOffset(Arrow::RecordBatchField::Buffers, bufferVector);
+    uint32_t batch = b.endTable();
+    Block block;
+    if (!writeMessage(file, message(b, Arrow::RecordBatchMessage, batch, body.size()), body, pos, block))
+        return false;
+    blocks.append(block);
+    return true;
+}
+
+}
+
+QString ArrowWriter::write(const DataTable *table, QIODevice &file,
+                           const std::atomic<bool> &inputFinished, const std::atomic<bool> &cancelled,
+                           std::function<void(qint64)> progress)
+{
+    QVector<ColumnBuilder> columns;
+    for (int c = 0; c < table->columnCount(); ++c)
+        columns.append(ColumnBuilder(kindOf(table, c)));
+
+    QByteArray header(Arrow::Magic, Arrow::MagicSize);
+    padTo8(header);
+    if (file.write(header) != header.size())
+        return file.errorString();
+    qint64 pos = header.size();
+    Block schemaBlock;
+    {
+        FlatBuilder b;
+        uint32_t schema = buildSchema(b, table, columns);
+        if (!writeMessage(file, message(b, Arrow::SchemaMessage, schema, 0), QByteArray(), pos, schemaBlock))
+            return file.errorString();
+    }
+
+    QVector<Block> blocks;
+    qint64 written = 0;
+    qint64 batchBytes = 0;
+    forever
+    {
+        // checked before taking rows so that the last rows are not missed
+        bool last = inputFinished;
+        // the list is a snapshot: rows appended later do not affect it
+        QVector<DataRow*> rows = table->rows();
+        for (; written < rows.size(); ++written)
+        {
+            const DataRow &row = *rows[written];
+            batchBytes = 0;
+            for (int c = 0; c < columns.size(); ++c)
+            {
+                columns[c].append(row.at(c));
+                batchBytes += columns[c].bytes();
+            }
+            if (columns.isEmpty() || (columns.first().length < ARROW_BATCH_ROWS && batchBytes < ARROW_BATCH_MAX_BYTES))
+                continue;
+            if (!writeBatch(file, columns, pos, blocks))
+                return file.errorString();
+            if (progress)
+                progress(written + 1);
+            if (cancelled)
+                return QObject::tr("export cancelled");
+        }
+        if (cancelled)
+            return QObject::tr("export cancelled");
+        if (last)
+            break;
+        QThread::msleep(ARROW_POLL_INTERVAL);
+    }
+    if (!columns.isEmpty() && columns.first().length && !writeBatch(file, columns, pos, blocks))
+        return file.errorString();
+
+    // end of stream marker, then the footer repeating the schema and locating batches
+    QByteArray tail;
+    ColumnBuilder::appendValue<int32_t>(tail, Arrow::Continuation);
+    ColumnBuilder::appendValue<int32_t>(tail, 0);
+    FlatBuilder b;
+    uint32_t schema = buildSchema(b, table, columns);
+    std::vector<int64_t> blockData;
+    for (const Block &block: blocks)
+    {
+        blockData.push_back(block.offset);
+        blockData.push_back(block.metaDataLength);  // the upper half is padding
+        blockData.push_back(block.bodyLength);
+    }
+    uint32_t dictionaries = b.createStructVector(std::vector<int64_t>(), Arrow::BlockSize);
+    uint32_t batches = b.createStructVector(blockData, Arrow::BlockSize);
+    b.startTable();
+    b.addOffset(Arrow::FooterField::Schema, schema);
+    b.addOffset(Arrow::FooterField::Dictionaries, dictionaries);
+    b.addOffset(Arrow::FooterField::RecordBatches, batches);
+    b.addScalar<int16_t>(Arrow::FooterField::Version, Arrow::MetadataV5);
+    QByteArray footer = b.finish(b.endTable());
+    tail.append(footer);
+    ColumnBuilder::appendValue<int32_t>(tail, footer.size());
+    tail.append(Arrow::Magic, Arrow::MagicSize);
+    if (file.write(tail) != tail.size())
+        return file.errorString();
+    if (progress)
+        progress(written);
+    return QString();
+}
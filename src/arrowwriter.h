@@ -0,0 +1,31 @@
+#ifndef ARROWWRITER_H
+#define ARROWWRITER_H
+
+#include <QString>
+#include <atomic>
+#include <functional>
+
+class DataTable;
+class QIODevice;
+
+/*!
+ * \brief writes resultset rows as an Apache Arrow IPC file (Feather v2)
+ *
+ * The writer is self-contained: flatbuffers metadata is built by a minimal
+ * builder. Rows are written by record batches, so the whole resultset is never
+ * converted at once. Column types: int64/uint64, float64, bool, utf8, binary,
+ * timestamp[ms], date32 and time32[ms]; other values are written as text.
+ */
+class ArrowWriter
+{
+public:
+    /*!
+     * \brief write rows of a table (rows appended later are written until inputFinished is set)
+     * \return error message (empty on success)
+     */
+    static QString write(const DataTable *table, QIODevice &file,
+                         const std::atomic<bool> &inputFinished, const std::atomic<bool> &cancelled,
+                         std::function<void(qint64)> progress);
+};
+
+#endif // ARROWWRITER_H
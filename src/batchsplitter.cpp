@@ -0,0 +1,164 @@
+#include "batchsplitter.h"
+
+BatchSplitter::BatchSplitter(const QString &script) :
+    _script(script)
+{
+}
+
+bool BatchSplitter::next()
+{
+    const QChar *data = _script.constData();
+    const int size = _script.size();
+    while (_pos < size)
+    {
+        _start = _pos;
+        _count = 1;
+        bool line_start = true;
+        int i = _pos;
+        for (;;)
+        {
+            int line_end, count;
+            if (line_start && isSeparator(i, line_end, count))
+            {
+                _end = i;
+                _count = count;
+                _pos = (line_end < size ? line_end + 1 : size);
+                break;
+            }
+            if (i >= size)
+            {
+                _end = _pos = size;
+                break;
+            }
+
+            line_start = false;
+            ushort c = data[i].unicode();
+            ushort next = (i + 1 < size ? data[i + 1].unicode() : 0);
+            if (c == '\n')
+            {
+                line_start = true;
+                ++i;
+            }
+            else if (c == '-' && next == '-')
+            {
+                // line comment, stop at the line end to check the next line
+                while (i < size && data[i] != '\n')
+                    ++i;
+            }
+            else if (c == '/' && next == '*')
+            {
+                // block comments are nested in T-SQL
+                int depth = 1;
+                i += 2;
+                while (i < size && depth)
+                {
+                    if (data[i] == '/' && i + 1 < size && data[i + 1] == '*')
+                    {
+                        ++depth;
+                        i += 2;
+                    }
+                    else if (data[i] == '*' && i + 1 < size && data[i + 1] == '/')
+                    {
+                        --depth;
+                        i += 2;
+                    }
+                    else
+                        ++i;
+                }
+            }
+            else if (c == '\'' || c == '"' || c == '[')
+            {
+                // doubled closing quote is an escape: the literal is just continued
+                ushort closing = (c == '[' ? ']' : c);
+                ++i;
+                while (i < size && data[i] != closing)
+                    ++i;
+                if (i < size)
+                    ++i;
+            }
+            else
+                ++i;
+        }
+
+        if (!isBlank(_start, _end))
+            return true;
+    }
+    _start = _end = size;
+    _count = 0;
+    return false;
+}
+
+bool BatchSplitter::isSeparator(int lineStart, int &lineEnd, int &count) const
+{
+    const QChar *data = _script.constData();
+    const int size = _script.size();
+    int i = lineStart;
+    auto skip_spaces = [&]() {
+        while (i < size && (data[i] == ' ' || data[i] == '\t'))
+            ++i;
+    };
+
+    skip_spaces();
+    if (i + 1 >= size ||
+            (data[i] != 'g' && data[i] != 'G') ||
+            (data[i + 1] != 'o' && data[i + 1] != 'O'))
+        return false;
+    i += 2;
+    if (i < size && data[i] != ' ' && data[i] != '\t' && data[i] != '\r' && data[i] != '\n' && data[i] != '-')
+        return false;
+
+    skip_spaces();
+    int digits = i;
+    count = 0;
+    while (i < size && data[i].isDigit() && count < 1000000)
+        count = count * 10 + data[i++].digitValue();
+    if (i == digits || count < 1)
+        count = 1;
+
+    skip_spaces();
+    if (i + 1 < size && data[i] == '-' && data[i + 1] == '-')
+    {
+        while (i < size && data[i] != '\n')
+            ++i;
+    }
+    if (i < size && data[i] == '\r')
+        ++i;
+    if (i < size && data[i] != '\n')
+        return false;
+
+    lineEnd = i;
+    return true;
+}
+
+bool BatchSplitter::isBlank(int start, int end) const
+{
+    const QChar *data = _script.constData();
+    for (int i = start; i < end; ++i)
+    {
+        if (!data[i].isSpace())
+            return false;
+    }
+    return true;
+}
+
+QString BatchSplitter::batch(bool crlf) const
+{
+    const QChar *data = _script.constData();
+    // the script outlives the batch (the splitter owns a shallow copy of it)
+    if (!crlf)
+        return QString::fromRawData(data + _start, _end - _start);
+
+    QString res;
+    res.reserve(_end - _start + (_end - _start) / 16);
+    int line = _start;
+    for (int i = _start; i < _end; ++i)
+    {
+        if (data[i] != '\n' || (i > _start && data[i - 1] == '\r'))
+            continue;
+        res.append(data + line, i - line);
+        res.append(QLatin1String("\r\n"));
+        line = i + 1;
+    }
+    res.append(data + line, _end - line);
+    return res;
+}
@@ -0,0 +1,39 @@
+#ifndef BATCHSPLITTER_H
+#define BATCHSPLITTER_H
+
+#include <QString>
+
+/*!
+ * \brief single-pass splitter of a T-SQL script into batches separated by "go [count]" lines
+ *
+ * The script is scanned lazily up to the end of the next batch only. "go" within
+ * strings, quoted identifiers and comments does not separate batches.
+ */
+class BatchSplitter
+{
+public:
+    explicit BatchSplitter(const QString &script);
+
+    /*!
+     * \brief find the next non-empty batch
+     * \return false if the script is over
+     */
+    bool next();
+    /*!
+     * \brief the current batch (shares the script data unless line ends are converted)
+     * \param crlf convert lone \n line ends to \r\n
+     */
+    QString batch(bool crlf) const;
+    int count() const { return _count; } ///< how many times the current batch must be executed
+
+private:
+    const QString _script;
+    int _pos = 0;
+    int _start = 0, _end = 0; ///< current batch bounds
+    int _count = 0;
+
+    bool isSeparator(int lineStart, int &lineEnd, int &count) const;
+    bool isBlank(int start, int end) const;
+};
+
+#endif // BATCHSPLITTER_H
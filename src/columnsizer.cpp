@@ -0,0 +1,162 @@
+#include "columnsizer.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include <QTableView>
+#include <QHeaderView>
+#include <QStyle>
+#include <QFontMetrics>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QMutex>
+#include <QHash>
+#include <random>
+
+// sampled rows: the first and the last ones plus random rows in between
+#define SAMPLE_HEAD_ROWS 100
+#define SAMPLE_TAIL_ROWS 100
+#define SAMPLE_RANDOM_ROWS 200
+// widths of long values are not measured beyond this length (chars)
+#define SAMPLE_TEXT_LENGTH 200
+// the same limit as TableModel uses for long values
+#define MAX_COLUMN_WIDTH 500
+
+static inline int horizontalAdvance(const QFontMetrics &fm, const QString &text)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    return fm.horizontalAdvance(text);
+#else
+    return fm.width(text);
+#endif
+}
+
+void ColumnSizer::resizeColumns(QTableView *view)
+{
+    const TableModel *model = qobject_cast<const TableModel*>(view->model());
+    if (!model)
+    {
+        view->resizeColumnsToContents();
+        return;
+    }
+    const DataTable *table = model->table();
+    int columns = table->columnCount();
+    int rows = table->rowCount();
+    if (!columns)
+        return;
+
+    // rows are appended in this thread only - it is safe to read them here
+    Sample sample;
+    sample.font = view->font();
+    sample.padding = 2 * (view->style()->pixelMetric(QStyle::PM_FocusFrameHMargin, 0, view) + 1) +
+            (view->showGrid() ? 1 : 0);
+    sample.maxWidth = MAX_COLUMN_WIDTH;
+    for (int c = 0; c < columns; ++c)
+    {
+        DataColumn &column = table->getColumn(c);
+        // character columns' size is their max length (if known)
+        sample.maxChars.append((column.variantType() == QMetaType::QString && column.size() > 0) ?
+                                   column.size() : -1);
+        sample.minWidths.append(view->horizontalHeader()->sectionSizeHint(c));
+    }
+
+    QVector<int> indexes;
+    if (rows <= SAMPLE_HEAD_ROWS + SAMPLE_TAIL_ROWS + SAMPLE_RANDOM_ROWS)
+    {
+        for (int r = 0; r < rows; ++r)
+            indexes.append(r);
+    }
+    else
+    {
+        for (int r = 0; r < SAMPLE_HEAD_ROWS; ++r)
+            indexes.append(r);
+        std::minstd_rand rnd(rows);
+        std::uniform_int_distribution<int> middle(SAMPLE_HEAD_ROWS, rows - SAMPLE_TAIL_ROWS - 1);
+        for (int i = 0; i < SAMPLE_RANDOM_ROWS; ++i)
+            indexes.append(middle(rnd));
+        for (int r = rows - SAMPLE_TAIL_ROWS; r < rows; ++r)
+            indexes.append(r);
+    }
+    sample.rows.reserve(indexes.size());
+    for (int r: indexes)
+    {
+        const DataRow &row = table->getRow(r);
+        QVector<QVariant> values(columns);
+        for (int c = 0; c < columns; ++c)
+            values[c] = row.at(c);
+        sample.rows.append(values);
+    }
+
+    // the watcher goes away with the view, the worker owns its copy of the sample
+    QFutureWatcher<QVector<int>> *watcher = new QFutureWatcher<QVector<int>>(view);
+    QObject::connect(watcher, &QFutureWatcher<QVector<int>>::finished, view, [view, watcher, model]() {
+        QVector<int> widths = watcher->result();
+        watcher->deleteLater();
+        // the view may be showing another resultset by now
+        if (view->model() != model || model->columnCount() != widths.size())
+            return;
+        for (int c = 0; c < widths.size(); ++c)
+            view->setColumnWidth(c, widths[c]);
+    });
+    watcher->setFuture(QtConcurrent::run(&ColumnSizer::measure, sample));
+}
+
+QVector<int> ColumnSizer::measure(const Sample &sample)
+{
+    QVector<int> widths = sample.minWidths;
+    QVector<int> advances = asciiAdvances(sample.font);
+    for (const QVector<QVariant> &row: sample.rows)
+    {
+        for (int c = 0; c < row.size(); ++c)
+        {
+            if (widths[c] >= sample.maxWidth || row[c].isNull())
+                continue;
+            QString text = TableModel::toText(row[c], SAMPLE_TEXT_LENGTH);
+            int width = textWidth(text, sample.font, advances) + sample.padding;
+            if (width > widths[c])
+                widths[c] = width;
+        }
+    }
+    int maxCharWidth = QFontMetrics(sample.font).maxWidth();
+    for (int c = 0; c < widths.size(); ++c)
+    {
+        if (sample.maxChars[c] > 0)
+        {
+            int limit = sample.maxChars[c] * maxCharWidth + sample.padding;
+            widths[c] = qMin(widths[c], qMax(limit, sample.minWidths[c]));
+        }
+        widths[c] = qMin(widths[c], qMax(sample.maxWidth, sample.minWidths[c]));
+    }
+    return widths;
+}
+
+QVector<int> ColumnSizer::asciiAdvances(const QFont &font)
+{
+    // font metrics are taken once per font
+    static QMutex guard;
+    static QHash<QString, QVector<int>> advances;
+
+    QMutexLocker lk(&guard);
+    QString key = font.key();
+    auto it = advances.find(key);
+    if (it == advances.end())
+    {
+        QFontMetrics fm(font);
+        QVector<int> widths(128);
+        for (int ch = 0; ch < 128; ++ch)
+            widths[ch] = horizontalAdvance(fm, QString(QLatin1Char(char(ch))));
+        it = advances.insert(key, widths);
+    }
+    return it.value();
+}
+
+int ColumnSizer::textWidth(const QString &text, const QFont &font, const QVector<int> &advances)
+{
+    // ASCII texts are summed up from cached advances, other texts are measured as a whole
+    int width = 0;
+    for (QChar ch: text)
+    {
+        if (ch.unicode() >= 128)
+            return horizontalAdvance(QFontMetrics(font), text);
+        width += advances[ch.unicode()];
+    }
+    return width;
+}
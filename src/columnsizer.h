@@ -0,0 +1,43 @@
+#ifndef COLUMNSIZER_H
+#define COLUMNSIZER_H
+
+#include <QFont>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+class QTableView;
+
+/*!
+ * \brief fits column widths of a result grid to a sample of its rows
+ *
+ * Instead of measuring every row (like QTableView::resizeColumnsToContents does)
+ * the head, the tail and random rows of the table are taken. Values are copied
+ * in the calling thread, texts are measured by a worker thread and the view
+ * gets all the widths at once.
+ */
+class ColumnSizer
+{
+public:
+    /*!
+     * \brief start sizing columns of a view showing a TableModel
+     */
+    static void resizeColumns(QTableView *view);
+
+private:
+    struct Sample
+    {
+        QFont font;
+        QVector<QVector<QVariant>> rows;
+        QVector<int> maxChars;  ///< per column: length limit known from metadata (-1 if none)
+        QVector<int> minWidths; ///< per column: header width
+        int padding;
+        int maxWidth;
+    };
+
+    static QVector<int> measure(const Sample &sample);
+    static QVector<int> asciiAdvances(const QFont &font);
+    static int textWidth(const QString &text, const QFont &font, const QVector<int> &advances);
+};
+
+#endif // COLUMNSIZER_H
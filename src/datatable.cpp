@@ -59,6 +59,12 @@ DataRow& DataTable::getRow(int ind) const
     return *_rows.at(ind);
 }
 
+QVector<DataRow*> DataTable::rows() const
+{
+    QMutexLocker locker(&mutex);
+    return _rows;
+}
+
 DataColumn& DataTable::addColumn(QString col_name, QMetaType::Type type, int sql_type, int size, int16_t dec_digits, int8_t nullable_desc, Qt::AlignmentFlag hAlignment)
 {
     DataColumn* new_col = new DataColumn(col_name, type, sql_type, size, dec_digits, nullable_desc, hAlignment);
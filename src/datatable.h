@@ -16,6 +16,7 @@ public:
     DataColumn(QString _col_name, QMetaType::Type type, int sql_type, int size, int16_t _dec_digits, int8_t _nullable_desc, Qt::AlignmentFlag hAlignment);
     QMetaType::Type variantType() { return _var_type; }
     int sqlType() { return _sql_type; }
+    int size() { return _col_size; }
     QString name() { return _col_name; }
     Qt::AlignmentFlag hAlignment() { return _hAlignment; }
 private:
@@ -37,6 +38,7 @@ public:
     ~DataRow();
     QVariant& operator[](QString column_name);
     QVariant& operator[](int index);
+    const QVariant& at(int index) const { return _row.at(index); }
 private:
     QVector<QVariant> _row;
     DataTable* _table;
@@ -58,6 +60,7 @@ public:
     DataColumn& getColumn(int ord) const;
     int getColumnOrd(QString column_name) const;
     DataRow& getRow(int ind) const;
+    QVector<DataRow*> rows() const; ///< shallow copy of the rows list (rows appended later are not in it)
     mutable QMutex mutex;
 public slots:
     int columnCount() const;
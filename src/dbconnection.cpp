@@ -51,6 +51,31 @@ DataTable* DbConnection::execute(const QString &query, const QVariantList &param
     return nullptr;
 }
 
+QVector<bool> DbConnection::executeBatch(const QString &query, const QVector<QVector<QVariant>> &paramSets)
+{
+    QVector<bool> res;
+    res.reserve(paramSets.size());
+    for (const QVector<QVariant> &params: paramSets)
+    {
+        res.append(execute(query, &params));
+        clearResultsets();
+    }
+    return res;
+}
+
+QVariantList DbConnection::executeBatch(const QString &query, const QVariantList &paramSets)
+{
+    QVector<QVector<QVariant>> sets;
+    sets.reserve(paramSets.size());
+    for (const QVariant &params: paramSets)
+        sets.append(params.toList().toVector());
+
+    QVariantList res;
+    for (bool ok: executeBatch(query, sets))
+        res.append(ok);
+    return res;
+}
+
 void DbConnection::appendResultset(DataTable *table)
 {
     clearResultsets();
@@ -75,6 +75,11 @@ public:
      * \brief synchronous query execution used by objects tree and so on
      */
     virtual bool execute(const QString &query, const QVector<QVariant> *params = nullptr, int limit = -1) = 0;
+    /*!
+     * \brief execute a statement once per parameter set (resultsets are discarded)
+     * \return success flag of every parameter set
+     */
+    virtual QVector<bool> executeBatch(const QString &query, const QVector<QVector<QVariant>> &paramSets);
 
     void setDatabase(const QString &database);
     void setConnectionString(const QString &connectionString);
@@ -84,6 +89,7 @@ public:
 
 public slots: // to use from QJSEngine
     virtual DataTable* execute(const QString &query, const QVariantList &params);
+    QVariantList executeBatch(const QString &query, const QVariantList &paramSets);
     void appendResultset(DataTable* table);
     void clearResultsets();
 
@@ -33,6 +33,12 @@ void DbConnectionFactory::removeConnection(QString name)
 {
     if (!_connections.contains(name))
         return;
-    _connections.remove(name);
+    // disconnect an idle ODBC connection right away even if it is still referenced
+    // (reopened on demand): it returns to the driver manager's pool to be reused
+    // by the next connection with the same connection string (shared only if
+    // the driver resets pooled sessions)
+    std::shared_ptr<DbConnection> con = _connections.take(name);
+    if (dynamic_cast<OdbcConnection*>(con.get()) && con->queryState() == QueryState::Inactive)
+        con->close();
 }
 
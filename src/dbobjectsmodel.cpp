@@ -17,6 +17,8 @@
 #include <QUuid>
 #include "dbosortfilterproxymodel.h"
 #include "scripting.h"
+#include "tableexporter.h"
+#include "resultquery.h"
 
 #include <QJSEngine>
 #include <QJSValueList>
@@ -440,6 +442,37 @@ DataTable *DbObjectsModel::nodeChildren(const QModelIndex &obj)
                         })");
             e.globalObject().setProperty("exec", exec_fn);
 
+            QJSValue exec_batch_fn = e.evaluate(R"(
+                        function(query, paramSets) {
+                            return __connection.executeBatch(query, paramSets);
+                        })");
+            e.globalObject().setProperty("execBatch", exec_batch_fn);
+
+            // "export" is a reserved word in JavaScript
+            TableExporter exporter;
+            QQmlEngine::setObjectOwnership(&exporter, QQmlEngine::CppOwnership);
+            e.globalObject().setProperty("__exporter", e.newQObject(&exporter));
+            QJSValue export_fn = e.evaluate(R"(
+                        function(resultset, fileName, format, tableName) {
+                            var err = __exporter.exportTable(resultset, fileName, format || "", tableName || "");
+                            if (err)
+                                throw new Error(err);
+                        })");
+            e.globalObject().setProperty("exportTable", export_fn);
+
+            // resultsets passed after the query are named r1, r2 and so on
+            ResultQuery resultQuery;
+            QQmlEngine::setObjectOwnership(&resultQuery, QQmlEngine::CppOwnership);
+            e.globalObject().setProperty("__query", e.newQObject(&resultQuery));
+            QJSValue query_fn = e.evaluate(R"(
+                        function(query) {
+                            var res = __query.query(query, Array.prototype.slice.call(arguments, 1));
+                            if (!res)
+                                throw new Error(__query.lastError());
+                            return res;
+                        })");
+            e.globalObject().setProperty("query", query_fn);
+
             QJSValue return_fn = e.evaluate(R"(
                                             function(resultset) {
                                                 __connection.appendResultset(resultset);
@@ -0,0 +1,240 @@
+#include "diffmodel.h"
+#include "tablemodel.h"
+#include <QBrush>
+#include <QtConcurrent>
+
+// max length of the text displayed within a cell
+#define CELL_PREVIEW_LENGTH 1000
+
+DiffModel::DiffModel(QObject *parent) :
+    QAbstractItemModel(parent), _cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+    connect(&_watcher, &QFutureWatcher<TableDiff::Result>::finished, this, &DiffModel::onFinished);
+}
+
+DiffModel::~DiffModel()
+{
+    cancel();
+    // the worker reads rows owned by the model
+    _watcher.waitForFinished();
+}
+
+QVector<DataRow> DiffModel::copyRows(const DataTable *table)
+{
+    QVector<DataRow*> rows = table->rows();
+    QVector<DataRow> res;
+    res.reserve(rows.size());
+    for (const DataRow *row: rows)
+        res.append(*row);
+    return res;
+}
+
+void DiffModel::compare(const DataTable *lt, const DataTable *rt, const QStringList &keyColumns)
+{
+    cancel();
+    _watcher.waitForFinished();
+
+    QVector<int> leftColumns, rightColumns, keys;
+    QStringList names;
+    QVector<Qt::Alignment> alignments;
+    for (int c = 0; c < lt->columnCount(); ++c)
+    {
+        QString name = lt->getColumn(c).name();
+        int rc = -1;
+        for (int i = 0; i < rt->columnCount() && rc < 0; ++i)
+        {
+            if (rt->getColumn(i).name().compare(name, Qt::CaseInsensitive) == 0)
+                rc = i;
+        }
+        if (rc < 0)
+            continue;
+        leftColumns.append(c);
+        rightColumns.append(rc);
+        names.append(name);
+        alignments.append(lt->getColumn(c).hAlignment());
+    }
+    if (names.isEmpty())
+        throw tr("resultsets have no columns of the same names");
+    for (const QString &key: keyColumns)
+    {
+        int k = -1;
+        for (int i = 0; i < names.size() && k < 0; ++i)
+        {
+            if (names[i].compare(key.trimmed(), Qt::CaseInsensitive) == 0)
+                k = i;
+        }
+        if (k < 0)
+            throw tr("column %1 is not found in both resultsets").arg(key.trimmed());
+        keys.append(k);
+    }
+
+    beginResetModel();
+    _left = copyRows(lt);
+    _right = copyRows(rt);
+    _leftColumns = leftColumns;
+    _rightColumns = rightColumns;
+    _names = names;
+    _alignments = alignments;
+    _rows.clear();
+    _slots.clear();
+    endResetModel();
+
+    *_cancelled = false;
+    std::shared_ptr<std::atomic<bool>> cancelled = _cancelled;
+    _watcher.setFuture(QtConcurrent::run([this, keys, cancelled]() {
+        return TableDiff::compare(_left, _right, _leftColumns, _rightColumns, keys, cancelled);
+    }));
+}
+
+void DiffModel::cancel()
+{
+    *_cancelled = true;
+}
+
+void DiffModel::onFinished()
+{
+    TableDiff::Result res = _watcher.result();
+    if (res.cancelled || !res.error.isEmpty())
+    {
+        beginResetModel();
+        _left.clear();
+        _right.clear();
+        endResetModel();
+        emit finished(res.cancelled ? tr("comparison cancelled") : res.error);
+        return;
+    }
+    // only rows of differences are kept
+    QVector<DataRow> left, right;
+    QVector<QPair<int, int>> slots(res.rows.size(), qMakePair(-1, -1));
+    for (int i = 0; i < res.rows.size(); ++i)
+    {
+        const TableDiff::Row &r = res.rows.at(i);
+        if (r.left >= 0)
+        {
+            slots[i].first = left.size();
+            left.append(_left.at(r.left));
+        }
+        if (r.right >= 0)
+        {
+            slots[i].second = right.size();
+            right.append(_right.at(r.right));
+        }
+    }
+    beginResetModel();
+    _left = left;
+    _right = right;
+    _slots = slots;
+    _rows = res.rows;
+    endResetModel();
+
+    qint64 onlyLeft = 0, onlyRight = 0, changed = 0;
+    for (const TableDiff::Row &r: _rows)
+    {
+        switch (r.kind)
+        {
+        case TableDiff::OnlyLeft:
+            ++onlyLeft;
+            break;
+        case TableDiff::OnlyRight:
+            ++onlyRight;
+            break;
+        case TableDiff::Changed:
+            ++changed;
+            break;
+        }
+    }
+    emit finished(tr("%1 rows are equal, %2 only in the first resultset, %3 only in the second one, %4 changed")
+                  .arg(res.equal).arg(onlyLeft).arg(onlyRight).arg(changed));
+}
+
+QModelIndex DiffModel::parent(const QModelIndex &) const
+{
+    return QModelIndex();
+}
+
+int DiffModel::rowCount(const QModelIndex &) const
+{
+    return _rows.size();
+}
+
+int DiffModel::columnCount(const QModelIndex &) const
+{
+    // the first column shows the kind of difference and row numbers
+    return _names.size() + 1;
+}
+
+QModelIndex DiffModel::index(int row, int column, const QModelIndex &) const
+{
+    return createIndex(row, column);
+}
+
+QVariant DiffModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    const TableDiff::Row &r = _rows.at(index.row());
+    const DataRow *left = (r.left >= 0 ? &_left.at(_slots.at(index.row()).first) : nullptr);
+    const DataRow *right = (r.right >= 0 ? &_right.at(_slots.at(index.row()).second) : nullptr);
+    int c = index.column() - 1;
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        if (c < 0)
+        {
+            switch (r.kind)
+            {
+            case TableDiff::OnlyLeft:
+                return QString("- %1").arg(r.left + 1);
+            case TableDiff::OnlyRight:
+                return QString("+ %1").arg(r.right + 1);
+            case TableDiff::Changed:
+                return QString("~ %1 / %2").arg(r.left + 1).arg(r.right + 1);
+            }
+            return QVariant();
+        }
+        if (r.kind == TableDiff::OnlyRight)
+            return TableModel::toText(right->at(_rightColumns[c]), CELL_PREVIEW_LENGTH);
+        if (r.kind == TableDiff::Changed &&
+                !TableDiff::equal(left->at(_leftColumns[c]), right->at(_rightColumns[c])))
+        {
+            return TableModel::toText(left->at(_leftColumns[c]), CELL_PREVIEW_LENGTH) + QString(" -> ") +
+                    TableModel::toText(right->at(_rightColumns[c]), CELL_PREVIEW_LENGTH);
+        }
+        return TableModel::toText(left->at(_leftColumns[c]), CELL_PREVIEW_LENGTH);
+    case Qt::TextAlignmentRole:
+        if (c < 0)
+            return QVariant();
+        return int(_alignments[c] | Qt::AlignVCenter);
+    case Qt::BackgroundRole:
+        switch (r.kind)
+        {
+        case TableDiff::OnlyLeft:
+            return QBrush(QColor(255, 0, 0, 30));
+        case TableDiff::OnlyRight:
+            return QBrush(QColor(0, 200, 0, 30));
+        case TableDiff::Changed:
+            if (c < 0 || !TableDiff::equal(left->at(_leftColumns[c]), right->at(_rightColumns[c])))
+                return QBrush(QColor(255, 200, 0, 60));
+            return QVariant();
+        }
+        return QVariant();
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags DiffModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+
+    return QAbstractItemModel::flags(index);
+}
+
+QVariant DiffModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Horizontal)
+        return section ? _names.value(section - 1) : tr("row");
+    return QString::number(section + 1);
+}
@@ -0,0 +1,62 @@
+#ifndef DIFFMODEL_H
+#define DIFFMODEL_H
+
+#include <QAbstractItemModel>
+#include <QFutureWatcher>
+#include <QStringList>
+#include "datatable.h"
+#include "tablediff.h"
+
+/*!
+ * \brief differences of two resultsets: rows only on the left, only on the right and changed ones
+ *
+ * Rows are compared in background. The model keeps its own copies of rows
+ * (values are shared), so compared resultsets may be cleared meanwhile.
+ * Once compared, only copies of rows of differences are kept, cells are
+ * rendered on demand.
+ */
+class DiffModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    explicit DiffModel(QObject *parent = 0);
+    ~DiffModel();
+
+    /*!
+     * \brief start comparing
+     *
+     * Columns present in both resultsets (by name) are compared.
+     * \param keyColumns names of columns identifying rows (whole rows are matched if empty)
+     * \throw QString if a key column is missing or there are no common columns
+     */
+    void compare(const DataTable *left, const DataTable *right, const QStringList &keyColumns);
+    void cancel();
+
+    virtual QModelIndex parent(const QModelIndex &) const override;
+    virtual int rowCount(const QModelIndex & = QModelIndex()) const override;
+    virtual int columnCount(const QModelIndex & = QModelIndex()) const override;
+    virtual QModelIndex index(int row, int column, const QModelIndex & = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    virtual Qt::ItemFlags flags(const QModelIndex &index) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    void finished(const QString &summary);
+
+private:
+    QVector<DataRow> _left;
+    QVector<DataRow> _right;
+    QVector<int> _leftColumns;
+    QVector<int> _rightColumns;
+    QStringList _names;
+    QVector<Qt::Alignment> _alignments;
+    QVector<TableDiff::Row> _rows;
+    QVector<QPair<int, int>> _slots;    ///< indexes of rows of differences within _left and _right
+    QFutureWatcher<TableDiff::Result> _watcher;
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+
+    void onFinished();
+    static QVector<DataRow> copyRows(const DataTable *table);
+};
+
+#endif // DIFFMODEL_H
@@ -0,0 +1,151 @@
+#include "keywordtable.h"
+#include <algorithm>
+
+// average number of words in a bucket
+#define KEYWORD_BUCKET_SIZE 4
+// seeds tried for a bucket before the table is enlarged
+#define KEYWORD_MAX_SEED 4096
+
+static inline ushort foldCase(ushort c)
+{
+    if (c < 128)
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    return static_cast<ushort>(QChar::toLower(c));
+}
+
+KeywordTable::KeywordTable()
+{
+}
+
+int KeywordTable::insert(int parent, const QString &word)
+{
+    QString text = word.toLower();
+    QString key = QString::number(parent) + ' ' + text;
+    auto it = _index.constFind(key);
+    if (it != _index.constEnd())
+        return it.value();
+    _words.append({ text, parent });
+    _index.insert(key, _words.size() - 1);
+    _seeds.clear();
+    _slots.clear();
+    return _words.size() - 1;
+}
+
+void KeywordTable::compile()
+{
+    _seeds.clear();
+    _slots.clear();
+    if (_words.isEmpty())
+        return;
+
+    int bucketCount = _words.size() / KEYWORD_BUCKET_SIZE + 1;
+    QVector<QVector<int>> buckets(bucketCount);
+    for (int i = 0; i < _words.size(); ++i)
+    {
+        const Word &w = _words.at(i);
+        buckets[hash(w.parent, w.text.constData(), w.text.length(), 0) % bucketCount].append(i);
+    }
+    // the largest buckets are placed first, while the table is mostly empty
+    QVector<int> order(bucketCount);
+    for (int i = 0; i < bucketCount; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&buckets](int a, int b) {
+        return buckets.at(a).size() > buckets.at(b).size();
+    });
+
+    int size = 1;
+    while (size < _words.size() * 2)
+        size <<= 1;
+    while (true)
+    {
+        QVector<int> slots(size, -1);
+        QVector<quint32> seeds(bucketCount, 0);
+        QVector<int> taken;
+        bool placed = true;
+        for (int b: order)
+        {
+            const QVector<int> &bucket = buckets.at(b);
+            if (bucket.isEmpty())
+                break;
+            quint32 seed = 1;
+            for (; seed <= KEYWORD_MAX_SEED; ++seed)
+            {
+                taken.clear();
+                for (int i: bucket)
+                {
+                    const Word &w = _words.at(i);
+                    int slot = hash(w.parent, w.text.constData(), w.text.length(), seed) & (size - 1);
+                    if (slots.at(slot) >= 0 || taken.contains(slot))
+                        break;
+                    taken.append(slot);
+                }
+                if (taken.size() == bucket.size())
+                    break;
+            }
+            if (seed > KEYWORD_MAX_SEED)
+            {
+                placed = false;
+                break;
+            }
+            seeds[b] = seed;
+            for (int i = 0; i < bucket.size(); ++i)
+                slots[taken.at(i)] = bucket.at(i);
+        }
+        if (placed)
+        {
+            _seeds = seeds;
+            _slots = slots;
+            return;
+        }
+        size <<= 1;
+    }
+}
+
+int KeywordTable::find(int parent, const QStringRef &word) const
+{
+    const QChar *s = word.unicode();
+    int len = word.length();
+    if (_slots.isEmpty())
+    {
+        for (int i = 0; i < _words.size(); ++i)
+        {
+            if (equals(i, parent, s, len))
+                return i;
+        }
+        return -1;
+    }
+    quint32 seed = _seeds.at(hash(parent, s, len, 0) % _seeds.size());
+    if (!seed)
+        return -1;
+    int index = _slots.at(hash(parent, s, len, seed) & (_slots.size() - 1));
+    return (index >= 0 && equals(index, parent, s, len)) ? index : -1;
+}
+
+quint32 KeywordTable::hash(int parent, const QChar *s, int len, quint32 seed)
+{
+    // FNV-1a over case-folded characters
+    quint32 h = (2166136261u ^ (seed * 0x9E3779B9u)) + static_cast<quint32>(parent);
+    for (int i = 0; i < len; ++i)
+    {
+        h ^= foldCase(s[i].unicode());
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+bool KeywordTable::equals(int index, int parent, const QChar *s, int len) const
+{
+    const Word &w = _words.at(index);
+    if (w.parent != parent || w.text.length() != len)
+        return false;
+    const QChar *t = w.text.constData();
+    for (int i = 0; i < len; ++i)
+    {
+        if (t[i].unicode() != foldCase(s[i].unicode()))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef KEYWORDTABLE_H
+#define KEYWORDTABLE_H
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+#include <QHash>
+
+/*!
+ * \brief case insensitive perfect hash of words, compiled once
+ *
+ * A word is looked up together with the entry it follows (phrases like
+ * "double precision" form chains of entries), so all words share one table.
+ * Words are hashed in two steps: the first hash selects a bucket, the second
+ * one is seeded by the bucket and points to the only slot a word may occupy.
+ * Lookups compare case-folded characters in place and do not allocate.
+ */
+class KeywordTable
+{
+public:
+    KeywordTable();
+
+    /*!
+     * \brief add a word (or find the one added before), invalidates compiled lookups
+     * \param parent the entry of the previous word of a phrase, -1 for first words
+     * \return index of the entry
+     */
+    int insert(int parent, const QString &word);
+    void compile();                 ///< builds the hash, call it after all words are inserted
+    /*!
+     * \return index of the entry or -1
+     */
+    int find(int parent, const QStringRef &word) const;
+    int count() const { return _words.size(); }
+
+private:
+    struct Word
+    {
+        QString text;               ///< lowercase
+        int parent;
+    };
+    QVector<Word> _words;
+    QVector<quint32> _seeds;        ///< by buckets
+    QVector<int> _slots;            ///< word indexes, -1 for empty slots
+    QHash<QString, int> _index;     ///< by parent and word, to merge repeated words
+
+    static quint32 hash(int parent, const QChar *s, int len, quint32 seed);
+    bool equals(int index, int parent, const QChar *s, int len) const;
+};
+
+#endif // KEYWORDTABLE_H
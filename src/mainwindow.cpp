@@ -19,10 +19,21 @@
 #include <QCloseEvent>
 #include <QTextEdit>
 #include "tablemodel.h"
+#include "columnsizer.h"
+#include "arrowtablemodel.h"
+#include "selectionaggregator.h"
+#include "diffmodel.h"
+#include "tablecomparer.h"
 #include "dbtreeitemdelegate.h"
 #include "findandreplacepanel.h"
 #include <memory>
 #include "scripting.h"
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QComboBox>
+#include <QLineEdit>
+#include <QSpinBox>
 
 #include <QDebug>
 
@@ -38,6 +49,19 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->statusBar->addPermanentWidget(&_contextLabel);
     _positionLabel.setVisible(false);
     ui->statusBar->addPermanentWidget(&_positionLabel);
+    _selectionLabel.setVisible(false);
+    ui->statusBar->addPermanentWidget(&_selectionLabel);
+    _aggregator = new SelectionAggregator(this);
+    connect(_aggregator, &SelectionAggregator::changed, &_selectionLabel, [this](const QString &summary) {
+        _selectionLabel.setText(summary);
+        _selectionLabel.setVisible(!summary.isEmpty());
+    });
+    // figures of the last focused grid are shown
+    connect(qApp, &QApplication::focusChanged, _aggregator, [this](QWidget *, QWidget *now) {
+        QTableView *tv = qobject_cast<QTableView*>(now);
+        if (tv && qobject_cast<TableModel*>(tv->model()))
+            _aggregator->setView(tv);
+    });
 
     _objectScript = new QueryWidget(this);
     _objectScript->setReadOnly(true);
@@ -101,6 +125,7 @@ MainWindow::MainWindow(QWidget *parent) :
     _tableModel = new TableModel(this);
     ui->tableView->setModel(_tableModel);
     ui->tableView->verticalHeader()->setDefaultSectionSize(ui->tableView->verticalHeader()->minimumSectionSize());
+    ui->tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     ui->tableView->hide();
     //ui->tableView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
 
@@ -520,10 +545,17 @@ void MainWindow::on_actionOpen_triggered()
     _fileDialog.setAcceptMode(QFileDialog::AcceptOpen);
     _fileDialog.setFileMode(QFileDialog::ExistingFile);
     _fileDialog.setWindowTitle(tr("Open script"));
-    _fileDialog.setNameFilters(QStringList() << tr("Script files (*.sql)") << tr("All files (*.*)"));
+    _fileDialog.setNameFilters(QStringList() << tr("Script files (*.sql)") << tr("Arrow files (*.arrow *.feather)")
+                               << tr("All files (*.*)"));
     if (!_fileDialog.exec())
         return;
     QString fn = _fileDialog.selectedFiles().at(0);
+    QString suffix = QFileInfo(fn).suffix().toLower();
+    if (suffix == "arrow" || suffix == "feather")
+    {
+        openArrowFile(fn);
+        return;
+    }
 
     int tabs_count = ui->tabWidget->count();
     ui->actionNew->activate(QAction::Trigger);
@@ -538,6 +570,227 @@ void MainWindow::on_actionOpen_triggered()
     }
 }
 
+void MainWindow::openArrowFile(const QString &fileName)
+{
+    // a separate window closed along with the main one
+    QTableView *view = new QTableView(this);
+    view->setWindowFlags(Qt::Window);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    ArrowTableModel *model = new ArrowTableModel(view);
+    try
+    {
+        model->open(fileName);
+    }
+    catch (const QString &err)
+    {
+        delete view;
+        QMessageBox::critical(this, tr("Error"), err);
+        return;
+    }
+    view->setModel(model);
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    // values are decoded on demand - widths are measured by a part of rows
+    view->horizontalHeader()->setResizeContentsPrecision(200);
+    view->resizeColumnsToContents();
+    view->setWindowTitle(tr("%1 - %2 rows").arg(QFileInfo(fileName).fileName()).arg(model->rows()));
+    view->resize(size() * 3 / 4);
+    view->show();
+}
+
+void MainWindow::on_actionCompare_resultsets_triggered()
+{
+    // resultsets of all query tabs
+    QList<QPair<QString, TableModel*>> models;
+    for (int i = 0; i < ui->tabWidget->count(); ++i)
+    {
+        QueryWidget *w = qobject_cast<QueryWidget*>(ui->tabWidget->widget(i));
+        if (!w)
+            continue;
+        const QList<TableModel*> &tables = w->resultModels();
+        for (int t = 0; t < tables.size(); ++t)
+            models.append(qMakePair(tr("%1: resultset %2").arg(ui->tabWidget->tabText(i)).arg(t + 1), tables[t]));
+    }
+    if (models.size() < 2)
+    {
+        QMessageBox::information(this, tr("Compare resultsets"), tr("There should be two resultsets at least."));
+        return;
+    }
+
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("Compare resultsets"));
+    QFormLayout *form = new QFormLayout(&dlg);
+    QComboBox *leftBox = new QComboBox(&dlg);
+    QComboBox *rightBox = new QComboBox(&dlg);
+    for (const auto &m: models)
+    {
+        leftBox->addItem(m.first);
+        rightBox->addItem(m.first);
+    }
+    rightBox->setCurrentIndex(1);
+    QLineEdit *keysEdit = new QLineEdit(&dlg);
+    keysEdit->setPlaceholderText(tr("comma separated (whole rows are matched if empty)"));
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dlg);
+    connect(buttons, &QDialogButtonBox::accepted, &dlg, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dlg, &QDialog::reject);
+    form->addRow(tr("First"), leftBox);
+    form->addRow(tr("Second"), rightBox);
+    form->addRow(tr("Key columns"), keysEdit);
+    form->addRow(buttons);
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+
+    // the diff keeps its own copies of rows, so the window may outlive the resultsets
+    QWidget *window = new QWidget(this, Qt::Window);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->setWindowTitle(tr("%1 - %2").arg(leftBox->currentText(), rightBox->currentText()));
+    QVBoxLayout *layout = new QVBoxLayout(window);
+    QLabel *summary = new QLabel(tr("Comparing..."), window);
+    QTableView *view = new QTableView(window);
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->horizontalHeader()->setResizeContentsPrecision(200);
+    DiffModel *model = new DiffModel(view);
+    view->setModel(model);
+    layout->addWidget(summary);
+    layout->addWidget(view);
+    connect(model, &DiffModel::finished, summary, [summary, view](const QString &text) {
+        summary->setText(text);
+        view->resizeColumnsToContents();
+    });
+    try
+    {
+        model->compare(models[leftBox->currentIndex()].second->table(), models[rightBox->currentIndex()].second->table(),
+                       keysEdit->text().split(',', QString::SkipEmptyParts));
+    }
+    catch (const QString &err)
+    {
+        delete window;
+        QMessageBox::critical(this, tr("Error"), err);
+        return;
+    }
+    window->resize(size() * 3 / 4);
+    window->show();
+}
+
+void MainWindow::on_actionCompare_tables_triggered()
+{
+    // connections of query tabs
+    QList<QPair<QString, DbConnection*>> connections;
+    int current = 0;
+    for (int i = 0; i < ui->tabWidget->count(); ++i)
+    {
+        QueryWidget *w = qobject_cast<QueryWidget*>(ui->tabWidget->widget(i));
+        if (!w || !w->dbConnection())
+            continue;
+        if (i == ui->tabWidget->currentIndex())
+            current = connections.size();
+        connections.append(qMakePair(ui->tabWidget->tabText(i), w->dbConnection()));
+    }
+    if (connections.isEmpty())
+    {
+        QMessageBox::information(this, tr("Compare tables"), tr("Open a query tab of every database to compare."));
+        return;
+    }
+
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("Compare tables"));
+    QFormLayout *form = new QFormLayout(&dlg);
+    QComboBox *leftBox = new QComboBox(&dlg);
+    QComboBox *rightBox = new QComboBox(&dlg);
+    for (const auto &c: connections)
+    {
+        leftBox->addItem(c.first);
+        rightBox->addItem(c.first);
+    }
+    leftBox->setCurrentIndex(current);
+    rightBox->setCurrentIndex(connections.size() > 1 ? (current + 1) % connections.size() : 0);
+    QLineEdit *leftTableEdit = new QLineEdit(&dlg);
+    QLineEdit *rightTableEdit = new QLineEdit(&dlg);
+    rightTableEdit->setPlaceholderText(tr("the same as the first one if empty"));
+    QLineEdit *keyEdit = new QLineEdit(&dlg);
+    keyEdit->setPlaceholderText(tr("unique column"));
+    QLineEdit *columnsEdit = new QLineEdit(&dlg);
+    columnsEdit->setPlaceholderText(tr("comma separated (whole rows are compared if empty)"));
+    QSpinBox *connectionsBox = new QSpinBox(&dlg);
+    connectionsBox->setRange(1, 16);
+    connectionsBox->setValue(4);
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dlg);
+    connect(buttons, &QDialogButtonBox::accepted, &dlg, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dlg, &QDialog::reject);
+    form->addRow(tr("First connection"), leftBox);
+    form->addRow(tr("First table"), leftTableEdit);
+    form->addRow(tr("Second connection"), rightBox);
+    form->addRow(tr("Second table"), rightTableEdit);
+    form->addRow(tr("Key column"), keyEdit);
+    form->addRow(tr("Columns"), columnsEdit);
+    form->addRow(tr("Parallel connections"), connectionsBox);
+    form->addRow(buttons);
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+    QString leftTable = leftTableEdit->text().trimmed();
+    QString rightTable = rightTableEdit->text().trimmed();
+    if (rightTable.isEmpty())
+        rightTable = leftTable;
+    QString key = keyEdit->text().trimmed();
+    if (leftTable.isEmpty() || key.isEmpty())
+    {
+        QMessageBox::critical(this, tr("Error"), tr("A table and a key column are required."));
+        return;
+    }
+    QStringList columns;
+    for (const QString &c: columnsEdit->text().split(',', QString::SkipEmptyParts))
+        columns.append(c.trimmed());
+
+    // the comparer works with its own connections, so the window may outlive the tabs
+    QWidget *window = new QWidget(this, Qt::Window);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->setWindowTitle(tr("%1 - %2").arg(leftTable, rightTable));
+    QVBoxLayout *layout = new QVBoxLayout(window);
+    QLabel *summary = new QLabel(tr("Comparing..."), window);
+    QTableView *view = new QTableView(window);
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->horizontalHeader()->setResizeContentsPrecision(200);
+    DiffModel *model = new DiffModel(view);
+    view->setModel(model);
+    layout->addWidget(summary);
+    layout->addWidget(view);
+    TableComparer *comparer = new TableComparer(window);
+    connect(comparer, &TableComparer::progress, summary, [summary](qint64 ranges, qint64 rows) {
+        summary->setText(tr("Comparing... %1 ranges compared, %2 rows transferred").arg(ranges).arg(rows));
+    });
+    connect(model, &DiffModel::finished, summary, [summary, view](const QString &text) {
+        summary->setText(text);
+        view->resizeColumnsToContents();
+    });
+    connect(comparer, &TableComparer::finished, window, [comparer, model, summary, key](const QString &err) {
+        if (!err.isEmpty())
+        {
+            summary->setText(err);
+            return;
+        }
+        // only rows of mismatching ranges are compared locally
+        std::unique_ptr<DataTable> left(comparer->takeLeftRows());
+        std::unique_ptr<DataTable> right(comparer->takeRightRows());
+        if (!left->columnCount() && !right->columnCount())
+        {
+            summary->setText(tr("Tables are equal"));
+            return;
+        }
+        try
+        {
+            model->compare(left.get(), right.get(), QStringList(key.split('.').last()));
+        }
+        catch (const QString &e)
+        {
+            summary->setText(e);
+        }
+    });
+    comparer->start(connections[leftBox->currentIndex()].second, leftTable,
+                    connections[rightBox->currentIndex()].second, rightTable,
+                    key, columns, connectionsBox->value());
+    window->resize(size() * 3 / 4);
+    window->show();
+}
+
 QueryWidget *MainWindow::currentQueryWidget()
 {
     if (!ui->tabWidget->count())
@@ -788,7 +1041,7 @@ void MainWindow::scriptSelectedObjects(bool currentOnly)
                 {
                     _tableModel->take(con->_resultsets.front());
                     ui->tableView->show();
-                    ui->tableView->resizeColumnsToContents();
+                    ColumnSizer::resizeColumns(ui->tableView);
                 }
             }
             else if (con->_resultsets.isEmpty())
@@ -833,7 +1086,7 @@ void MainWindow::fillContent(QModelIndex &index, std::shared_ptr<DbConnection> c
             ui->tableView->show();
             _objectScript->hide();
             _tableModel->take(table);
-            ui->tableView->resizeColumnsToContents();
+            ColumnSizer::resizeColumns(ui->tableView);
             if (index.isValid())
                 _objectsModel->setData(index, "table", DbObject::ContentTypeRole);
             return;
@@ -18,6 +18,7 @@ class FindAndReplacePanel;
 class DbObjectsModel;
 class DbConnection;
 class DataTable;
+class SelectionAggregator;
 
 class MainWindow : public QMainWindow
 {
@@ -54,9 +55,12 @@ private slots:
     void objectsViewAdjustColumnWidth(const QModelIndex &);
     void on_actionFind_triggered();
     void on_tabWidget_currentChanged(int index);
+    void on_actionCompare_resultsets_triggered();
+    void on_actionCompare_tables_triggered();
 
 private:
-    QLabel _contextLabel, _positionLabel;
+    QLabel _contextLabel, _positionLabel, _selectionLabel;
+    SelectionAggregator *_aggregator;
     ExtFileDialog _fileDialog;
 	Ui::MainWindow *ui;
     DbObjectsModel *_objectsModel;
@@ -70,6 +74,7 @@ private:
     QTimer *_hideTimer;
     void log(const QString &msg);
     bool script(const QModelIndex &index, const QString &children = "");
+    void openArrowFile(const QString &fileName);    ///< shows a saved resultset in a separate window
 
 public slots:
     QVariant current(const QString &nodeType, const QString &field);
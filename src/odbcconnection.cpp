@@ -7,44 +7,211 @@
 #include <QDebug>
 #include <QTextCodec>
 #include <QStringList>
-#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QTimer>
 #include "datatable.h"
 #include <memory>
 #include "scripting.h"
+#include "batchsplitter.h"
+#include "odbcparams.h"
+
+// block cursor (bound arrays) limits: column size in characters/bytes,
+// total size of a statement's buffers and max rows fetched at once
+#define BLOCK_MAX_COLUMN_SIZE 4000
+#define BLOCK_BUFFER_SIZE (4 * 1024 * 1024)
+#define BLOCK_MAX_ROWS 4096
+
+// initial and max kept size of a buffer to receive unbounded column values
+#define COLUMN_BUFFER_SIZE 1024
+#define COLUMN_BUFFER_MAX_SIZE (64 * 1024)
+
+// max parameter sets sent at once by executeBatch
+#define PARAMSET_MAX_SIZE 1000
+
+// asynchronous execution: max delay between polls of a running statement (ms)
+// and max time of results processing per event loop iteration (ms)
+#define ASYNC_MAX_POLL_INTERVAL 50
+#define ASYNC_TIME_SLICE 20
+
+// pooled sessions found dead after connecting, before a connection attempt fails
+#define POOL_MAX_DEAD_SESSIONS 3
+
+// W-API passes QString storage to the driver as is
+static_assert(sizeof(SQLWCHAR) == sizeof(QChar), "SQLWCHAR must be a UTF-16 code unit");
+
+static inline SQLWCHAR* sqlText(const QString &str)
+{
+    return reinterpret_cast<SQLWCHAR*>(const_cast<QChar*>(str.constData()));
+}
+
+static inline QString fromSqlText(const SQLWCHAR *str, int length = -1)
+{
+    return QString::fromUtf16(reinterpret_cast<const ushort*>(str), length);
+}
+
+SQLHENV OdbcConnection::_sharedEnv = SQL_NULL_HENV;
+int OdbcConnection::_sharedEnvRefs = 0;
+QMutex OdbcConnection::_sharedEnvGuard;
+QHash<QString, bool> OdbcConnection::_resettingDrivers;
 
 OdbcConnection::OdbcConnection() :
     DbConnection()
 {
-    RETCODE retcode;
-    _henv = 0;
+    _henv = SQL_NULL_HENV;
+    _hdbc = 0;
     _hstmt = 0;
+    _cachedStmt = SQL_NULL_HSTMT;
     _query_state = QueryState::Inactive;
+    _pollTimer = new QTimer(this);
+    _pollTimer->setSingleShot(true);
+    connect(_pollTimer, &QTimer::timeout, this, &OdbcConnection::asyncProceed);
+}
 
-    retcode = SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &_henv);
-    if (check(retcode, _henv, SQL_HANDLE_ENV))
+OdbcConnection::~OdbcConnection()
+{
+    if (_async)
     {
-        retcode = SQLSetEnvAttr(_henv, SQL_ATTR_ODBC_VERSION, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_OV_ODBC3)), 0);
-        if (check(retcode, _henv, SQL_HANDLE_ENV))
-        {
-            retcode = SQLAllocHandle(SQL_HANDLE_DBC, _henv, &_hdbc);
-            if (check(retcode, _hdbc, SQL_HANDLE_DBC))
-                return;
-            else if (_hdbc)
-                SQLFreeHandle(SQL_HANDLE_DBC, _hdbc);
-        }
-        SQLFreeHandle(SQL_HANDLE_ENV, _henv);
+        SQLCancel(_async->hstmt);
+        SQLFreeHandle(SQL_HANDLE_STMT, _async->hstmt);
+    }
+    close();
+    freeConnection();
+}
+
+SQLHENV OdbcConnection::allocEnvironment() noexcept
+{
+    SQLHENV henv;
+    RETCODE retcode = SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &henv);
+    if (!SQL_SUCCEEDED(retcode))
+        return SQL_NULL_HENV;
+    retcode = SQLSetEnvAttr(henv, SQL_ATTR_ODBC_VERSION, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_OV_ODBC3)), 0);
+    if (!SQL_SUCCEEDED(retcode))
+    {
+        SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        return SQL_NULL_HENV;
     }
+    SQLSetEnvAttr(henv, SQL_ATTR_CP_MATCH, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_CP_RELAXED_MATCH)), 0);
+    return henv;
+}
+
+bool OdbcConnection::allocConnection()
+{
+    // sessions of drivers that do not reset them may keep state (USE, SET, temp tables),
+    // so they are not shared: such a connection has its own environment, closed with
+    // the connection; the first connection of a string is pooled until it is known
+    QString cs = finalConnectionString();
+    QMutexLocker lk(&_sharedEnvGuard);
+    _privateEnv = !_resettingDrivers.value(cs, true);
+    lk.unlock();
+    _henv = (_privateEnv ? allocEnvironment() : acquireEnvironment());
+    if (!_henv)
+        return false;
+    RETCODE retcode = SQLAllocHandle(SQL_HANDLE_DBC, _henv, &_hdbc);
+    if (check(retcode, _henv, SQL_HANDLE_ENV))
+        return true;
+    else if (_hdbc)
+        SQLFreeHandle(SQL_HANDLE_DBC, _hdbc);
     _hdbc = 0;
-    _henv = 0;
+    if (_privateEnv)
+        SQLFreeHandle(SQL_HANDLE_ENV, _henv);
+    else
+        releaseEnvironment();
+    _henv = SQL_NULL_HENV;
+    return false;
 }
 
-OdbcConnection::~OdbcConnection()
+void OdbcConnection::freeConnection() noexcept
 {
-    close();
     if (_hdbc)
         SQLFreeHandle(SQL_HANDLE_DBC, _hdbc);
-    if (_henv)
+    _hdbc = 0;
+    if (_henv && _privateEnv)
         SQLFreeHandle(SQL_HANDLE_ENV, _henv);
+    else if (_henv)
+        releaseEnvironment();
+    _henv = SQL_NULL_HENV;
+}
+
+bool OdbcConnection::resetsPooledSessions() const noexcept
+{
+    // the driver manager resets a session returned to the pool by SQL_ATTR_RESET_CONNECTION,
+    // a driver that does not accept the attribute keeps the state of the session;
+    // a just connected session has nothing to reset
+#ifdef SQL_ATTR_RESET_CONNECTION
+    RETCODE retcode = SQLSetConnectAttrW(_hdbc, SQL_ATTR_RESET_CONNECTION,
+                                         reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_RESET_CONNECTION_YES)), SQL_IS_UINTEGER);
+    return SQL_SUCCEEDED(retcode);
+#else
+    return false;
+#endif
+}
+
+bool OdbcConnection::isConnectionDead() const noexcept
+{
+    SQLINTEGER isConnectionDead;
+    RETCODE retcode = SQLGetConnectAttr(_hdbc,
+                                        SQL_ATTR_CONNECTION_DEAD,
+                                        &isConnectionDead,
+                                        sizeof(isConnectionDead),
+                                        nullptr);
+    if (retcode == SQL_SUCCESS || retcode == SQL_SUCCESS_WITH_INFO)
+        return isConnectionDead == SQL_CD_TRUE;
+    // the attribute is not supported by the driver
+    return false;
+}
+
+SQLHENV OdbcConnection::acquireEnvironment() noexcept
+{
+    QMutexLocker lk(&_sharedEnvGuard);
+    if (!_sharedEnv)
+    {
+        // process-wide attribute of the driver manager, must be set before
+        // the environment is allocated: disconnected connections are kept
+        // in the pool and reused by SQLDriverConnect with the same string
+        SQLSetEnvAttr(SQL_NULL_HANDLE, SQL_ATTR_CONNECTION_POOLING, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_CP_ONE_PER_HENV)), SQL_IS_UINTEGER);
+        _sharedEnv = allocEnvironment();
+        if (!_sharedEnv)
+            return SQL_NULL_HENV;
+    }
+    ++_sharedEnvRefs;
+    return _sharedEnv;
+}
+
+void OdbcConnection::releaseEnvironment() noexcept
+{
+    QMutexLocker lk(&_sharedEnvGuard);
+    if (--_sharedEnvRefs == 0)
+    {
+        SQLFreeHandle(SQL_HANDLE_ENV, _sharedEnv);
+        _sharedEnv = SQL_NULL_HENV;
+    }
+}
+
+SQLHSTMT OdbcConnection::allocStatement()
+{
+    SQLHSTMT hstmt = _cachedStmt.exchange(SQL_NULL_HSTMT);
+    if (hstmt)
+        return hstmt;
+    RETCODE retcode = SQLAllocHandle(SQL_HANDLE_STMT, _hdbc, &hstmt);
+    if (!check(retcode, _hdbc, SQL_HANDLE_DBC))
+        return SQL_NULL_HSTMT;
+    return hstmt;
+}
+
+void OdbcConnection::releaseStatement(SQLHSTMT hstmt) noexcept
+{
+    // a single closed statement is kept to be reused by the next query
+    if (!_connectionBroken)
+    {
+        SQLFreeStmt(hstmt, SQL_CLOSE);
+        SQLFreeStmt(hstmt, SQL_UNBIND);
+        OdbcParams::unbind(hstmt);
+        SQLSetStmtAttr(hstmt, SQL_ATTR_ASYNC_ENABLE, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_ASYNC_ENABLE_OFF)), 0);
+        SQLHSTMT expected = SQL_NULL_HSTMT;
+        if (_cachedStmt.compare_exchange_strong(expected, hstmt))
+            return;
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
 }
 
 DbConnection *OdbcConnection::clone()
@@ -61,8 +228,8 @@ bool OdbcConnection::checkStmt(RETCODE retcode, SQLHSTMT handle)
         return true;
 
     SQLINTEGER NativeError;
-    char SqlState[6];
-    SQLCHAR BufErrMsg[SQL_MAX_MESSAGE_LENGTH];
+    SQLWCHAR sql_state[6];
+    SQLWCHAR BufErrMsg[SQL_MAX_MESSAGE_LENGTH];
     SQLSMALLINT MsgLen;
     RETCODE rc;
 
@@ -70,26 +237,27 @@ bool OdbcConnection::checkStmt(RETCODE retcode, SQLHSTMT handle)
     do
     {
         MsgLen = 0; NativeError = 0;
-        rc = SQLGetDiagRecA(SQL_HANDLE_STMT,
+        rc = SQLGetDiagRecW(SQL_HANDLE_STMT,
                             handle,
                             ++i,
-                            reinterpret_cast<SQLCHAR*>(SqlState),
+                            sql_state,
                             &NativeError,
                             BufErrMsg,
-                            sizeof(BufErrMsg),
+                            SQL_MAX_MESSAGE_LENGTH,
                             &MsgLen);
-        BufErrMsg[MsgLen] = 0;
         if (rc == SQL_NO_DATA)
             break;
+        MsgLen = qBound<SQLSMALLINT>(0, MsgLen, SQL_MAX_MESSAGE_LENGTH - 1);
+        QString SqlState = fromSqlText(sql_state, 5);
 
         // Statement(s) could not be prepared
-        if (NativeError == 8180 && strcmp(SqlState, "42000") == 0)
+        if (NativeError == 8180 && SqlState == "42000")
             continue;
 
         if (MsgLen > 0 || NativeError)
         {
-            bool is_warn = (strcmp(SqlState, "01000") == 0 || strcmp(SqlState, "00000") == 0);
-            QString msg = QString::fromLocal8Bit(reinterpret_cast<char*>(BufErrMsg), SQL_NTS);
+            bool is_warn = (SqlState == "01000" || SqlState == "00000");
+            QString msg = fromSqlText(BufErrMsg, MsgLen);
             if (!is_warn || NativeError)
             {
                 msg = tr("%1 %2, state %3: %4").
@@ -105,12 +273,10 @@ bool OdbcConnection::checkStmt(RETCODE retcode, SQLHSTMT handle)
             else
                 emit message(msg);
 
-            if (strcmp(SqlState, "08S01") == 0)   // connection broken (first time detected on query execution (SQL_HANDLE_STMT))
-            {
-                close();
-                if (open())
-                    emit message("connection restored\n");
-            }
+            // connection broken (first time detected on query execution (SQL_HANDLE_STMT)),
+            // it is restored by the next query
+            if (SqlState == "08S01")
+                _connectionBroken = true;
         }
     }
     while (rc == SQL_SUCCESS);
@@ -124,8 +290,8 @@ bool OdbcConnection::check(RETCODE retcode, SQLHANDLE handle, SQLSMALLINT handle
         return true;
 
     SQLINTEGER NativeError;
-    char SqlState[6];
-    SQLCHAR BufErrMsg[SQL_MAX_MESSAGE_LENGTH];
+    SQLWCHAR sql_state[6];
+    SQLWCHAR BufErrMsg[SQL_MAX_MESSAGE_LENGTH];
     SQLSMALLINT MsgLen;
     RETCODE rc;
 
@@ -133,26 +299,27 @@ bool OdbcConnection::check(RETCODE retcode, SQLHANDLE handle, SQLSMALLINT handle
     do
     {
         MsgLen = 0; NativeError = 0;
-        rc = SQLGetDiagRecA(handle_type,
+        rc = SQLGetDiagRecW(handle_type,
                             handle,
                             ++i,
-                            reinterpret_cast<SQLCHAR*>(SqlState),
+                            sql_state,
                             &NativeError,
                             BufErrMsg,
-                            sizeof(BufErrMsg),
+                            SQL_MAX_MESSAGE_LENGTH,
                             &MsgLen);
-        BufErrMsg[MsgLen] = 0;
         if (rc == SQL_NO_DATA)
             break;
+        MsgLen = qBound<SQLSMALLINT>(0, MsgLen, SQL_MAX_MESSAGE_LENGTH - 1);
+        QString SqlState = fromSqlText(sql_state, 5);
 
         // Statement(s) could not be prepared
-        if (NativeError == 8180 && strcmp(SqlState, "42000") == 0)
+        if (NativeError == 8180 && SqlState == "42000")
             continue;
 
         if (MsgLen > 0 || NativeError)
         {
-            bool is_warn = (strcmp(SqlState, "01000") == 0 || strcmp(SqlState, "00000") == 0);
-            QString msg = QString::fromLocal8Bit(reinterpret_cast<char*>(BufErrMsg), SQL_NTS).append("\n");
+            bool is_warn = (SqlState == "01000" || SqlState == "00000");
+            QString msg = fromSqlText(BufErrMsg, MsgLen).append("\n");
             if (!is_warn || NativeError)
             {
                 msg = tr("%1 %2, state %3: %4").
@@ -206,6 +373,11 @@ QMetaType::Type OdbcConnection::sqlTypeToVariant(int sqlType) const noexcept
     case SQL_TYPE_TIMESTAMP:
         var_type = QMetaType::QDateTime;
         break;
+    case SQL_BINARY:
+    case SQL_VARBINARY:
+    case SQL_LONGVARBINARY:
+        var_type = QMetaType::QByteArray;
+        break;
     default:
         var_type = QMetaType::QString;
     }
@@ -214,280 +386,742 @@ QMetaType::Type OdbcConnection::sqlTypeToVariant(int sqlType) const noexcept
 
 bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *params, int limit)
 {
+    // resultsets of a query being fetched asynchronously are not deleted under it
+    asyncStop();
     clearResultsets();
     if (!open())
         return false;
 
     SQLLEN cb;
-    QStringList queries = query.split(QRegularExpression("^go\\s*$",
-                                                         QRegularExpression::CaseInsensitiveOption |
-                                                         QRegularExpression::MultilineOption),
-                                      QString::SkipEmptyParts);
-    SQLHSTMT hstmt_local;
-    RETCODE retcode = SQLAllocHandle(SQL_HANDLE_STMT, _hdbc, &hstmt_local);
-    if (!check(retcode, _hdbc, SQL_HANDLE_DBC))
+    BatchSplitter batches(query);
+    SQLHSTMT hstmt_local = allocStatement();
+    if (!hstmt_local)
         return false;
     _hstmt = hstmt_local;
+    RETCODE retcode;
 
     std::unique_ptr<SQLHSTMT, std::function<void(SQLHSTMT*)>> hstmt_guard(&hstmt_local, [this](SQLHSTMT *hstmt)
     {
         _hstmt = 0;
-        SQLFreeHandle(SQL_HANDLE_STMT, *hstmt);
+        releaseStatement(*hstmt);
         setQueryState(QueryState::Inactive);
     });
 
     setQueryState(QueryState::Running);
 
-    _timer.start();
-    foreach (QString q, queries)
-    {
-        // ms sql server wants \r\n line ends:
-        // TODO check dbms vendor (or something else) to support \n only...
-        q.replace(QRegularExpression("(?<!\r)\n"), "\r\n");
-
-        /*
-        1) in case of SQL_CURSOR_STATIC mode SQLRowCount always returns -1 (FreeTDS), and SQLFetch acts very slow
-        2) prepared statement incompatible with several features (including showplan)
-        */
-        retcode = SQLExecDirectA(hstmt_local, reinterpret_cast<SQLCHAR*>(q.toLocal8Bit().data()), SQL_NTS);
-        if (retcode == SQL_NO_DATA)
-            continue;
+    // parameters stay bound for all batches
+    OdbcParams bound_params;
+    if (params && !params->isEmpty())
+    {
+        bound_params.addRow(*params);
+        if (!checkStmt(bound_params.bind(hstmt_local), hstmt_local))
+            return false;
+    }
 
-        while (checkStmt(retcode, hstmt_local))
+    _timer.start();
+    while (batches.next())
+    {
+        QString q = batches.batch(_crlfLineEnds);
+        for (int n = 0; n < batches.count(); ++n)
         {
-            SQLSMALLINT col_count, name_length, data_type, dec_digits, nullable_desc;
-            SQLULEN col_size;
-            SQLCHAR col_name[512];
-            retcode = SQLNumResultCols(hstmt_local, &col_count);
-            int rowcount = 0;
-            if (checkStmt(retcode, hstmt_local) && col_count)
+            /*
+            1) in case of SQL_CURSOR_STATIC mode SQLRowCount always returns -1 (FreeTDS), and SQLFetch acts very slow
+            2) prepared statement incompatible with several features (including showplan)
+            */
+            retcode = SQLExecDirectW(hstmt_local, sqlText(q), q.size());
+            if (retcode == SQL_NO_DATA)
+                continue;
+
+            while (checkStmt(retcode, hstmt_local))
             {
-                DataTable *table = new DataTable();
-                QMutexLocker lk(&_resultsetsGuard);
-                _resultsets.append(table);
-                lk.unlock();
-                for (SQLUSMALLINT i = 0; i < col_count; ++i)
+                SQLSMALLINT col_count;
+                retcode = SQLNumResultCols(hstmt_local, &col_count);
+                int rowcount = 0;
+                if (checkStmt(retcode, hstmt_local) && col_count)
                 {
-                    SQLDescribeColA(hstmt_local, i + 1, col_name, sizeof(col_name), &name_length, &data_type, &col_size, &dec_digits, &nullable_desc);
-                    table->addColumn(
-                                QString::fromLocal8Bit(reinterpret_cast<char*>(col_name)),
-                                sqlTypeToVariant(data_type),
-                                data_type,
-                                col_size,
-                                dec_digits,
-                                int8_t(nullable_desc),
-                                isNumericType(data_type) ?
-                                    Qt::AlignRight : Qt::AlignLeft);
+                    DataTable *table = new DataTable();
+                    QMutexLocker lk(&_resultsetsGuard);
+                    _resultsets.append(table);
+                    lk.unlock();
+                    describeColumns(hstmt_local, table, col_count);
+
+                    std::vector<BoundColumn> columns;
+                    SQLULEN block_size = bindColumns(hstmt_local, table, columns, limit);
+                    rowcount = (block_size ?
+                                    fetchBlocks(hstmt_local, table, columns, block_size, limit) :
+                                    fetchRows(hstmt_local, table, limit));
+                    if (rowcount < 0)
+                        return false;
+                    if (rowcount == 0 || rowcount % FETCH_COUNT_NOTIFY != 0)
+                        emit fetched(table);
                 }
 
-                while ((limit == -1 || rowcount < limit) && (retcode = SQLFetch(hstmt_local)) != SQL_NO_DATA)
+                if (col_count)
+                    emit message(tr("%1 rows fetched").arg(rowcount));
+                else
                 {
-                    if (!checkStmt(retcode, hstmt_local))
-                        break;
-                    std::unique_ptr<DataRow> row(new DataRow(table));
-                    for (SQLUSMALLINT i = 0; i < col_count; ++i)
-                    {
-                        cb = SQL_NULL_DATA;
-                        int type = table->getColumn(i).sqlType();
-                        switch (type)
-                        {
-                        case SQL_SMALLINT:
-                        {
-                            short num = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SSHORT, &num, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = num;
-                            break;
-                        }
-                        case SQL_BIGINT:
-                        {
-                            qint64 num = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SBIGINT, &num, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = num;
-                            break;
-                        }
-                        case SQL_INTEGER:
-                        {
-                            qint32 num = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SLONG, &num, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = num;
-                            break;
-                        }
-                        case SQL_REAL:
-                        {
-                            float num = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_FLOAT, &num, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = num;
-                            break;
-                        }
-                        case SQL_FLOAT:
-                        case SQL_DOUBLE:
-                        {
-                            double num = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_DOUBLE, &num, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = num;
-                            break;
-                        }
-                        case SQL_BIT:
-                        {
-                            unsigned char bit = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_BIT, &bit, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = (bit ? true : false);
-                            break;
-                        }
-                        case SQL_TINYINT:
-                        {
-                            unsigned char bit = 0;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_UTINYINT, &bit, 0, &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = bit;
-                            break;
-                        }
-                        case SQL_TYPE_DATE:
-                        {
-                            DATE_STRUCT date;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_DATE, &date, sizeof(DATE_STRUCT), &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = QDate(date.year, date.month, date.day);
-                            break;
-                        }
-                        case SQL_SS_TIME2:
-                        case SQL_TYPE_TIME:
-                        {
-                            /*
-                            TIME_STRUCT time;
-                            retcode = SQLGetData(hstmt, i + 1, SQL_C_TYPE_TIME, &time, sizeof(TIME_STRUCT), &cb);
-                            if (!check(retcode, hstmt, SQL_HANDLE_STMT) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = QTime(time.hour, time.minute, time.second);
-                            */
-                            TIMESTAMP_STRUCT dt;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_TIMESTAMP, &dt, sizeof(TIMESTAMP_STRUCT), &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000);
-                            break;
-                        }
-                        case SQL_TYPE_TIMESTAMP:
-                        {
-                            TIMESTAMP_STRUCT dt;
-                            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_TIMESTAMP, &dt, sizeof(TIMESTAMP_STRUCT), &cb);
-                            if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
-                                break;
-                            (*row)[i] = QDateTime(QDate(dt.year, dt.month, dt.day), QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000));
-                            break;
-                        }
-                        case SQL_WCHAR:
-                        case SQL_WVARCHAR:
-                        case SQL_WLONGVARCHAR:
-                        {
-                            size_t buf_size = 1024;
-                            std::vector<char> buf_storage(buf_size);
-                            char *buf = buf_storage.data();
-                            char *ptr = buf;
-                            size_t res_len = 0;
-                            do
-                            {
-                                retcode = SQLGetData(hstmt_local, i + 1, SQL_C_WCHAR, ptr, SQLLEN(buf_size - size_t(ptr - buf)), &cb);
-                                if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
-                                    break;
-                                if (retcode == SQL_SUCCESS_WITH_INFO)
-                                {
-                                    res_len = buf_size - sizeof(SQLWCHAR); // every pass null-terminated
-                                    buf_storage.resize(buf_size + size_t(cb));
-                                    buf = buf_storage.data();
-                                    ptr = buf + res_len;
-                                    buf_size = buf_size + size_t(cb);
-                                }
-                                else
-                                    res_len += size_t(cb);
-                            }
-                            while (retcode == SQL_SUCCESS_WITH_INFO);
-                            if (retcode == SQL_ERROR)
-                                break;
-                            if (cb != SQL_NULL_DATA)
-                                (*row)[i] = QString::fromUtf16(reinterpret_cast<ushort*>(buf), int(res_len / sizeof(SQLWCHAR)));
-                            //(*row)[i] = QTextCodec::codecForMib(1015)->toUnicode(val); // 1015 is UTF-16, 1014 UTF-16LE, 1013 UTF-16LE
-                            break;
-                        }
-                        default:
-                        {
-                            size_t buf_size = 1024;
-                            std::vector<char> buf_storage(buf_size);
-                            char *buf = buf_storage.data();
-                            char *ptr = buf;
-                            size_t res_len = 0;
-                            do
-                            {
-                                SQLLEN arg_len = static_cast<SQLLEN>(buf_size - size_t(ptr - buf));
-                                retcode = SQLGetData(hstmt_local, i + 1, SQL_C_CHAR, ptr, arg_len, &cb);
-                                if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
-                                    break;
-                                if (retcode == SQL_SUCCESS_WITH_INFO && cb > arg_len) // workaround for sql_variant (always SQL_SUCCESS_WITH_INFO)
-                                {
-                                    res_len = buf_size - sizeof(SQLCHAR); // every pass null-terminated
-                                    buf_storage.resize(buf_size * 2);
-                                    buf = buf_storage.data();
-                                    ptr = buf + res_len;
-                                    buf_size = buf_size * 2;
-                                }
-                                else
-                                    break;
-                            }
-                            while (retcode == SQL_SUCCESS_WITH_INFO);
-                            if (retcode == SQL_ERROR)
-                                break;
-                            if (cb != SQL_NULL_DATA)
-                                (*row)[i] = QString::fromLocal8Bit(buf);
-                        }
-                        }  // end of switch
-
-                        if (retcode == SQL_ERROR)
-                            return false;
-                    }
-                    lk.relock();
-                    table->addRow(row.release());
-                    lk.unlock();
-                    ++rowcount;
-                    if (rowcount % FETCH_COUNT_NOTIFY == 0)
-                        emit fetched(table);
+                    retcode = SQLRowCount(hstmt_local, &cb);
+                    if (check(retcode, _hdbc, SQL_HANDLE_DBC) && cb != -1)
+                        emit message(tr("%1 rows affected").arg(cb));
                 }
-                if (rowcount == 0 || rowcount % FETCH_COUNT_NOTIFY != 0)
-                    emit fetched(table);
+
+                if (rowcount == limit)
+                    SQLCloseCursor(hstmt_local);
+                retcode = SQLMoreResults(hstmt_local);
             }
+        }
+    }
 
-            if (col_count)
-                emit message(tr("%1 rows fetched").arg(rowcount));
-            else
+    return true;
+}
+
+QVector<bool> OdbcConnection::executeBatch(const QString &query, const QVector<QVector<QVariant>> &paramSets)
+{
+    QVector<bool> res(paramSets.size(), false);
+    asyncStop();
+    clearResultsets();
+    // the statement is the first batch of the query
+    BatchSplitter batches(query);
+    if (paramSets.isEmpty() || !batches.next() || !open())
+        return res;
+    QString q = batches.batch(_crlfLineEnds);
+
+    SQLHSTMT hstmt_local = allocStatement();
+    if (!hstmt_local)
+        return res;
+    _hstmt = hstmt_local;
+    RETCODE retcode;
+
+    std::unique_ptr<SQLHSTMT, std::function<void(SQLHSTMT*)>> hstmt_guard(&hstmt_local, [this](SQLHSTMT *hstmt)
+    {
+        _hstmt = 0;
+        releaseStatement(*hstmt);
+        setQueryState(QueryState::Inactive);
+    });
+
+    setQueryState(QueryState::Running);
+    _timer.start();
+
+    int chunk_size = PARAMSET_MAX_SIZE;
+    int failed = 0;
+    for (int first = 0; first < paramSets.size() && _query_state == QueryState::Running; )
+    {
+        OdbcParams params;
+        int count = qMin(chunk_size, paramSets.size() - first);
+        // bound elements are as long as the longest value, so long values are sent in sets of their own
+        if (OdbcParams::isLongRow(paramSets[first]))
+            count = 1;
+        for (int i = first + 1; i < first + count; ++i)
+        {
+            if (OdbcParams::isLongRow(paramSets[i]))
+                count = i - first;
+        }
+        for (int i = first; i < first + count; ++i)
+            params.addRow(paramSets[i]);
+
+        retcode = params.bind(hstmt_local);
+        if (retcode == SQL_ERROR && count > 1)
+        {
+            // parameter arrays are not supported: one set per execution
+            OdbcParams::unbind(hstmt_local);
+            chunk_size = 1;
+            continue;
+        }
+        if (!checkStmt(retcode, hstmt_local))
+            break;
+        if (params.boundRowCount() < count)
+        {
+            // the driver capped the array size: the rest of sets go in the next chunks
+            OdbcParams::unbind(hstmt_local);
+            chunk_size = qMax(1, params.boundRowCount());
+            continue;
+        }
+
+        retcode = SQLExecDirectW(hstmt_local, sqlText(q), q.size());
+        bool executed = (retcode == SQL_NO_DATA || checkStmt(retcode, hstmt_local));
+        // the status array is complete after all results are processed
+        while (SQL_SUCCEEDED(retcode))
+        {
+            retcode = SQLMoreResults(hstmt_local);
+            if (retcode != SQL_NO_DATA)
+                checkStmt(retcode, hstmt_local);
+        }
+        SQLFreeStmt(hstmt_local, SQL_CLOSE);
+
+        for (int i = 0; i < count; ++i)
+        {
+            res[first + i] = params.succeeded(i, executed);
+            if (!res[first + i])
+                ++failed;
+        }
+        OdbcParams::unbind(hstmt_local);
+        first += count;
+    }
+
+    if (failed)
+        emit error(tr("%1 of %2 parameter sets failed\n").arg(failed).arg(paramSets.size()));
+    return res;
+}
+
+void OdbcConnection::describeColumns(SQLHSTMT hstmt_local, DataTable *table, SQLSMALLINT col_count)
+{
+    for (SQLUSMALLINT i = 0; i < col_count; ++i)
+        describeColumn(hstmt_local, table);
+}
+
+RETCODE OdbcConnection::describeColumn(SQLHSTMT hstmt_local, DataTable *table)
+{
+    SQLSMALLINT name_length = 0, data_type = SQL_UNKNOWN_TYPE, dec_digits = 0, nullable_desc = SQL_NULLABLE_UNKNOWN;
+    SQLULEN col_size = 0;
+    SQLWCHAR col_name[512];
+    SQLUSMALLINT i = static_cast<SQLUSMALLINT>(table->columnCount());
+    RETCODE retcode = SQLDescribeColW(hstmt_local, i + 1, col_name, SQLSMALLINT(512), &name_length, &data_type, &col_size, &dec_digits, &nullable_desc);
+    if (retcode == SQL_STILL_EXECUTING)
+        return retcode;
+    table->addColumn(
+                fromSqlText(col_name, qBound<SQLSMALLINT>(0, name_length, 511)),
+                sqlTypeToVariant(data_type),
+                data_type,
+                col_size,
+                dec_digits,
+                int8_t(nullable_desc),
+                isNumericType(data_type) ?
+                    Qt::AlignRight : Qt::AlignLeft);
+    return retcode;
+}
+
+SQLULEN OdbcConnection::bindColumns(SQLHSTMT hstmt_local, DataTable *table, std::vector<BoundColumn> &columns, int limit)
+{
+    int col_count = table->columnCount();
+    columns.resize(static_cast<size_t>(col_count));
+    size_t row_width = 0;
+    for (int i = 0; i < col_count; ++i)
+    {
+        DataColumn &column = table->getColumn(i);
+        BoundColumn &bc = columns[static_cast<size_t>(i)];
+        int size = column.size();
+        switch (column.sqlType())
+        {
+        case SQL_SMALLINT:
+            bc.c_type = SQL_C_SSHORT;
+            bc.width = sizeof(SQLSMALLINT);
+            break;
+        case SQL_INTEGER:
+            bc.c_type = SQL_C_SLONG;
+            bc.width = sizeof(SQLINTEGER);
+            break;
+        case SQL_BIGINT:
+            bc.c_type = SQL_C_SBIGINT;
+            bc.width = sizeof(SQLBIGINT);
+            break;
+        case SQL_REAL:
+            bc.c_type = SQL_C_FLOAT;
+            bc.width = sizeof(SQLREAL);
+            break;
+        case SQL_FLOAT:
+        case SQL_DOUBLE:
+            bc.c_type = SQL_C_DOUBLE;
+            bc.width = sizeof(SQLDOUBLE);
+            break;
+        case SQL_BIT:
+            bc.c_type = SQL_C_BIT;
+            bc.width = sizeof(SQLCHAR);
+            break;
+        case SQL_TINYINT:
+            bc.c_type = SQL_C_UTINYINT;
+            bc.width = sizeof(SQLCHAR);
+            break;
+        case SQL_TYPE_DATE:
+            bc.c_type = SQL_C_TYPE_DATE;
+            bc.width = sizeof(DATE_STRUCT);
+            break;
+        case SQL_SS_TIME2:
+        case SQL_TYPE_TIME:
+        case SQL_TYPE_TIMESTAMP:
+            bc.c_type = SQL_C_TYPE_TIMESTAMP;
+            bc.width = sizeof(TIMESTAMP_STRUCT);
+            break;
+        case SQL_BINARY:
+        case SQL_VARBINARY:
+            if (size <= 0 || size > BLOCK_MAX_COLUMN_SIZE)
+                return 0;
+            bc.c_type = SQL_C_BINARY;
+            bc.width = size;
+            break;
+        case SQL_WLONGVARCHAR:
+        case SQL_LONGVARCHAR:
+        case SQL_LONGVARBINARY:
+        case SQL_VARIANT:
+            // unbounded (LOB) columns are fetched by SQLGetData
+            return 0;
+        default:
+            if (size <= 0 || size > BLOCK_MAX_COLUMN_SIZE)
+                return 0;
+            // character data is received converted to UTF-16 (not longer than in bytes),
+            // numerics need sign, point and leading zero
+            bc.c_type = SQL_C_WCHAR;
+            bc.width = ((isNumericType(column.sqlType()) ? size + 3 : size) + 1) * SQLLEN(sizeof(SQLWCHAR));
+        }
+        row_width += size_t(bc.width) + sizeof(SQLLEN);
+    }
+
+    SQLULEN block_size = qBound<SQLULEN>(1, BLOCK_BUFFER_SIZE / row_width, BLOCK_MAX_ROWS);
+    if (limit > 0 && SQLULEN(limit) < block_size)
+        block_size = SQLULEN(limit);
+    // a single row is fetched by SQLGetData as usual
+    if (block_size < 2)
+        return 0;
+
+    RETCODE retcode = SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROW_BIND_TYPE, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_BIND_BY_COLUMN)), 0);
+    if (retcode == SQL_SUCCESS)
+        retcode = SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROW_ARRAY_SIZE, reinterpret_cast<SQLPOINTER>(std::intptr_t(block_size)), 0);
+    for (SQLUSMALLINT i = 0; retcode == SQL_SUCCESS && i < col_count; ++i)
+    {
+        BoundColumn &bc = columns[i];
+        bc.data.resize(size_t(bc.width) * block_size);
+        bc.indicators.resize(block_size);
+        retcode = SQLBindCol(hstmt_local, i + 1, bc.c_type, bc.data.data(), bc.width, bc.indicators.data());
+    }
+
+    // the driver does not support block cursors (or substituted array size)
+    if (retcode != SQL_SUCCESS)
+    {
+        unbindColumns(hstmt_local);
+        columns.clear();
+        return 0;
+    }
+    return block_size;
+}
+
+int OdbcConnection::fetchBlocks(SQLHSTMT hstmt_local, DataTable *table, std::vector<BoundColumn> &columns, SQLULEN block_size, int limit)
+{
+    SQLULEN rows_fetched = 0;
+    std::vector<SQLUSMALLINT> row_status(block_size);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROWS_FETCHED_PTR, &rows_fetched, 0);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROW_STATUS_PTR, row_status.data(), 0);
+
+    // detach local buffers from the statement
+    std::unique_ptr<SQLHSTMT, std::function<void(SQLHSTMT*)>> bind_guard(&hstmt_local, [](SQLHSTMT *hstmt)
+    {
+        unbindColumns(*hstmt);
+    });
+
+    RETCODE retcode;
+    int rowcount = 0;
+    bool truncated = false;
+    while ((limit == -1 || rowcount < limit) && (retcode = SQLFetch(hstmt_local)) != SQL_NO_DATA)
+    {
+        if (!checkStmt(retcode, hstmt_local))
+            break;
+
+        int notified = rowcount / FETCH_COUNT_NOTIFY;
+        SQLULEN next_row = 0;
+        rowcount += appendBlock(table, columns, row_status, next_row, rows_fetched,
+                                (limit == -1 ? -1 : limit - rowcount), truncated);
+        if (rowcount / FETCH_COUNT_NOTIFY != notified)
+            emit fetched(table);
+    }
+
+    if (truncated)
+        emit message(tr("warning: some values were truncated while fetching"));
+    return rowcount;
+}
+
+int OdbcConnection::appendBlock(DataTable *table, const std::vector<BoundColumn> &columns,
+                                const std::vector<SQLUSMALLINT> &row_status, SQLULEN &next_row, SQLULEN rows_fetched,
+                                int max_rows, bool &truncated, const QElapsedTimer *slice)
+{
+    int rowcount = 0;
+    QMutexLocker lk(&_resultsetsGuard);
+    for (; next_row < rows_fetched && (max_rows == -1 || rowcount < max_rows); ++next_row)
+    {
+        // a large block of wide rows may take longer than a slice, at least a row is converted
+        if (slice && rowcount && slice->elapsed() >= ASYNC_TIME_SLICE)
+            break;
+        SQLULEN r = next_row;
+        if (row_status[r] != SQL_ROW_SUCCESS && row_status[r] != SQL_ROW_SUCCESS_WITH_INFO)
+            continue;
+        DataRow *row = new DataRow(table);
+        for (size_t i = 0; i < columns.size(); ++i)
+            (*row)[int(i)] = boundValue(columns[i], r, table->getColumn(int(i)).sqlType(), truncated);
+        table->addRow(row);
+        ++rowcount;
+    }
+    return rowcount;
+}
+
+void OdbcConnection::initColumnBuffers(std::vector<std::vector<char>> &buffers, int count)
+{
+    buffers.resize(static_cast<size_t>(count));
+    for (std::vector<char> &buf: buffers)
+        buf.assign(COLUMN_BUFFER_SIZE, 0);
+}
+
+void OdbcConnection::growColumnBuffer(std::vector<char> &buffer, SQLLEN size)
+{
+    // next values of the similar size are received by a single call
+    if (size != SQL_NO_TOTAL && size <= COLUMN_BUFFER_MAX_SIZE && size_t(size) > buffer.size())
+        buffer.resize(size_t(size));
+}
+
+void OdbcConnection::unbindColumns(SQLHSTMT hstmt_local) noexcept
+{
+    SQLFreeStmt(hstmt_local, SQL_UNBIND);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROW_ARRAY_SIZE, reinterpret_cast<SQLPOINTER>(std::intptr_t(1)), 0);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROWS_FETCHED_PTR, nullptr, 0);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_ROW_STATUS_PTR, nullptr, 0);
+}
+
+QVariant OdbcConnection::boundValue(const BoundColumn &column, SQLULEN row, int sqlType, bool &truncated) const noexcept
+{
+    SQLLEN cb = column.indicators[row];
+    if (cb == SQL_NULL_DATA)
+        return QVariant();
+
+    const char *ptr = column.data.data() + size_t(column.width) * row;
+    switch (column.c_type)
+    {
+    case SQL_C_SSHORT:
+        return int(*reinterpret_cast<const SQLSMALLINT*>(ptr));
+    case SQL_C_SLONG:
+        return qint32(*reinterpret_cast<const SQLINTEGER*>(ptr));
+    case SQL_C_SBIGINT:
+        return qint64(*reinterpret_cast<const SQLBIGINT*>(ptr));
+    case SQL_C_FLOAT:
+        return *reinterpret_cast<const float*>(ptr);
+    case SQL_C_DOUBLE:
+        return *reinterpret_cast<const double*>(ptr);
+    case SQL_C_BIT:
+        return (*ptr ? true : false);
+    case SQL_C_UTINYINT:
+        return int(*reinterpret_cast<const unsigned char*>(ptr));
+    case SQL_C_TYPE_DATE:
+    {
+        const DATE_STRUCT *date = reinterpret_cast<const DATE_STRUCT*>(ptr);
+        return QDate(date->year, date->month, date->day);
+    }
+    case SQL_C_TYPE_TIMESTAMP:
+    {
+        const TIMESTAMP_STRUCT *dt = reinterpret_cast<const TIMESTAMP_STRUCT*>(ptr);
+        QTime time(dt->hour, dt->minute, dt->second, dt->fraction / 1000000);
+        if (sqlType == SQL_TYPE_TIME || sqlType == SQL_SS_TIME2)
+            return time;
+        return QDateTime(QDate(dt->year, dt->month, dt->day), time);
+    }
+    case SQL_C_BINARY:
+        if (cb == SQL_NO_TOTAL || cb > column.width)
+        {
+            truncated = true;
+            cb = column.width;
+        }
+        return QByteArray(ptr, int(cb));
+    default: // SQL_C_WCHAR
+    {
+        SQLLEN max_len = column.width - SQLLEN(sizeof(SQLWCHAR));
+        if (cb == SQL_NO_TOTAL || cb > max_len)
+        {
+            truncated = true;
+            cb = max_len;
+        }
+        return fromSqlText(reinterpret_cast<const SQLWCHAR*>(ptr), int(cb / SQLLEN(sizeof(SQLWCHAR))));
+    }
+    }
+}
+
+int OdbcConnection::fetchRows(SQLHSTMT hstmt_local, DataTable *table, int limit)
+{
+    RETCODE retcode;
+    int rowcount = 0;
+    std::vector<std::vector<char>> buffers;
+    initColumnBuffers(buffers, table->columnCount());
+    while ((limit == -1 || rowcount < limit) && (retcode = SQLFetch(hstmt_local)) != SQL_NO_DATA)
+    {
+        if (!checkStmt(retcode, hstmt_local))
+            break;
+        if (!appendRow(hstmt_local, table, buffers))
+            return -1;
+        ++rowcount;
+        if (rowcount % FETCH_COUNT_NOTIFY == 0)
+            emit fetched(table);
+    }
+    return rowcount;
+}
+
+bool OdbcConnection::appendRow(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers)
+{
+    // synchronous statements complete every call at once
+    RowReader reader;
+    return readRow(hstmt_local, table, buffers, reader) == SQL_SUCCESS;
+}
+
+RETCODE OdbcConnection::readRow(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers, RowReader &reader)
+{
+    int col_count = table->columnCount();
+    if (!reader.row)
+    {
+        reader.row.reset(new DataRow(table));
+        reader.column = 0;
+        reader.received = -1;
+    }
+    for (; reader.column < col_count; ++reader.column)
+    {
+        RETCODE retcode = readValue(hstmt_local, table, buffers, reader);
+        if (retcode == SQL_STILL_EXECUTING)
+            return retcode;
+        reader.received = -1;
+        reader.bytes = QByteArray();
+        reader.text = QString();
+        if (retcode == SQL_ERROR)
+        {
+            reader.row.reset();
+            return retcode;
+        }
+    }
+    QMutexLocker lk(&_resultsetsGuard);
+    table->addRow(reader.row.release());
+    return SQL_SUCCESS;
+}
+
+RETCODE OdbcConnection::readValue(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers, RowReader &reader)
+{
+    RETCODE retcode;
+    const SQLUSMALLINT i = static_cast<SQLUSMALLINT>(reader.column);
+    QVariant &value = (*reader.row)[i];
+    SQLLEN &cb = reader.cb;
+    RowReader::Fixed &fixed = reader.fixed;
+    int type = table->getColumn(i).sqlType();
+
+    SQLSMALLINT c_type = 0;
+    switch (type)
+    {
+    case SQL_SMALLINT:
+        c_type = SQL_C_SSHORT;
+        break;
+    case SQL_BIGINT:
+        c_type = SQL_C_SBIGINT;
+        break;
+    case SQL_INTEGER:
+        c_type = SQL_C_SLONG;
+        break;
+    case SQL_REAL:
+        c_type = SQL_C_FLOAT;
+        break;
+    case SQL_FLOAT:
+    case SQL_DOUBLE:
+        c_type = SQL_C_DOUBLE;
+        break;
+    case SQL_BIT:
+        c_type = SQL_C_BIT;
+        break;
+    case SQL_TINYINT:
+        c_type = SQL_C_UTINYINT;
+        break;
+    case SQL_TYPE_DATE:
+        c_type = SQL_C_TYPE_DATE;
+        break;
+    case SQL_SS_TIME2:
+    case SQL_TYPE_TIME:
+        // SQL_C_TYPE_TIME loses fractions of seconds
+    case SQL_TYPE_TIMESTAMP:
+        c_type = SQL_C_TYPE_TIMESTAMP;
+        break;
+    }
+
+    if (c_type)
+    {
+        // fixed size values, the target must stay the same while the call is repeated
+        cb = SQL_NULL_DATA;
+        retcode = SQLGetData(hstmt_local, i + 1, c_type, &fixed, sizeof(fixed), &cb);
+        if (retcode == SQL_STILL_EXECUTING || !checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
+            return retcode;
+        switch (type)
+        {
+        case SQL_SMALLINT:
+            value = fixed.smallint;
+            break;
+        case SQL_BIGINT:
+            value = fixed.bigint;
+            break;
+        case SQL_INTEGER:
+            value = fixed.integer;
+            break;
+        case SQL_REAL:
+            value = fixed.real;
+            break;
+        case SQL_FLOAT:
+        case SQL_DOUBLE:
+            value = fixed.dbl;
+            break;
+        case SQL_BIT:
+            value = (fixed.byte ? true : false);
+            break;
+        case SQL_TINYINT:
+            value = fixed.byte;
+            break;
+        case SQL_TYPE_DATE:
+            value = QDate(fixed.date.year, fixed.date.month, fixed.date.day);
+            break;
+        case SQL_SS_TIME2:
+        case SQL_TYPE_TIME:
+            value = QTime(fixed.timestamp.hour, fixed.timestamp.minute, fixed.timestamp.second, fixed.timestamp.fraction / 1000000);
+            break;
+        case SQL_TYPE_TIMESTAMP:
+        {
+            const TIMESTAMP_STRUCT &dt = fixed.timestamp;
+            value = QDateTime(QDate(dt.year, dt.month, dt.day), QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000));
+            break;
+        }
+        }
+        return retcode;
+    }
+
+    std::vector<char> &buf = buffers[i];
+    if (type == SQL_BINARY || type == SQL_VARBINARY || type == SQL_LONGVARBINARY)
+    {
+        // raw bytes (the driver's hex string conversion doubles the size):
+        // short values are received into the column buffer, the rest
+        // of long ones straight into the value storage
+        QByteArray &bytes = reader.bytes;
+        if (reader.received < 0)
+        {
+            SQLLEN buf_len = SQLLEN(buf.size());
+            cb = SQL_NULL_DATA;
+            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_BINARY, buf.data(), buf_len, &cb);
+            if (retcode == SQL_ERROR)
+                checkStmt(retcode, hstmt_local);
+            if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
+                return retcode;
+            if (cb != SQL_NO_TOTAL && cb <= buf_len)
             {
-                retcode = SQLRowCount(hstmt_local, &cb);
-                if (check(retcode, _hdbc, SQL_HANDLE_DBC) && cb != -1)
-                    emit message(tr("%1 rows affected").arg(cb));
+                value = QByteArray(buf.data(), int(cb));
+                return retcode;
             }
+            growColumnBuffer(buf, cb);
 
-            if (rowcount == limit)
-                SQLCloseCursor(hstmt_local);
-            retcode = SQLMoreResults(hstmt_local);
+            // cb is the length of data available before the call
+            reader.received = int(buf_len);
+            bytes = QByteArray(cb == SQL_NO_TOTAL ? reader.received * 2 : int(cb), Qt::Uninitialized);
+            memcpy(bytes.data(), buf.data(), size_t(reader.received));
+            reader.chunkPending = false;
+            if (retcode != SQL_SUCCESS_WITH_INFO)
+            {
+                bytes.resize(reader.received);
+                value = bytes;
+                return retcode;
+            }
         }
+        while (true)
+        {
+            // the storage is not changed while a chunk is pending
+            if (!reader.chunkPending && reader.received == bytes.size())
+                bytes.resize(bytes.size() * 2);
+            SQLLEN available = bytes.size() - reader.received;
+            retcode = SQLGetData(hstmt_local, i + 1, SQL_C_BINARY, bytes.data() + reader.received, available, &cb);
+            if ((reader.chunkPending = (retcode == SQL_STILL_EXECUTING)))
+                return retcode;
+            if (!SQL_SUCCEEDED(retcode))
+                break;
+            if (retcode == SQL_SUCCESS_WITH_INFO && (cb == SQL_NO_TOTAL || cb > available))
+            {
+                reader.received += int(available);
+                bytes.resize(cb == SQL_NO_TOTAL ? bytes.size() * 2 : reader.received + int(cb - available));
+            }
+            else
+            {
+                reader.received += int(cb);
+                break;
+            }
+        }
+        if (retcode == SQL_ERROR)
+        {
+            checkStmt(retcode, hstmt_local);
+            return retcode;
+        }
+        bytes.resize(reader.received);
+        value = bytes;
+        return retcode;
     }
 
-    return true;
+    // character data of any type is received as UTF-16 straight into QString,
+    // the same way as binary data, but every chunk is null-terminated
+    const SQLLEN char_size = SQLLEN(sizeof(SQLWCHAR));
+    QString &text = reader.text;
+    if (reader.received < 0)
+    {
+        SQLLEN buf_len = SQLLEN(buf.size());
+        cb = SQL_NULL_DATA;
+        retcode = SQLGetData(hstmt_local, i + 1, SQL_C_WCHAR, buf.data(), buf_len, &cb);
+        if (retcode == SQL_ERROR)
+            checkStmt(retcode, hstmt_local);
+        if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
+            return retcode;
+        if (cb != SQL_NO_TOTAL && cb + char_size <= buf_len)
+        {
+            value = fromSqlText(reinterpret_cast<const SQLWCHAR*>(buf.data()), int(cb / char_size));
+            return retcode;
+        }
+        growColumnBuffer(buf, cb == SQL_NO_TOTAL ? cb : cb + char_size);
+
+        // the string has a room for the terminator of the last chunk
+        reader.received = int(buf_len / char_size) - 1;
+        text = QString(cb == SQL_NO_TOTAL ? reader.received * 2 : int(cb / char_size) + 1, Qt::Uninitialized);
+        memcpy(text.data(), buf.data(), size_t(reader.received) * sizeof(SQLWCHAR));
+        reader.chunkPending = false;
+        if (retcode != SQL_SUCCESS_WITH_INFO)
+        {
+            text.resize(reader.received);
+            value = text;
+            return retcode;
+        }
+    }
+    while (true)
+    {
+        // the storage is not changed while a chunk is pending
+        if (!reader.chunkPending && text.size() - reader.received < 2)
+            text.resize(text.size() * 2);
+        SQLLEN available = (text.size() - reader.received) * char_size;
+        retcode = SQLGetData(hstmt_local, i + 1, SQL_C_WCHAR, text.data() + reader.received, available, &cb);
+        if ((reader.chunkPending = (retcode == SQL_STILL_EXECUTING)))
+            return retcode;
+        if (!SQL_SUCCEEDED(retcode))
+            break;
+        if (retcode == SQL_SUCCESS_WITH_INFO && (cb == SQL_NO_TOTAL || cb + char_size > available))
+        {
+            reader.received += int(available / char_size) - 1;
+            text.resize(cb == SQL_NO_TOTAL ?
+                            text.size() * 2 :
+                            reader.received + int((cb - available) / char_size) + 2);
+        }
+        else
+        {
+            reader.received += int(cb / char_size);
+            break;
+        }
+    }
+    if (retcode == SQL_ERROR)
+    {
+        checkStmt(retcode, hstmt_local);
+        return retcode;
+    }
+    text.resize(reader.received);
+    value = text;
+    return retcode;
 }
 
 void OdbcConnection::executeAsync(const QString &query, const QVector<QVariant> *params) noexcept
+{
+    if (_async)
+    {
+        emit error(tr("another command is already in progress\n"));
+        return;
+    }
+    // connecting and drivers without statement level asynchronous
+    // execution block the calling thread
+    if (!startAsync(query, params))
+        executeInThread(query, params);
+}
+
+void OdbcConnection::executeInThread(const QString &query, const QVector<QVariant> *params) noexcept
 {
     QThread* thread = new QThread(); // man: The object cannot be moved if it has a parent.
     moveToThread(thread);
@@ -504,26 +1138,312 @@ void OdbcConnection::executeAsync(const QString &query, const QVector<QVariant>
     thread->start();
 }
 
-bool OdbcConnection::open()
+bool OdbcConnection::startAsync(const QString &query, const QVector<QVariant> *params)
 {
-    if (!_hdbc)
+    if (!isOpened())
+        return false;
+
+    SQLUINTEGER async_mode = SQL_AM_NONE;
+    RETCODE retcode = SQLGetInfoW(_hdbc, SQL_ASYNC_MODE, &async_mode, sizeof(async_mode), nullptr);
+    // on connection level all statements of the connection must be asynchronous
+    if (!SQL_SUCCEEDED(retcode) || async_mode != SQL_AM_STATEMENT)
+        return false;
+
+    SQLHSTMT hstmt_local = allocStatement();
+    if (!hstmt_local)
+        return false;
+    retcode = SQLSetStmtAttr(hstmt_local, SQL_ATTR_ASYNC_ENABLE, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_ASYNC_ENABLE_ON)), 0);
+    if (retcode != SQL_SUCCESS)
+    {
+        releaseStatement(hstmt_local);
         return false;
+    }
+
+    clearResultsets();
+    _async.reset(new AsyncQuery(query));
+    _async->hstmt = hstmt_local;
+    if (params && !params->isEmpty())
+    {
+        _async->params.addRow(*params);
+        if (!checkStmt(_async->params.bind(hstmt_local), hstmt_local))
+        {
+            releaseStatement(hstmt_local);
+            _async.reset();
+            return false;
+        }
+    }
+    _hstmt = hstmt_local;
+    _pollInterval = 0;
+    setQueryState(QueryState::Running);
+    _timer.start();
+    _pollTimer->start(0);
+    return true;
+}
+
+void OdbcConnection::asyncProceed()
+{
+    AsyncQuery &q = *_async;
+    QElapsedTimer slice;
+    slice.start();
+    while (slice.elapsed() < ASYNC_TIME_SLICE)
+    {
+        // the driver completes (fails) a cancelled operation in progress,
+        // otherwise there is nothing to wait for
+        if (_query_state == QueryState::Cancelling && !q.pending)
+        {
+            if (q.stage == async_stage::fetching)
+                asyncResultsetDone();
+            else if (q.stage == async_stage::describing)
+                q.table = nullptr;
+            asyncFinish();
+            return;
+        }
+
+        RETCODE retcode;
+        switch (q.stage)
+        {
+        case async_stage::next_query:
+            // the next batch is scanned only after the current one is executed
+            if (++q.repeat >= q.batches.count())
+            {
+                if (!q.batches.next())
+                {
+                    asyncFinish();
+                    return;
+                }
+                q.text = q.batches.batch(_crlfLineEnds);
+                q.repeat = 0;
+            }
+            q.stage = async_stage::executing;
+            break;
+        case async_stage::executing:
+            // the same arguments are passed on every poll
+            retcode = SQLExecDirectW(q.hstmt, sqlText(q.text), q.text.size());
+            if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                return asyncWait();
+            q.retcode = retcode;
+            q.stage = (retcode == SQL_NO_DATA ? async_stage::next_query : async_stage::result_ready);
+            break;
+        case async_stage::result_ready:
+            if (!checkStmt(q.retcode, q.hstmt))
+            {
+                q.stage = async_stage::next_query;
+                break;
+            }
+            q.stage = async_stage::counting_columns;
+            break;
+        // every call on an asynchronous statement may return SQL_STILL_EXECUTING,
+        // even a local one, it is repeated on the next poll then
+        case async_stage::counting_columns:
+            q.col_count = 0;
+            retcode = SQLNumResultCols(q.hstmt, &q.col_count);
+            if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                return asyncWait();
+            if (checkStmt(retcode, q.hstmt) && q.col_count)
+            {
+                q.table = new DataTable();
+                QMutexLocker lk(&_resultsetsGuard);
+                _resultsets.append(q.table);
+                lk.unlock();
+                q.stage = async_stage::describing;
+            }
+            else
+                q.stage = async_stage::counting_rows;
+            break;
+        case async_stage::describing:
+            if (q.table->columnCount() < q.col_count)
+            {
+                retcode = describeColumn(q.hstmt, q.table);
+                if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                    return asyncWait();
+                break;
+            }
+            q.rowcount = 0;
+            q.truncated = false;
+            q.block_row = q.rows_fetched = 0;
+            q.block_size = bindColumns(q.hstmt, q.table, q.columns, -1);
+            if (!q.block_size)
+                initColumnBuffers(q.buffers, q.col_count);
+            if (q.block_size)
+            {
+                q.row_status.resize(q.block_size);
+                SQLSetStmtAttr(q.hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &q.rows_fetched, 0);
+                SQLSetStmtAttr(q.hstmt, SQL_ATTR_ROW_STATUS_PTR, q.row_status.data(), 0);
+            }
+            q.stage = async_stage::fetching;
+            break;
+        case async_stage::counting_rows:
+        {
+            SQLLEN cb = -1;
+            retcode = SQLRowCount(q.hstmt, &cb);
+            if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                return asyncWait();
+            if (check(retcode, _hdbc, SQL_HANDLE_DBC) && cb != -1)
+                emit message(tr("%1 rows affected").arg(cb));
+            q.stage = async_stage::more_results;
+            break;
+        }
+        case async_stage::fetching:
+        {
+            // values of a row being read by SQLGetData are received on later polls,
+            // as are rows of a block not converted within the slice
+            if (!q.reader.row && (!q.block_size || q.block_row >= q.rows_fetched))
+            {
+                q.block_row = 0;
+                retcode = SQLFetch(q.hstmt);
+                if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                    return asyncWait();
+                if (retcode == SQL_NO_DATA || !checkStmt(retcode, q.hstmt))
+                {
+                    asyncResultsetDone();
+                    q.stage = async_stage::more_results;
+                    break;
+                }
+            }
+            int notified = q.rowcount / FETCH_COUNT_NOTIFY;
+            if (q.block_size)
+                q.rowcount += appendBlock(q.table, q.columns, q.row_status, q.block_row, q.rows_fetched, -1, q.truncated, &slice);
+            else
+            {
+                retcode = readRow(q.hstmt, q.table, q.buffers, q.reader);
+                if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                    return asyncWait();
+                if (retcode == SQL_ERROR)
+                {
+                    // rows fetched so far are shown, the error is reported by readRow
+                    asyncResultsetDone();
+                    asyncFinish();
+                    return;
+                }
+                ++q.rowcount;
+            }
+            if (q.rowcount / FETCH_COUNT_NOTIFY != notified)
+                emit fetched(q.table);
+            break;
+        }
+        case async_stage::more_results:
+            retcode = SQLMoreResults(q.hstmt);
+            if ((q.pending = (retcode == SQL_STILL_EXECUTING)))
+                return asyncWait();
+            q.retcode = retcode;
+            q.stage = async_stage::result_ready;
+            break;
+        }
+        _pollInterval = 0;
+    }
+    // let the event loop process pending events before going on
+    _pollTimer->start(0);
+}
+
+void OdbcConnection::asyncWait()
+{
+    _pollInterval = qBound(1, _pollInterval * 2, ASYNC_MAX_POLL_INTERVAL);
+    _pollTimer->start(_pollInterval);
+}
+
+void OdbcConnection::asyncResultsetDone()
+{
+    AsyncQuery &q = *_async;
+    if (q.block_size)
+    {
+        unbindColumns(q.hstmt);
+        q.columns.clear();
+        q.block_size = 0;
+    }
+    if (q.rowcount == 0 || q.rowcount % FETCH_COUNT_NOTIFY != 0)
+        emit fetched(q.table);
+    if (q.truncated)
+        emit message(tr("warning: some values were truncated while fetching"));
+    emit message(tr("%1 rows fetched").arg(q.rowcount));
+    q.table = nullptr;
+}
+
+void OdbcConnection::asyncFinish()
+{
+    _pollTimer->stop();
+    releaseStatement(_async->hstmt);
+    _hstmt = 0;
+    _async.reset();
+    setQueryState(QueryState::Inactive);
+    emit message(tr("done (%1)").arg(elapsed()));
+    emit setContext(context());
+}
+
+void OdbcConnection::asyncStop()
+{
+    if (!_async)
+        return;
+    cancel();
+    // polled here: the event loop is not returned to until the query is finished
+    while (_async)
+    {
+        asyncProceed();
+        if (_async && _async->pending)
+            QThread::msleep(1);
+    }
+}
+
+bool OdbcConnection::open()
+{
     if (isOpened())
         return true;
+    // dead or broken connection
+    bool restoring = _connectionBroken;
+    if (_connected)
+        close();
+    if (!_hdbc && !allocConnection())
+        return false;
 
-    SQLCHAR szConnStrOut[1024];
+    SQLWCHAR szConnStrOut[1024];
     SQLSMALLINT swStrLen;
     RETCODE retcode;
     SQLPOINTER timeout = reinterpret_cast<SQLPOINTER>(std::intptr_t(5));
-    std::string cs = finalConnectionString();
+    QString cs = finalConnectionString();
 
-    SQLSetConnectAttrA(_hdbc, SQL_ATTR_CONNECTION_TIMEOUT, timeout, SQL_IS_UINTEGER);
-    SQLSetConnectAttrA(_hdbc, SQL_ATTR_LOGIN_TIMEOUT, timeout, SQL_IS_UINTEGER);
-    retcode = SQLDriverConnectA(_hdbc, 0, const_cast<SQLCHAR*>(reinterpret_cast<const SQLCHAR*>(cs.c_str())),
-                                SQL_NTS, szConnStrOut,
+    SQLSetConnectAttrW(_hdbc, SQL_ATTR_CONNECTION_TIMEOUT, timeout, SQL_IS_UINTEGER);
+    SQLSetConnectAttrW(_hdbc, SQL_ATTR_LOGIN_TIMEOUT, timeout, SQL_IS_UINTEGER);
+    retcode = SQLDriverConnectW(_hdbc, 0, sqlText(cs),
+                                SQLSMALLINT(cs.size()), szConnStrOut,
                                 1024, &swStrLen, SQL_DRIVER_NOPROMPT);
+    // a session taken from the pool may have died while idle, the driver manager
+    // does not return a dead session to the pool on disconnect
+    for (int i = 0; i < POOL_MAX_DEAD_SESSIONS && SQL_SUCCEEDED(retcode) && isConnectionDead(); ++i)
+    {
+        SQLDisconnect(_hdbc);
+        retcode = SQLDriverConnectW(_hdbc, 0, sqlText(cs),
+                                    SQLSMALLINT(cs.size()), szConnStrOut,
+                                    1024, &swStrLen, SQL_DRIVER_NOPROMPT);
+    }
+    if (SQL_SUCCEEDED(retcode) && isConnectionDead())
+    {
+        SQLDisconnect(_hdbc);
+        emit error(tr("the connection is dead\n"));
+        return false;
+    }
     if (check(retcode, _hdbc, SQL_HANDLE_DBC))
     {
+        _connected = true;
+        _connectionBroken = false;
+        if (!_privateEnv)
+        {
+            QMutexLocker lk(&_sharedEnvGuard);
+            bool known = _resettingDrivers.contains(cs);
+            bool resets = known ? _resettingDrivers.value(cs) : resetsPooledSessions();
+            _resettingDrivers.insert(cs, resets);
+            lk.unlock();
+            if (!resets)
+            {
+                // the session is returned to the shared pool before anything is done
+                // with it, the connection is made again with its own environment
+                close();
+                freeConnection();
+                return open();
+            }
+        }
+        if (restoring)
+            emit message(tr("connection restored\n"));
+        // ms sql server wants \r\n line ends
+        _crlfLineEnds = dbmsName().contains("SQL Server", Qt::CaseInsensitive);
         emit setContext(context());
         return true;
     }
@@ -542,11 +1462,11 @@ QString OdbcConnection::dbmsName() const noexcept
         return info;
     const SQLSMALLINT buf_size = 256;
     SQLSMALLINT res_size;
-    char info_buf[buf_size];
-    RETCODE retcode = SQLGetInfoA(_hdbc, SQL_DBMS_NAME, info_buf, buf_size, &res_size);
+    SQLWCHAR info_buf[buf_size];
+    RETCODE retcode = SQLGetInfoW(_hdbc, SQL_DBMS_NAME, info_buf, sizeof(info_buf), &res_size);
     if (check(retcode, _hdbc, SQL_HANDLE_DBC))
     //if (retcode == SQL_SUCCESS)
-        info = QString::fromLocal8Bit(info_buf, SQL_NTS);
+        info = fromSqlText(info_buf);
     return info;
 }
 
@@ -557,10 +1477,10 @@ QString OdbcConnection::dbmsVersion() const noexcept
         return info;
     const SQLSMALLINT buf_size = 256;
     SQLSMALLINT res_size;
-    char info_buf[buf_size];
-    RETCODE retcode = SQLGetInfoA(_hdbc, SQL_DBMS_VER, info_buf, buf_size, &res_size);
+    SQLWCHAR info_buf[buf_size];
+    RETCODE retcode = SQLGetInfoW(_hdbc, SQL_DBMS_VER, info_buf, sizeof(info_buf), &res_size);
     if (check(retcode, _hdbc, SQL_HANDLE_DBC))
-        info = QString::fromLocal8Bit(info_buf, SQL_NTS);
+        info = fromSqlText(info_buf);
     return info;
 }
 
@@ -574,11 +1494,11 @@ int OdbcConnection::dbmsComparableVersion()
     return 0x7fffffff;
 }
 
-std::string OdbcConnection::finalConnectionString() const noexcept
+QString OdbcConnection::finalConnectionString() const noexcept
 {
     return ("APP=sqt;" + _connection_string +
             (_database.isEmpty() ?
-                 "" : ";Database={" + _database + "};")).toStdString();
+                 "" : ";Database={" + _database + "};"));
 }
 
 bool OdbcConnection::isUnquotedType(int sqlType) const noexcept
@@ -612,19 +1532,19 @@ QString OdbcConnection::context() const noexcept
     RETCODE retcode;
     const SQLSMALLINT buf_size = 256;
     SQLSMALLINT res_size;
-    char info_buf[buf_size];
+    SQLWCHAR info_buf[buf_size];
     QString tmp, context;
 
-    retcode = SQLGetInfoA(_hdbc, SQL_SERVER_NAME, info_buf, buf_size, &res_size);
+    retcode = SQLGetInfoW(_hdbc, SQL_SERVER_NAME, info_buf, sizeof(info_buf), &res_size);
     if (retcode != SQL_SUCCESS)
         return "";
     //if (check(retcode, _hdbc, SQL_HANDLE_DBC) && res_size)
-    context = QString::fromLocal8Bit(info_buf, SQL_NTS);
+    context = fromSqlText(info_buf);
 
-    retcode = SQLGetInfoA(_hdbc, SQL_DATABASE_NAME, info_buf, buf_size, &res_size);
+    retcode = SQLGetInfoW(_hdbc, SQL_DATABASE_NAME, info_buf, sizeof(info_buf), &res_size);
     //if (check(retcode, _hdbc, SQL_HANDLE_DBC) && res_size)
     if (retcode == SQL_SUCCESS)
-        tmp = QString::fromLocal8Bit(info_buf, SQL_NTS);
+        tmp = fromSqlText(info_buf);
 
     if (context.isEmpty())
         context = tmp;
@@ -642,24 +1562,24 @@ QString OdbcConnection::database() const noexcept
 void OdbcConnection::close() noexcept
 {
     clearResultsets();
-    if (!isOpened())
+    SQLHSTMT cached = _cachedStmt.exchange(SQL_NULL_HSTMT);
+    if (cached)
+        SQLFreeHandle(SQL_HANDLE_STMT, cached);
+    if (!_connected)
         return;
+    // returns the connection to the driver manager's pool, a private one is
+    // closed with its environment
     SQLDisconnect(_hdbc);
+    _connected = false;
+    if (_privateEnv)
+        freeConnection();
 }
 
 bool OdbcConnection::isOpened() const noexcept
 {
-    if (!_hdbc)
+    if (!_hdbc || !_connected || _connectionBroken)
         return false;
-    SQLINTEGER isConnectionDead;
-    RETCODE retcode = SQLGetConnectAttr(_hdbc,
-                                        SQL_ATTR_CONNECTION_DEAD,
-                                        &isConnectionDead,
-                                        sizeof(isConnectionDead),
-                                        nullptr);
-    if (retcode == SQL_SUCCESS || retcode == SQL_SUCCESS_WITH_INFO)
-        return !isConnectionDead;
-    return false;
+    return !isConnectionDead();
 }
 
 void OdbcConnection::cancel() noexcept
@@ -670,6 +1590,14 @@ void OdbcConnection::cancel() noexcept
         setQueryState(QueryState::Cancelling);
         emit message(tr("cancelling..."));
 
+        if (_async)
+        {
+            // an asynchronous operation in progress fails on the next poll
+            checkStmt(SQLCancel(hstmt_local), hstmt_local);
+            _pollTimer->start(0);
+            return;
+        }
+
         QThread* thread = new QThread;
         connect(thread, &QThread::started, [this, thread, hstmt_local]() {
             checkStmt(SQLCancel(hstmt_local), hstmt_local);
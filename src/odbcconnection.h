@@ -16,9 +16,17 @@
 #include <sqlext.h>
 #include <QString>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QHash>
+#include <vector>
+#include <memory>
 #include "dbconnection.h"
+#include "datatable.h"
+#include "batchsplitter.h"
+#include "odbcparams.h"
 
 class QueryCanceller;
+class QTimer;
 
 class OdbcConnection : public DbConnection
 {
@@ -43,14 +51,143 @@ public:
     virtual QMetaType::Type sqlTypeToVariant(int sqlType) const noexcept override;
     virtual void executeAsync(const QString &query, const QVector<QVariant> *params = nullptr) noexcept override;
     virtual bool execute(const QString &query, const QVector<QVariant> *params = nullptr, int limit = -1) override;
+    virtual QVector<bool> executeBatch(const QString &query, const QVector<QVector<QVariant>> &paramSets) override;
+    using DbConnection::executeBatch;
 
 private:
+    struct BoundColumn
+    {
+        SQLSMALLINT c_type;
+        SQLLEN width;                   ///< size of a single element
+        std::vector<char> data;         ///< column-wise bound values
+        std::vector<SQLLEN> indicators;
+    };
+
+    /*!
+     * \brief state of a row being read by SQLGetData, kept while a call is repeated
+     */
+    struct RowReader
+    {
+        std::unique_ptr<DataRow> row;   ///< nullptr if no row is being read
+        int column = 0;
+        int received = -1;              ///< characters/bytes of a long value received (-1 before the first chunk)
+        bool chunkPending = false;      ///< the storage must not be moved
+        QByteArray bytes;               ///< long binary value
+        QString text;                   ///< long character value
+        SQLLEN cb = 0;
+        union Fixed
+        {
+            short smallint;
+            qint64 bigint;
+            qint32 integer;
+            float real;
+            double dbl;
+            unsigned char byte;
+            DATE_STRUCT date;
+            TIMESTAMP_STRUCT timestamp;
+        } fixed;                        ///< fixed size value
+    };
+
+    enum class async_stage { next_query, executing, result_ready, counting_columns, describing, counting_rows, fetching, more_results };
+    /*!
+     * \brief state of a query executed by polling of an asynchronous statement
+     */
+    struct AsyncQuery
+    {
+        AsyncQuery(const QString &query) : batches(query) {}
+        async_stage stage = async_stage::next_query;
+        bool pending = false;           ///< the driver returned SQL_STILL_EXECUTING
+        BatchSplitter batches;
+        OdbcParams params;
+        int repeat = 0;                 ///< execution number of the current batch
+        QString text;                   ///< statement text must stay intact while polling
+        SQLHSTMT hstmt = SQL_NULL_HSTMT;
+        RETCODE retcode = SQL_SUCCESS;
+        DataTable *table = nullptr;
+        SQLSMALLINT col_count = 0;
+        int rowcount = 0;
+        bool truncated = false;
+        std::vector<BoundColumn> columns;
+        std::vector<SQLUSMALLINT> row_status;
+        std::vector<std::vector<char>> buffers;
+        RowReader reader;
+        SQLULEN block_size = 0, rows_fetched = 0;
+        SQLULEN block_row = 0;          ///< the next fetched row of the block to convert
+    };
+
+    static SQLHENV _sharedEnv;
+    static int _sharedEnvRefs;
+    static QMutex _sharedEnvGuard;
+    static QHash<QString, bool> _resettingDrivers;  ///< whether drivers reset pooled sessions, by connection strings
     SQLHENV _henv;
+    bool _privateEnv = false;       ///< the environment (and its pool) is not shared
     SQLHDBC _hdbc;
+    bool _connected = false;
+    std::atomic<bool> _connectionBroken { false };
     std::atomic<SQLHSTMT> _hstmt; // to cancel query from another thread
+    std::atomic<SQLHSTMT> _cachedStmt; ///< closed statement to be reused
+    bool _crlfLineEnds = true;
+    std::unique_ptr<AsyncQuery> _async;
+    QTimer *_pollTimer;
+    int _pollInterval = 0;
+    /*!
+     * \brief environment shared by all connections (with connection pooling enabled)
+     */
+    static SQLHENV acquireEnvironment() noexcept;
+    static void releaseEnvironment() noexcept;
+    static SQLHENV allocEnvironment() noexcept;
+    bool allocConnection();         ///< the handle is allocated on the first open()
+    void freeConnection() noexcept;
+    bool resetsPooledSessions() const noexcept;     ///< checked on a just connected session
+    bool isConnectionDead() const noexcept;
+    SQLHSTMT allocStatement();
+    void releaseStatement(SQLHSTMT hstmt) noexcept;
     bool checkStmt(RETCODE retcode, SQLHSTMT handle);
     bool check(RETCODE retcode, SQLHANDLE handle, SQLSMALLINT handle_type) const;
-    std::string finalConnectionString() const noexcept;
+    QString finalConnectionString() const noexcept;
+    void describeColumns(SQLHSTMT hstmt_local, DataTable *table, SQLSMALLINT col_count);
+    RETCODE describeColumn(SQLHSTMT hstmt_local, DataTable *table);    ///< the next column
+    /*!
+     * \brief bind bounded columns to arrays to fetch many rows per SQLFetch call
+     * \return row array size or 0 if the resultset must be fetched row by row
+     */
+    SQLULEN bindColumns(SQLHSTMT hstmt_local, DataTable *table, std::vector<BoundColumn> &columns, int limit);
+    int fetchBlocks(SQLHSTMT hstmt_local, DataTable *table, std::vector<BoundColumn> &columns, SQLULEN block_size, int limit);
+    /*!
+     * \brief convert fetched rows of the block starting from next_row
+     * \param slice stop when the time slice of asynchronous execution is over (next_row is left at the rest)
+     */
+    int appendBlock(DataTable *table, const std::vector<BoundColumn> &columns,
+                    const std::vector<SQLUSMALLINT> &row_status, SQLULEN &next_row, SQLULEN rows_fetched,
+                    int max_rows, bool &truncated, const QElapsedTimer *slice = nullptr);
+    static void unbindColumns(SQLHSTMT hstmt_local) noexcept;
+    int fetchRows(SQLHSTMT hstmt_local, DataTable *table, int limit);
+    /*!
+     * \brief fetch values of the current row by SQLGetData
+     * \param buffers per column buffers reused for every row
+     */
+    bool appendRow(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers);
+    /*!
+     * \brief read values of the current row, resuming where the previous call stopped
+     * \return SQL_STILL_EXECUTING if the call must be repeated on the next poll,
+     * SQL_ERROR if the row is dropped (the error is reported)
+     */
+    RETCODE readRow(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers, RowReader &reader);
+    RETCODE readValue(SQLHSTMT hstmt_local, DataTable *table, std::vector<std::vector<char>> &buffers, RowReader &reader);
+    static void initColumnBuffers(std::vector<std::vector<char>> &buffers, int count);
+    static void growColumnBuffer(std::vector<char> &buffer, SQLLEN size);
+    /*!
+     * \brief start polling execution if the driver supports asynchronous statements
+     * \return false if the query must be executed in a separate thread
+     */
+    bool startAsync(const QString &query, const QVector<QVariant> *params);
+    void executeInThread(const QString &query, const QVector<QVariant> *params) noexcept;
+    void asyncProceed();
+    void asyncWait();
+    void asyncResultsetDone();
+    void asyncFinish();
+    void asyncStop();   ///< cancel the asynchronous query and wait until it is finished
+    QVariant boundValue(const BoundColumn &column, SQLULEN row, int sqlType, bool &truncated) const noexcept;
 };
 
 #endif // ODBCCONNECTION_H
@@ -0,0 +1,273 @@
+#include "odbcparams.h"
+#include <QDateTime>
+#include <cstring>
+#include <limits>
+
+// longer values are sent as long data types (nvarchar(max), varbinary(max))
+#define PARAM_MAX_WCHARS 4000
+#define PARAM_MAX_BYTES 8000
+
+bool OdbcParams::isLongRow(const QVector<QVariant> &values)
+{
+    for (const QVariant &v: values)
+    {
+        switch ((QMetaType::Type)v.type())
+        {
+        case QMetaType::QString:
+            if (v.toString().size() > PARAM_MAX_WCHARS)
+                return true;
+            break;
+        case QMetaType::QByteArray:
+            if (v.toByteArray().size() > PARAM_MAX_BYTES)
+                return true;
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+static bool isBigUnsigned(const QVariant &v)
+{
+    QMetaType::Type type = (QMetaType::Type)v.type();
+    return (type == QMetaType::ULongLong || type == QMetaType::ULong) &&
+            v.toULongLong() > quint64(std::numeric_limits<qint64>::max());
+}
+
+OdbcParams &OdbcParams::addRow(const QVector<QVariant> &values)
+{
+    _rows.push_back(values);
+    _column_count = qMax(_column_count, values.size());
+    return *this;
+}
+
+RETCODE OdbcParams::bind(SQLHSTMT hstmt)
+{
+    SQLULEN rows = _rows.size();
+    _status.assign(rows, SQL_PARAM_UNUSED);
+    _processed = 0;
+
+    _bound_rows = rows;
+
+    RETCODE retcode = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAM_BIND_TYPE, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_PARAM_BIND_BY_COLUMN)), 0);
+    if (SQL_SUCCEEDED(retcode))
+        retcode = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, reinterpret_cast<SQLPOINTER>(std::intptr_t(rows)), 0);
+    if (retcode == SQL_SUCCESS_WITH_INFO)
+    {
+        // the driver may cap the size (01S02)
+        SQLULEN size = 0;
+        if (SQL_SUCCEEDED(SQLGetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, &size, 0, nullptr)) && size > 0)
+            _bound_rows = qMin(size, rows);
+    }
+    if (SQL_SUCCEEDED(retcode))
+        retcode = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAM_STATUS_PTR, _status.data(), 0);
+    if (SQL_SUCCEEDED(retcode))
+        retcode = SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMS_PROCESSED_PTR, &_processed, 0);
+
+    _columns.resize(static_cast<size_t>(_column_count));
+    for (int i = 0; i < _column_count && SQL_SUCCEEDED(retcode); ++i)
+    {
+        Column &column = _columns[static_cast<size_t>(i)];
+        fill(column, i);
+        retcode = SQLBindParameter(hstmt, SQLUSMALLINT(i + 1), SQL_PARAM_INPUT,
+                                   column.c_type, column.sql_type, column.size, column.digits,
+                                   column.data.data(), column.width, column.indicators.data());
+    }
+    return retcode;
+}
+
+void OdbcParams::unbind(SQLHSTMT hstmt) noexcept
+{
+    SQLFreeStmt(hstmt, SQL_RESET_PARAMS);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, reinterpret_cast<SQLPOINTER>(std::intptr_t(1)), 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_PARAM_STATUS_PTR, nullptr, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMS_PROCESSED_PTR, nullptr, 0);
+}
+
+bool OdbcParams::succeeded(int row, bool executed) const
+{
+    SQLUSMALLINT status = _status[static_cast<size_t>(row)];
+    if (status == SQL_PARAM_UNUSED && _processed == 0)
+        return executed && _rows.size() == 1;
+    return (status == SQL_PARAM_SUCCESS || status == SQL_PARAM_SUCCESS_WITH_INFO);
+}
+
+void OdbcParams::fill(Column &column, int index)
+{
+    size_t rows = _rows.size();
+    auto value = [this, index](size_t row) -> QVariant {
+        const QVector<QVariant> &values = _rows[row];
+        return (index < values.size() ? values[index] : QVariant());
+    };
+
+    QMetaType::Type type = QMetaType::UnknownType;
+    for (size_t r = 0; r < rows && type == QMetaType::UnknownType; ++r)
+    {
+        QVariant v = value(r);
+        if (v.isValid() && !v.isNull())
+            type = (QMetaType::Type)v.type();
+    }
+    // unsigned values above the signed range must not wrap
+    bool bigUnsigned = false, negative = false;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        QVariant v = value(r);
+        if (isBigUnsigned(v))
+            bigUnsigned = true;
+        else if (v.canConvert<qlonglong>() && !v.isNull() && v.toLongLong() < 0)
+            negative = true;
+    }
+    if (bigUnsigned && negative)
+        type = QMetaType::QString;
+
+    column.digits = 0;
+    column.indicators.assign(rows, SQL_NULL_DATA);
+    switch (type)
+    {
+    case QMetaType::Bool:
+        column.c_type = SQL_C_BIT;
+        column.sql_type = SQL_BIT;
+        column.size = 1;
+        column.width = sizeof(SQLCHAR);
+        break;
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::UChar:
+    case QMetaType::SChar:
+        if (bigUnsigned)
+        {
+            column.c_type = SQL_C_UBIGINT;
+            column.sql_type = SQL_DECIMAL;
+            column.size = 20;
+            column.width = sizeof(SQLUBIGINT);
+            break;
+        }
+        column.c_type = SQL_C_SBIGINT;
+        column.sql_type = SQL_BIGINT;
+        column.size = 19;
+        column.width = sizeof(SQLBIGINT);
+        break;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        column.c_type = SQL_C_DOUBLE;
+        column.sql_type = SQL_DOUBLE;
+        column.size = 15;
+        column.width = sizeof(SQLDOUBLE);
+        break;
+    case QMetaType::QDate:
+        column.c_type = SQL_C_TYPE_DATE;
+        column.sql_type = SQL_TYPE_DATE;
+        column.size = 10;
+        column.width = sizeof(DATE_STRUCT);
+        break;
+    case QMetaType::QDateTime:
+        column.c_type = SQL_C_TYPE_TIMESTAMP;
+        column.sql_type = SQL_TYPE_TIMESTAMP;
+        column.size = 23;
+        column.digits = 3;
+        column.width = sizeof(TIMESTAMP_STRUCT);
+        break;
+    case QMetaType::QByteArray:
+    {
+        int max_size = 1;
+        for (size_t r = 0; r < rows; ++r)
+            max_size = qMax(max_size, value(r).toByteArray().size());
+        column.c_type = SQL_C_BINARY;
+        column.sql_type = (max_size > PARAM_MAX_BYTES ? SQL_LONGVARBINARY : SQL_VARBINARY);
+        column.size = SQLULEN(max_size);
+        column.width = max_size;
+        break;
+    }
+    default:
+    {
+        // strings, times and the rest are passed as text
+        std::vector<QString> texts(rows);
+        int max_length = 1;
+        for (size_t r = 0; r < rows; ++r)
+        {
+            QVariant v = value(r);
+            if (!v.isValid() || v.isNull())
+                continue;
+            texts[r] = ((QMetaType::Type)v.type() == QMetaType::QTime ?
+                            v.toTime().toString("hh:mm:ss.zzz") :
+                            v.toString());
+            max_length = qMax(max_length, texts[r].size());
+        }
+        column.c_type = SQL_C_WCHAR;
+        column.sql_type = (max_length > PARAM_MAX_WCHARS ? SQL_WLONGVARCHAR : SQL_WVARCHAR);
+        column.size = SQLULEN(max_length);
+        column.width = (max_length + 1) * SQLLEN(sizeof(SQLWCHAR));
+        column.data.assign(size_t(column.width) * rows, 0);
+        for (size_t r = 0; r < rows; ++r)
+        {
+            if (texts[r].isNull())
+                continue;
+            size_t bytes = size_t(texts[r].size()) * sizeof(SQLWCHAR);
+            memcpy(column.data.data() + size_t(column.width) * r, texts[r].utf16(), bytes);
+            column.indicators[r] = SQLLEN(bytes);
+        }
+        return;
+    }
+    }
+
+    column.data.assign(size_t(column.width) * rows, 0);
+    for (size_t r = 0; r < rows; ++r)
+    {
+        QVariant v = value(r);
+        if (!v.isValid() || v.isNull())
+            continue;
+        char *ptr = column.data.data() + size_t(column.width) * r;
+        column.indicators[r] = column.width;
+        switch (column.c_type)
+        {
+        case SQL_C_BIT:
+            *reinterpret_cast<SQLCHAR*>(ptr) = (v.toBool() ? 1 : 0);
+            break;
+        case SQL_C_SBIGINT:
+            *reinterpret_cast<SQLBIGINT*>(ptr) = v.toLongLong();
+            break;
+        case SQL_C_UBIGINT:
+            *reinterpret_cast<SQLUBIGINT*>(ptr) = v.toULongLong();
+            break;
+        case SQL_C_DOUBLE:
+            *reinterpret_cast<SQLDOUBLE*>(ptr) = v.toDouble();
+            break;
+        case SQL_C_TYPE_DATE:
+        {
+            QDate d = v.toDate();
+            DATE_STRUCT *date = reinterpret_cast<DATE_STRUCT*>(ptr);
+            date->year = SQLSMALLINT(d.year());
+            date->month = SQLUSMALLINT(d.month());
+            date->day = SQLUSMALLINT(d.day());
+            break;
+        }
+        case SQL_C_TYPE_TIMESTAMP:
+        {
+            QDateTime dt = v.toDateTime();
+            TIMESTAMP_STRUCT *ts = reinterpret_cast<TIMESTAMP_STRUCT*>(ptr);
+            ts->year = SQLSMALLINT(dt.date().year());
+            ts->month = SQLUSMALLINT(dt.date().month());
+            ts->day = SQLUSMALLINT(dt.date().day());
+            ts->hour = SQLUSMALLINT(dt.time().hour());
+            ts->minute = SQLUSMALLINT(dt.time().minute());
+            ts->second = SQLUSMALLINT(dt.time().second());
+            ts->fraction = SQLUINTEGER(dt.time().msec()) * 1000000;
+            break;
+        }
+        case SQL_C_BINARY:
+        {
+            QByteArray bytes = v.toByteArray();
+            memcpy(ptr, bytes.constData(), size_t(bytes.size()));
+            column.indicators[r] = bytes.size();
+            break;
+        }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef ODBCPARAMS_H
+#define ODBCPARAMS_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_WIN32
+#include <qt_windows.h>
+#else
+#include <sqltypes.h>
+#endif
+
+#include <sql.h>
+#include <sqlext.h>
+#include <vector>
+#include <QVariant>
+#include <QVector>
+
+/*!
+ * \brief column-wise bound parameter sets of an ODBC statement
+ *
+ * SQL type of a parameter is taken from its first non-null value in the sets,
+ * the rest of values are converted to it. The object must stay alive and
+ * unchanged while the statement uses the parameters. Every element of a column
+ * takes the size of the longest value, so sets with long values are to be
+ * bound alone (see isLongRow).
+ */
+class OdbcParams
+{
+public:
+    OdbcParams& addRow(const QVector<QVariant> &values);
+    static bool isLongRow(const QVector<QVariant> &values);    ///< has values sent as long data types
+    int rowCount() const { return static_cast<int>(_rows.size()); }
+    bool isEmpty() const { return _rows.empty(); }
+    /*!
+     * \brief bind all parameter sets to the statement (as parameter array if there are many)
+     */
+    RETCODE bind(SQLHSTMT hstmt);
+    /*!
+     * \brief parameter sets the statement sends at once (the driver may cap the array size)
+     */
+    int boundRowCount() const { return static_cast<int>(_bound_rows); }
+    static void unbind(SQLHSTMT hstmt) noexcept;
+    /*!
+     * \brief status of a parameter set after execution
+     * \param executed the statement execution succeeded (for drivers that leave the status array untouched)
+     */
+    bool succeeded(int row, bool executed) const;
+
+private:
+    struct Column
+    {
+        SQLSMALLINT c_type;
+        SQLSMALLINT sql_type;
+        SQLULEN size;
+        SQLSMALLINT digits;
+        SQLLEN width;                   ///< size of a single element
+        std::vector<char> data;
+        std::vector<SQLLEN> indicators;
+    };
+
+    std::vector<QVector<QVariant>> _rows;
+    int _column_count = 0;
+    std::vector<Column> _columns;
+    std::vector<SQLUSMALLINT> _status;
+    SQLULEN _processed = 0;
+    SQLULEN _bound_rows = 0;
+
+    void fill(Column &column, int index);
+};
+
+#endif // ODBCPARAMS_H
@@ -6,6 +6,7 @@
 #include <QSocketNotifier>
 #include <QRegularExpression>
 #include <QThread>
+#include <cstring>
 
 PgConnection::PgConnection() :
     DbConnection(), _readNotifier(nullptr), _writeNotifier(nullptr), _temp_result(nullptr)
@@ -277,6 +278,9 @@ QMetaType::Type PgConnection::sqlTypeToVariant(int sqlType) const noexcept
     case TIMESTAMPTZOID:
         var_type = QMetaType::QDateTime;
         break;
+    case BYTEAOID:
+        var_type = QMetaType::QByteArray;
+        break;
     default:
         var_type = QMetaType::QString;
     }
@@ -737,6 +741,51 @@ void PgConnection::watchSocket(int mode)
     adjustNotifier(QSocketNotifier::Write);
 }
 
+QByteArray PgConnection::decodeBytea(const char *val, int length) noexcept
+{
+    // hex format (default since 9.0): \x followed by 2 hex digits per byte.
+    // Decode straight into the destination buffer using lookup table
+    // (no intermediate escaped QString copy)
+    if (length >= 2 && val[0] == '\\' && val[1] == 'x')
+    {
+        static const struct HexTable
+        {
+            signed char digits[256];
+            HexTable()
+            {
+                memset(digits, -1, sizeof(digits));
+                for (int c = '0'; c <= '9'; ++c)
+                    digits[c] = static_cast<signed char>(c - '0');
+                for (int c = 'a'; c <= 'f'; ++c)
+                    digits[c] = digits[c - 'a' + 'A'] = static_cast<signed char>(c - 'a' + 10);
+            }
+        } table;
+
+        const uchar *src = reinterpret_cast<const uchar*>(val) + 2;
+        int size = (length - 2) / 2;
+        QByteArray res(size, Qt::Uninitialized);
+        char *dst = res.data();
+        for (int i = 0; i < size; ++i)
+        {
+            signed char hi = table.digits[src[i * 2]];
+            signed char lo = table.digits[src[i * 2 + 1]];
+            if ((hi | lo) < 0)
+                return QByteArray(val, length); // malformed - keep as is
+            dst[i] = static_cast<char>((hi << 4) | lo);
+        }
+        return res;
+    }
+
+    // legacy escape format
+    size_t size = 0;
+    unsigned char *bytes = PQunescapeBytea(reinterpret_cast<const unsigned char*>(val), &size);
+    if (!bytes)
+        return QByteArray(val, length);
+    QByteArray res(reinterpret_cast<const char*>(bytes), static_cast<int>(size));
+    PQfreemem(bytes);
+    return res;
+}
+
 int PgConnection::appendRawDataToTable(DataTable &dst, PGresult *src) noexcept
 {
     int dst_columns_count = dst.columnCount();
@@ -810,6 +859,9 @@ int PgConnection::appendRawDataToTable(DataTable &dst, PGresult *src) noexcept
                 case TIMESTAMPOID:
                     (*row)[i] = QDateTime::fromString(val, Qt::ISODateWithMs);
                     break;
+                case BYTEAOID:
+                    (*row)[i] = decodeBytea(val, PQgetlength(src, r, i));
+                    break;
                 // TODO:
                 // TIMESTAMPTZOID, TIMETZOID goes here untill timezone printing out implemented
                 default:
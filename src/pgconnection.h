@@ -52,6 +52,7 @@ private:
     void readyWriteSocket();
     void watchSocket(int mode);
     int appendRawDataToTable(DataTable &dst, PGresult *src) noexcept;
+    static QByteArray decodeBytea(const char *val, int length) noexcept;
     std::string finalConnectionString() const noexcept;
 };
 
@@ -23,13 +23,35 @@
 #include "dbobjectsmodel.h"
 #include "mainwindow.h"
 #include "scripting.h"
+#include "valueviewer.h"
+#include "columnsizer.h"
+#include "selectionmimedata.h"
+#include "tableexporter.h"
+#include "resulthistory.h"
+#include "resultquery.h"
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QProgressDialog>
+#include <QPointer>
+#include <QTimer>
+#include <QLineEdit>
+#include <QToolButton>
+#include <QInputDialog>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+// fetched rows are delivered to grids at most once per interval (ms)
+#define FETCH_REFRESH_INTERVAL 80
+// quick filter is applied after this typing pause (ms)
+#define FILTER_DELAY 150
 
 QueryWidget::QueryWidget(QWidget *parent) : QueryWidget(nullptr, parent)
 {
 }
 
 QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
-    QSplitter(parent), _editor(nullptr), _connection(connection)
+    QSplitter(parent), _editor(nullptr), _connection(connection), _history(nullptr), _extraSplitter(nullptr)
 {
     _messages = nullptr;
     _highlighter = nullptr;
@@ -39,6 +61,31 @@ QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
     _actionCopy->setShortcuts(QKeySequence::Copy);
     _resultMenu->addAction(_actionCopy);
     connect(_actionCopy, &QAction::triggered, this, &QueryWidget::onActionCopyTriggered);
+    QMenu *copyAsMenu = _resultMenu->addMenu(tr("Copy as"));
+    const QList<QPair<QString, SelectionMimeData::Format>> copyFormats = {
+        { tr("TSV"), SelectionMimeData::Tsv },
+        { tr("JSON"), SelectionMimeData::Json },
+        { tr("Markdown"), SelectionMimeData::Markdown }
+    };
+    for (const auto &f: copyFormats)
+    {
+        QAction *action = copyAsMenu->addAction(f.first);
+        action->setData(f.second);
+        connect(action, &QAction::triggered, this, &QueryWidget::onActionCopyTriggered);
+    }
+    _actionExport = new QAction(tr("Export..."), this);
+    _resultMenu->addAction(_actionExport);
+    connect(_actionExport, &QAction::triggered, this, &QueryWidget::onActionExportTriggered);
+    _actionViewValue = new QAction(tr("View value"), this);
+    _resultMenu->addAction(_actionViewValue);
+    connect(_actionViewValue, &QAction::triggered, this, &QueryWidget::onActionViewValueTriggered);
+    QAction *actionLocalQuery = new QAction(tr("Query resultsets..."), this);
+    _resultMenu->addAction(actionLocalQuery);
+    connect(actionLocalQuery, &QAction::triggered, this, &QueryWidget::onActionLocalQueryTriggered);
+    _fetchTimer = new QTimer(this);
+    _fetchTimer->setSingleShot(true);
+    _fetchTimer->setInterval(FETCH_REFRESH_INTERVAL);
+    connect(_fetchTimer, &QTimer::timeout, this, &QueryWidget::flushFetched);
 
     /*_actionCopyHTML = new QAction(tr("Copy html"), this);
     _resultMenu->addAction(_actionCopyHTML);
@@ -60,11 +107,42 @@ QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
         _messages = new QPlainTextEdit(res);
         _messages->setTextInteractionFlags(Qt::TextSelectableByMouse | Qt::TextSelectableByKeyboard);
         res->addTab(_messages, tr("messages"));
+        // previous resultsets are kept compressed until they are asked for
+        _history = new ResultHistory(this);
+        QToolButton *historyButton = new QToolButton(res);
+        historyButton->setText(tr("History"));
+        historyButton->setPopupMode(QToolButton::InstantPopup);
+        historyButton->setEnabled(false);
+        QMenu *historyMenu = new QMenu(historyButton);
+        historyButton->setMenu(historyMenu);
+        res->setCornerWidget(historyButton);
+        connect(_history, &ResultHistory::changed, historyButton, [this, historyButton]() {
+            historyButton->setEnabled(_history->count() > 0);
+        });
+        connect(historyMenu, &QMenu::aboutToShow, this, [this, historyMenu]() {
+            historyMenu->clear();
+            // entries may be dropped before a click, so they are referred to by ids
+            for (int id: _history->entries())
+            {
+                QAction *action = historyMenu->addAction(_history->title(id));
+                connect(action, &QAction::triggered, this, [this, id]() { showHistory(id); });
+            }
+        });
         addWidget(res);
         setSizes(QList<int>() << 1 << 0);
         setOrientation(Qt::Vertical);
 
         connect(_connection.get(), &DbConnection::fetched, this, &QueryWidget::fetched);
+        connect(_connection.get(), &DbConnection::queryStateChanged, this, [this]() {
+            // the rest of rows is shown at once when the query is over,
+            // columns are sized again by samples of all rows
+            if (_connection->queryState() == QueryState::Inactive)
+            {
+                flushFetched();
+                for (QTableView *tv: _resSplitter->findChildren<QTableView*>())
+                    ColumnSizer::resizeColumns(tv);
+            }
+        });
         connect(_connection.get(), &DbConnection::message, this, &QueryWidget::onMessage);
         connect(_connection.get(), &DbConnection::error, this, &QueryWidget::onError);
         _connection->open();
@@ -75,6 +153,11 @@ QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
 
 QueryWidget::~QueryWidget()
 {
+    if (_runningLocalQuery)
+        _runningLocalQuery->cancel();
+    // results are not worth keeping when the tab is closed
+    delete _history;
+    _history = nullptr;
     clearResult();
     if (_editorLayout->count() > 1)
     {
@@ -102,10 +185,8 @@ void QueryWidget::openFile(const QString &fileName, const QString &encoding)
     _encoding = encoding;
     QTextStream read_stream(&f);
     read_stream.setCodec(QTextCodec::codecForName(_encoding.toLatin1().data()));
-    if (f.size() > 1024 * 1024 * 5) // do not highlight > 5mb scripts
-        dehighlight();
-    else
-        highlight();
+    // large scripts are highlighted in background steps
+    highlight();
     setPlainText(read_stream.readAll());
     document()->setModified(false);
     f.close();
@@ -352,11 +433,30 @@ void QueryWidget::onError(const QString &err)
 }
 
 void QueryWidget::fetched(DataTable *table)
+{
+    // notifications only mark the resultset, rows are taken by the timer
+    // so that the fetch is not slowed down by grid updates
+    if (!_fetchedTables.contains(table))
+        _fetchedTables.append(table);
+    if (!_fetchTimer->isActive())
+        _fetchTimer->start();
+}
+
+void QueryWidget::flushFetched()
+{
+    _fetchTimer->stop();
+    QList<DataTable*> tables;
+    tables.swap(_fetchedTables);
+    for (DataTable *table: tables)
+        showFetched(table);
+}
+
+void QueryWidget::showFetched(DataTable *table)
 {
     if (widget(1)->height() == 0)
         setSizes(QList<int>() << 400 << 100);
     QTabWidget *res_tw = qobject_cast<QTabWidget*>(widget(1));
-    if (res_tw->count() == 1)
+    if (res_tw->indexOf(_resSplitter) < 0)
     {
         res_tw->insertTab(0, _resSplitter, tr("resultsets"));
         res_tw->setCurrentIndex(0);
@@ -366,31 +466,115 @@ void QueryWidget::fetched(DataTable *table)
     QString tname = QString::number(std::intptr_t(table));
     QTableView *tv = nullptr;
     TableModel *m = nullptr;
-    if (_resSplitter->count())
-        tv = qobject_cast<QTableView*>(_resSplitter->widget(_resSplitter->count() - 1));
-    if (!tv || tv->objectName() != tname)
+    if (_resSplitter->count() && _resSplitter->widget(_resSplitter->count() - 1)->objectName() == tname)
+        tv = _resSplitter->widget(_resSplitter->count() - 1)->findChild<QTableView*>();
+    if (!tv)
     {
-        tv = new QTableView(_resSplitter);
-        tv->setObjectName(tname);
-        tv->verticalHeader()->setDefaultSectionSize(tv->verticalHeader()->minimumSectionSize());
-        tv->setContextMenuPolicy(Qt::CustomContextMenu);
-        connect(tv, &QTableView::customContextMenuRequested, this, &QueryWidget::onCustomGridContextMenuRequested);
-        tv->setSelectionMode(QAbstractItemView::ContiguousSelection);
-        tv->addAction(_actionCopy);
-
         m = new TableModel(_resSplitter);
         _tables.append(m);
-        tv->setModel(m);
-        _resSplitter->addWidget(tv);
+        tv = addResultView(_resSplitter, tname, m);
         m->take(table);
-        tv->resizeColumnsToContents();
+        ColumnSizer::resizeColumns(tv);
     }
     else
     {
         m = qobject_cast<TableModel*>(tv->model());
         m->take(table);
     }
-    QCoreApplication::processEvents();
+}
+
+QTableView* QueryWidget::addResultView(QSplitter *splitter, const QString &name, TableModel *m)
+{
+    QWidget *w = new QWidget(splitter);
+    w->setObjectName(name);
+    QVBoxLayout *layout = new QVBoxLayout(w);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+
+    // quick filter bar: rows are filtered by the model in background after a short typing pause
+    QHBoxLayout *filterLayout = new QHBoxLayout();
+    QLineEdit *filterEdit = new QLineEdit(w);
+    filterEdit->setPlaceholderText(tr("Filter rows"));
+    filterEdit->setClearButtonEnabled(true);
+    QToolButton *regExpButton = new QToolButton(w);
+    regExpButton->setText(".*");
+    regExpButton->setToolTip(tr("Regular expression"));
+    regExpButton->setCheckable(true);
+    filterLayout->addWidget(filterEdit);
+    filterLayout->addWidget(regExpButton);
+    layout->addLayout(filterLayout);
+    QTimer *filterTimer = new QTimer(w);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(FILTER_DELAY);
+    connect(filterEdit, &QLineEdit::textChanged, filterTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(regExpButton, &QToolButton::toggled, filterTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(filterTimer, &QTimer::timeout, m, [m, filterEdit, regExpButton]() {
+        QPalette p = filterEdit->palette();
+        p.setColor(QPalette::Text, m->setFilter(filterEdit->text(), regExpButton->isChecked()) ?
+                       QApplication::palette().color(QPalette::Text) : Qt::red);
+        filterEdit->setPalette(p);
+    });
+
+    QTableView *tv = new QTableView(w);
+    tv->verticalHeader()->setDefaultSectionSize(tv->verticalHeader()->minimumSectionSize());
+    // uniform rows: header doesn't measure sections, positions are computed from the row number
+    tv->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    tv->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(tv, &QTableView::customContextMenuRequested, this, &QueryWidget::onCustomGridContextMenuRequested);
+    tv->setSelectionMode(QAbstractItemView::ContiguousSelection);
+    tv->addAction(_actionCopy);
+    tv->setModel(m);
+    // sorting is done by the model in background, Shift+click adds a sort key
+    QHeaderView *hh = tv->horizontalHeader();
+    hh->setSectionsClickable(true);
+    hh->setSortIndicator(-1, Qt::AscendingOrder);
+    hh->setSortIndicatorShown(true);
+    connect(hh, &QHeaderView::sortIndicatorChanged, m, [m](int section, Qt::SortOrder order) {
+        if (QApplication::keyboardModifiers() & Qt::ShiftModifier)
+            m->addSortKey(section, order);
+        else
+            m->sort(section, order);
+    });
+    layout->addWidget(tv);
+    splitter->addWidget(w);
+    return tv;
+}
+
+void QueryWidget::showHistory(int id)
+{
+    QString title = _history->title(id);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QList<DataTable*> tables = _history->restore(id);
+    QApplication::restoreOverrideCursor();
+    if (tables.isEmpty())   // dropped meanwhile
+        return;
+    showExtraResults(tables, title);
+}
+
+void QueryWidget::showExtraResults(const QList<DataTable*> &tables, const QString &title)
+{
+    closeExtraResults();
+    QTabWidget *res_tw = qobject_cast<QTabWidget*>(widget(1));
+    _extraSplitter = new QSplitter(res_tw);
+    for (DataTable *table: tables)
+    {
+        TableModel *m = new TableModel(_extraSplitter);
+        QTableView *tv = addResultView(_extraSplitter, QString::number(std::intptr_t(table)), m);
+        m->take(table);
+        delete table;
+        ColumnSizer::resizeColumns(tv);
+    }
+    // just before messages
+    res_tw->setCurrentIndex(res_tw->insertTab(res_tw->count() - 1, _extraSplitter, title));
+    if (widget(1)->height() == 0)
+        setSizes(QList<int>() << 400 << 100);
+}
+
+void QueryWidget::closeExtraResults()
+{
+    // the tab goes away with its widget
+    delete _extraSplitter;
+    _extraSplitter = nullptr;
 }
 
 void QueryWidget::clearResult()
@@ -401,12 +585,21 @@ void QueryWidget::clearResult()
     if (_messages) // it was nullptr once.. can't reproduce
         _messages->clear();
 
+    closeExtraResults();
+    if (_history && !_tables.isEmpty())
+    {
+        QList<const DataTable*> tables;
+        for (const TableModel *m: _tables)
+            tables.append(m->table());
+        _history->push(tables);
+    }
+
     if (count() > 1) // TabWidget exists (false on destruction)
     {
         QTabWidget *res_tw = qobject_cast<QTabWidget*>(widget(1));
-        if (res_tw && res_tw->count() > 1)
+        if (res_tw && res_tw->indexOf(_resSplitter) >= 0)
         {
-            res_tw->removeTab(0);
+            res_tw->removeTab(res_tw->indexOf(_resSplitter));
             for (int i = _resSplitter->count() - 1; i >= 0; --i)
             {
                 delete _resSplitter->widget(i);
@@ -415,6 +608,8 @@ void QueryWidget::clearResult()
     }
     qDeleteAll(_tables);
     _tables.clear();
+    _fetchTimer->stop();
+    _fetchedTables.clear();
 }
 
 void QueryWidget::onCustomGridContextMenuRequested(const QPoint &pos)
@@ -446,44 +641,164 @@ void QueryWidget::onActionCopyTriggered()
     QTableView *tv = qobject_cast<QTableView*>(QApplication::focusWidget());
     if (!tv)
         return;
-    bool isHTML = false; //(sender() == _actionCopyHTML);
-    QString result = (isHTML ? "<table><tr>" : "");
     TableModel *m = qobject_cast<TableModel*>(tv->model());
+    QItemSelection selection = tv->selectionModel()->selection();
+    if (!m || selection.isEmpty())
+        return;
 
-    QModelIndexList indexes = tv->selectionModel()->selectedIndexes();
-    if(indexes.size() < 1)
+    // "Copy as" actions keep the format in data, the default one is CSV
+    QAction *action = qobject_cast<QAction*>(sender());
+    SelectionMimeData::Format format = (action && action->data().isValid()) ?
+                SelectionMimeData::Format(action->data().toInt()) :
+                SelectionMimeData::Csv;
+    QVector<bool> quoted;
+    for (int c = 0; c < m->columnCount(); ++c)
+        quoted.append(!_connection->isUnquotedType(m->table()->getColumn(c).sqlType()));
+    QApplication::clipboard()->setMimeData(new SelectionMimeData(m, selection, quoted, format));
+}
+
+void QueryWidget::onActionExportTriggered()
+{
+    QTableView *tv = qobject_cast<QTableView*>(QApplication::focusWidget());
+    if (!tv)
+        return;
+    TableModel *m = qobject_cast<TableModel*>(tv->model());
+    if (!m)
         return;
-    qSort(indexes);
 
-    QModelIndex prev;
-    foreach(QModelIndex cur, indexes)
-    {
-        //QMetaType::Type t = (QMetaType::Type)m->data(cur).type();
-        QString val = m->data(cur).toString();
-        if (!prev.isValid()) ;
-        else if (cur.row() != prev.row()) result.append(isHTML ? QString("</tr><tr>") : QString(QChar::CarriageReturn));
-        else if (!isHTML) result.append(',');
-
-        if (isHTML)
-            result.append("<td>" + val.toHtmlEscaped() + "</td>");
+    // the order matches TableExporter::Format
+    QStringList filters;
+    filters << tr("CSV (*.csv)") << tr("TSV (*.tsv)") << tr("JSON Lines (*.jsonl)") << tr("SQL INSERT (*.sql)")
+            << tr("Arrow IPC (*.arrow)");
+    QString filter;
+    QString fn = QFileDialog::getSaveFileName(this, tr("Export resultset"), QString(), filters.join(";;"), &filter);
+    if (fn.isEmpty())
+        return;
+    int format = TableExporter::formatOf(QFileInfo(fn).suffix());
+    if (format < 0)
+        format = qMax(0, filters.indexOf(filter));
+
+    // the exporter goes away with the grid (before its model)
+    TableExporter *exporter = new TableExporter(tv->parentWidget());
+    QPointer<QProgressDialog> pd = new QProgressDialog(tr("Exporting to %1").arg(QDir::toNativeSeparators(fn)),
+                                                       tr("Cancel"), 0, 0, this);
+    pd->setAttribute(Qt::WA_DeleteOnClose);
+    pd->setWindowModality(Qt::NonModal);
+    connect(pd.data(), &QProgressDialog::canceled, exporter, &TableExporter::cancel);
+    // the grid may be closed while exporting
+    connect(exporter, &QObject::destroyed, pd.data(), &QProgressDialog::close);
+    connect(exporter, &TableExporter::progress, exporter, [pd, fn](qint64 rows) {
+        if (pd)
+            pd->setLabelText(tr("Exporting to %1: %2 rows").arg(QDir::toNativeSeparators(fn)).arg(rows));
+    });
+    connect(exporter, &TableExporter::finished, exporter, [this, m, exporter, pd, fn](const QString &err) {
+        if (pd)
+            pd->close();
+        if (err.isEmpty())
+            onMessage(tr("%1 rows exported to %2").arg(m->table()->rowCount()).arg(QDir::toNativeSeparators(fn)));
         else
-        {
-            int type = m->table()->getColumn(cur.column()).sqlType();
-            result.append(_connection->isUnquotedType(type) ? val : "\"" + val.replace("\"", "\"\"") + "\"");
-        }
-        prev = cur;
+            onError(err);
+        exporter->deleteLater();
+    });
+    // rows fetched later are exported as well, only the last resultset of a running query grows
+    DbConnection *con = _connection.get();
+    bool fetching = (con && con->queryState() != QueryState::Inactive && !_tables.isEmpty() && _tables.last() == m);
+    if (fetching)
+    {
+        connect(con, &DbConnection::queryStateChanged, exporter, [con, exporter]() {
+            if (con->queryState() == QueryState::Inactive)
+                exporter->finishInput();
+        });
+        connect(con, &QObject::destroyed, exporter, &TableExporter::finishInput);
     }
-    result.append(isHTML ? QString("</tr></table>") : QString(QChar::CarriageReturn));
-    if (isHTML)
+    exporter->start(m->table(), fn, TableExporter::Format(format), QFileInfo(fn).completeBaseName(), !fetching);
+    pd->show();
+}
+
+void QueryWidget::onActionViewValueTriggered()
+{
+    QTableView *tv = qobject_cast<QTableView*>(QApplication::focusWidget());
+    if (!tv || !tv->currentIndex().isValid())
+        return;
+    ValueViewer *viewer = new ValueViewer(tv->model()->data(tv->currentIndex(), TableModel::RawDataRole), this);
+    viewer->setAttribute(Qt::WA_DeleteOnClose);
+    viewer->show();
+}
+
+void QueryWidget::onActionLocalQueryTriggered()
+{
+    if (_tables.isEmpty())
+        return;
+    QStringList names;
+    for (int i = 0; i < _tables.size(); ++i)
+        names.append(QString("r%1").arg(i + 1));
+    bool ok;
+    QString sql = QInputDialog::getMultiLineText(this, tr("Query resultsets"),
+                                                 tr("Resultsets are named %1:").arg(names.join(", ")),
+                                                 _localQuery.isEmpty() ? QString("select * from r1") : _localQuery, &ok);
+    if (!ok || sql.trimmed().isEmpty())
+        return;
+    _localQuery = sql;
+
+    // values are copied here, so the query does not depend on grids (only resultsets it refers to)
+    std::shared_ptr<ResultQuery> query = std::make_shared<ResultQuery>();
+    try
     {
-        QMimeData *data = new QMimeData;
-        data->setHtml(result);
-        QApplication::clipboard()->setMimeData(data);
+        query->prepare(sql);
+        QStringList sources = query->sources();
+        for (int i = 0; i < _tables.size(); ++i)
+        {
+            if (sources.contains(names[i]))
+                query->addSource(names[i], _tables[i]->table());
+        }
     }
-    else
+    catch (const QString &err)
     {
-        QApplication::clipboard()->setText(result);
+        onError(err);
+        return;
     }
+    if (_runningLocalQuery)
+        _runningLocalQuery->cancel();
+    _runningLocalQuery = query;
+    QPointer<QProgressDialog> pd = new QProgressDialog(tr("Querying resultsets"), tr("Cancel"), 0, 0, this);
+    pd->setAttribute(Qt::WA_DeleteOnClose);
+    pd->setWindowModality(Qt::NonModal);
+    pd->setMinimumDuration(500);
+    connect(pd.data(), &QProgressDialog::canceled, pd.data(), [query]() { query->cancel(); });
+
+    // the watcher outlives the tab to delete the result of a query nobody waits for
+    typedef QPair<DataTable*, QString> Result;
+    QPointer<QueryWidget> self(this);
+    QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>();
+    connect(watcher, &QFutureWatcher<Result>::finished, watcher, [self, watcher, query, pd]() {
+        Result res = watcher->result();
+        watcher->deleteLater();
+        if (pd)
+            pd->close();
+        if (!self || self->_runningLocalQuery != query)
+        {
+            delete res.first;
+            return;
+        }
+        self->_runningLocalQuery.reset();
+        if (!res.first)
+        {
+            self->onError(res.second);
+            return;
+        }
+        self->onMessage(tr("%1 rows selected from resultsets").arg(res.first->rowCount()));
+        self->showExtraResults({ res.first }, tr("query over resultsets"));
+    });
+    watcher->setFuture(QtConcurrent::run([query]() {
+        try
+        {
+            return Result(query->execute(), QString());
+        }
+        catch (const QString &err)
+        {
+            return Result(nullptr, err);
+        }
+    }));
 }
 
 void QueryWidget::onCursorPositionChanged()
@@ -14,6 +14,10 @@ class QMenu;
 class FindAndReplacePanel;
 class QVBoxLayout;
 class DataTable;
+class QTimer;
+class QTableView;
+class ResultHistory;
+class ResultQuery;
 
 class QueryWidget : public QSplitter
 {
@@ -28,6 +32,7 @@ public:
     bool saveFile(const QString &fileName, const QString &encoding = QString());
     QString encoding() { return _encoding; }
     DbConnection* dbConnection() { return _connection.get(); }
+    const QList<TableModel*>& resultModels() const { return _tables; }   ///< in the order of resultsets
     void ShowFindPanel(FindAndReplacePanel *panel);
     void highlight(std::shared_ptr<DbConnection> con = nullptr);
     void dehighlight();
@@ -52,10 +57,14 @@ public slots:
     void onMessage(const QString &text);
     void onError(const QString &err);
     void fetched(DataTable *table);
+    void flushFetched();
     void clearResult();
     void onCustomGridContextMenuRequested(const QPoint & pos);
     //void on_customEditorContextMenuRequested(const QPoint & pos);
     void onActionCopyTriggered();
+    void onActionExportTriggered();
+    void onActionViewValueTriggered();
+    void onActionLocalQueryTriggered();
     void onCursorPositionChanged();
 
 private:
@@ -70,6 +79,19 @@ private:
     QList<TableModel*> _tables;
     QMenu *_resultMenu;
     QAction *_actionCopy;
+    QAction *_actionExport;
+    QAction *_actionViewValue;
+    ResultHistory *_history;            ///< resultsets of previous executions
+    QSplitter *_extraSplitter;          ///< grids of a restored history entry or of a local query (if shown)
+    QString _localQuery;                ///< the last query over resultsets
+    std::shared_ptr<ResultQuery> _runningLocalQuery;    ///< cancelled when replaced or the tab is closed
+    QTimer *_fetchTimer;                ///< paces delivery of fetched rows to the grids
+    QList<DataTable*> _fetchedTables;   ///< resultsets having rows not yet shown (in fetch order)
+    void showFetched(DataTable *table);
+    QTableView* addResultView(QSplitter *splitter, const QString &name, TableModel *m);
+    void showHistory(int id);
+    void showExtraResults(const QList<DataTable*> &tables, const QString &title);
+    void closeExtraResults();
     bool eventFilter(QObject *object, QEvent *event);
     QList<QTextEdit::ExtraSelection> matchBracket(const QTextCursor &selectedBracket, int darkerFactor = 100);
     bool isEnveloped(const QTextCursor &c);
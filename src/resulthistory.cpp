@@ -0,0 +1,215 @@
+#include "resulthistory.h"
+#include <QDataStream>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+// entries kept by a tab
+#define HISTORY_MAX_ENTRIES 20
+// compressed size of all histories (bytes)
+#define HISTORY_MEMORY_BUDGET (256 * 1024 * 1024)
+// rows compressed together
+#define HISTORY_CHUNK_ROWS 16384
+// zlib level: faster levels compress column values nearly as well
+#define HISTORY_COMPRESSION_LEVEL 3
+
+QList<ResultHistory*> ResultHistory::_histories;
+int ResultHistory::_lastId = 0;
+
+ResultHistory::ResultHistory(QObject *parent) : QObject(parent)
+{
+    _histories.append(this);
+}
+
+ResultHistory::~ResultHistory()
+{
+    // entries being compressed are owned by their tasks as well
+    _histories.removeOne(this);
+}
+
+void ResultHistory::push(const QList<const DataTable*> &tables)
+{
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->id = ++_lastId;
+    entry->time = QDateTime::currentDateTime();
+    entry->ready = false;
+    qint64 size = 0;
+    for (const DataTable *table: tables)
+    {
+        Resultset rs;
+        for (int c = 0; c < table->columnCount(); ++c)
+            rs.columns.append(table->getColumn(c));
+        QVector<DataRow*> rows = table->rows();
+        rs.rows.reserve(rows.size());
+        for (const DataRow *row: rows)
+            rs.rows.append(*row);
+        rs.rowCount = rows.size();
+        entry->resultsets.append(rs);
+        // values are not measured, that would take as long as compressing them
+        size += qint64(rs.rowCount) * rs.columns.size() * sizeof(QVariant);
+    }
+    entry->size = size;
+    _entries.prepend(entry);
+    while (_entries.size() > HISTORY_MAX_ENTRIES)
+        _entries.removeLast();
+    trim();
+
+    QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+    connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        trim();
+        emit changed();
+    });
+    watcher->setFuture(QtConcurrent::run([entry]() { compress(*entry); }));
+}
+
+void ResultHistory::compress(Entry &entry)
+{
+    qint64 size = 0;
+    for (Resultset &rs: entry.resultsets)
+    {
+        rs.chunks.resize((rs.rowCount + HISTORY_CHUNK_ROWS - 1) / HISTORY_CHUNK_ROWS);
+        QVector<int> chunks;
+        for (int i = 0; i < rs.chunks.size(); ++i)
+            chunks.append(i);
+        QtConcurrent::blockingMap(chunks, [&rs](int chunk) {
+            int from = chunk * HISTORY_CHUNK_ROWS;
+            int to = qMin(from + HISTORY_CHUNK_ROWS, rs.rowCount);
+            QVector<QByteArray> &columns = rs.chunks[chunk];
+            columns.resize(rs.columns.size());
+            for (int c = 0; c < rs.columns.size(); ++c)
+            {
+                QByteArray raw;
+                QDataStream s(&raw, QIODevice::WriteOnly);
+                for (int r = from; r < to; ++r)
+                    s << rs.rows[r].at(c);
+                columns[c] = qCompress(raw, HISTORY_COMPRESSION_LEVEL);
+            }
+        });
+        rs.rows = QVector<DataRow>();
+        for (const QVector<QByteArray> &columns: rs.chunks)
+        {
+            for (const QByteArray &data: columns)
+                size += data.size();
+        }
+    }
+    entry.size = size;
+    entry.ready = true;
+}
+
+int ResultHistory::count() const
+{
+    int res = 0;
+    for (const std::shared_ptr<Entry> &e: _entries)
+    {
+        if (e->ready)
+            ++res;
+    }
+    return res;
+}
+
+QVector<int> ResultHistory::entries() const
+{
+    QVector<int> res;
+    for (const std::shared_ptr<Entry> &e: _entries)
+    {
+        if (e->ready)
+            res.append(e->id);
+    }
+    return res;
+}
+
+std::shared_ptr<ResultHistory::Entry> ResultHistory::find(int id) const
+{
+    for (const std::shared_ptr<Entry> &e: _entries)
+    {
+        if (e->id == id)
+            return e->ready ? e : nullptr;
+    }
+    return nullptr;
+}
+
+QString ResultHistory::title(int id) const
+{
+    std::shared_ptr<Entry> e = find(id);
+    if (!e)
+        return QString();
+    qint64 rows = 0;
+    for (const Resultset &rs: e->resultsets)
+        rows += rs.rowCount;
+    return tr("%1: %2 resultsets, %3 rows").arg(e->time.toString("HH:mm:ss")).arg(e->resultsets.size()).arg(rows);
+}
+
+QList<DataTable*> ResultHistory::restore(int id) const
+{
+    QList<DataTable*> res;
+    std::shared_ptr<Entry> e = find(id);
+    if (!e)
+        return res;
+    for (const Resultset &rs: e->resultsets)
+    {
+        DataTable *table = new DataTable();
+        for (const DataColumn &c: rs.columns)
+            table->addColumn(new DataColumn(c));
+        // chunks are decompressed in parallel and appended in order
+        QVector<QVector<DataRow*>> rows(rs.chunks.size());
+        QVector<int> chunks;
+        for (int i = 0; i < rs.chunks.size(); ++i)
+            chunks.append(i);
+        QtConcurrent::blockingMap(chunks, [&rs, &rows, table](int chunk) {
+            int count = qMin(HISTORY_CHUNK_ROWS, rs.rowCount - chunk * HISTORY_CHUNK_ROWS);
+            QVector<DataRow*> &chunkRows = rows[chunk];
+            for (int r = 0; r < count; ++r)
+                chunkRows.append(new DataRow(table));
+            for (int c = 0; c < rs.columns.size(); ++c)
+            {
+                QByteArray raw = qUncompress(rs.chunks[chunk][c]);
+                QDataStream s(raw);
+                for (int r = 0; r < count; ++r)
+                    s >> (*chunkRows[r])[c];
+            }
+        });
+        for (const QVector<DataRow*> &chunkRows: rows)
+        {
+            for (DataRow *row: chunkRows)
+                table->addRow(row);
+        }
+        res.append(table);
+    }
+    return res;
+}
+
+qint64 ResultHistory::usedMemory()
+{
+    qint64 res = 0;
+    for (const ResultHistory *h: _histories)
+    {
+        for (const std::shared_ptr<Entry> &e: h->_entries)
+            res += e->size;
+    }
+    return res;
+}
+
+void ResultHistory::trim()
+{
+    qint64 used = usedMemory();
+    while (used > HISTORY_MEMORY_BUDGET)
+    {
+        ResultHistory *oldest = nullptr;
+        int oldestIndex = -1;
+        for (ResultHistory *h: _histories)
+        {
+            // the last entry is the oldest one of a history
+            if (!h->_entries.isEmpty() &&
+                    (!oldest || h->_entries.last()->time < oldest->_entries[oldestIndex]->time))
+            {
+                oldest = h;
+                oldestIndex = h->_entries.size() - 1;
+            }
+        }
+        if (!oldest)
+            break;
+        used -= oldest->_entries[oldestIndex]->size;
+        oldest->_entries.removeAt(oldestIndex);
+        emit oldest->changed();
+    }
+}
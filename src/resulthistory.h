@@ -0,0 +1,74 @@
+#ifndef RESULTHISTORY_H
+#define RESULTHISTORY_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QVector>
+#include <QList>
+#include <atomic>
+#include <memory>
+#include "datatable.h"
+
+/*!
+ * \brief past resultsets of a query tab
+ *
+ * Resultsets are compressed in background by zlib (qCompress) as chunks of rows,
+ * every column of a chunk is compressed separately so that similar values are
+ * packed together. They are decompressed only when shown again.
+ * Sizes of all histories share one memory budget (entries awaiting compression
+ * are counted by an estimate of their values): when it is exceeded, the oldest
+ * entries of all tabs are dropped.
+ */
+class ResultHistory : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ResultHistory(QObject *parent = 0);
+    ~ResultHistory();
+
+    /*!
+     * \brief store resultsets of an execution
+     *
+     * Rows are copied (values are shared), so tables may be cleared right away.
+     */
+    void push(const QList<const DataTable*> &tables);
+    int count() const;                  ///< entries ready to be restored
+    QVector<int> entries() const;       ///< ids of entries ready to be restored, the newest first
+    QString title(int id) const;        ///< empty if the entry is dropped
+    /*!
+     * \brief decompress resultsets of an entry (the caller takes ownership)
+     * \return empty list if the entry is dropped
+     */
+    QList<DataTable*> restore(int id) const;
+    static qint64 usedMemory();         ///< size of all histories
+
+signals:
+    void changed();
+
+private:
+    struct Resultset
+    {
+        QVector<DataColumn> columns;
+        QVector<DataRow> rows;              ///< until compressed
+        int rowCount;
+        QVector<QVector<QByteArray>> chunks; ///< compressed values of [chunk][column]
+    };
+    struct Entry
+    {
+        int id;
+        QDateTime time;
+        QVector<Resultset> resultsets;
+        std::atomic<qint64> size;       ///< compressed bytes, estimated raw size until ready
+        std::atomic<bool> ready;
+    };
+
+    QList<std::shared_ptr<Entry>> _entries; ///< the newest first
+    static int _lastId;
+
+    std::shared_ptr<Entry> find(int id) const;  ///< ready entry or nullptr
+    static void compress(Entry &entry);
+    static QList<ResultHistory*> _histories;
+    static void trim();                 ///< drops the oldest entries (compressed or not) beyond the budget
+};
+
+#endif // RESULTHISTORY_H
@@ -0,0 +1,1600 @@
+#include "resultquery.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include <QRegularExpression>
+#include <QDateTime>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <numeric>
+
+// rows evaluated at once by every node of an expression
+#define QUERY_BATCH_ROWS 1024
+
+namespace MiniSql
+{
+
+typedef QVector<QVariant> Vector;
+
+struct Token
+{
+    enum Type { End, Name, QuotedName, Number, String, Symbol };
+    Type type;
+    QString text;
+    int pos;
+};
+
+struct Expr;
+typedef std::shared_ptr<Expr> ExprPtr;
+
+struct Expr
+{
+    enum Kind { Literal, Column, Unary, Binary, Function, Aggregate, IsNull, Like };
+    Kind kind;
+    QString op;             ///< operator or function name (lowercase)
+    QString qualifier;      ///< of a column
+    QString name;           ///< of a column (empty for columns bound to grouped rows)
+    QVariant value;         ///< of a literal
+    QVector<ExprPtr> args;
+    bool negated = false;   ///< is not null, not like
+    bool star = false;      ///< count(*)
+    QString text;           ///< canonical text identifying group by expressions and aggregates
+    int column = -1;        ///< resolved column
+};
+
+struct SelectItem
+{
+    ExprPtr expr;
+    QString alias;
+    bool star;
+    QString qualifier;      ///< of a star
+};
+
+struct OrderItem
+{
+    ExprPtr expr;
+    bool descending;
+};
+
+struct Join
+{
+    QString source;
+    QString alias;
+    bool left;
+    ExprPtr on;
+};
+
+struct Statement
+{
+    QVector<SelectItem> select;
+    QString source;
+    QString alias;
+    QVector<Join> joins;
+    ExprPtr where;
+    QVector<ExprPtr> groupBy;
+    ExprPtr having;
+    QVector<OrderItem> orderBy;
+    qint64 limit = -1;
+};
+
+struct Relation
+{
+    QStringList names;
+    QStringList qualifiers;     ///< lowercase names or aliases of sources
+    QVector<QMetaType::Type> types;
+    QVector<int> sqlTypes;
+    QVector<Vector> columns;
+    int rows = 0;
+    const std::atomic<bool> *cancelled = nullptr;   ///< checked between batches
+
+    int find(const QString &qualifier, const QString &name) const
+    {
+        int res = -1;
+        for (int i = 0; i < names.size(); ++i)
+        {
+            if (names[i].compare(name, Qt::CaseInsensitive) != 0 ||
+                    (!qualifier.isEmpty() && qualifiers[i] != qualifier.toLower()))
+                continue;
+            if (res >= 0)
+                throw ResultQuery::tr("column reference %1 is ambiguous").arg(name);
+            res = i;
+        }
+        return res;
+    }
+
+    void addColumn(const QString &name, const QString &qualifier, QMetaType::Type type, int sqlType, const Vector &values)
+    {
+        names.append(name);
+        qualifiers.append(qualifier);
+        types.append(type);
+        sqlTypes.append(sqlType);
+        columns.append(values);
+    }
+};
+
+}
+
+using namespace MiniSql;
+
+static const QStringList reservedWords = {
+    "select", "from", "join", "inner", "left", "outer", "on", "where", "group", "by", "having", "order",
+    "asc", "desc", "limit", "as", "and", "or", "not", "is", "null", "like", "ilike", "true", "false"
+};
+static const QStringList aggregateFunctions = { "count", "sum", "avg", "min", "max" };
+
+static QVector<Token> tokenize(const QString &sql)
+{
+    static const QStringList symbols = {
+        "<>", "!=", "<=", ">=", "||", "(", ")", ",", ".", "*", "+", "-", "/", "%", "=", "<", ">"
+    };
+    QVector<Token> res;
+    int i = 0;
+    int n = sql.size();
+    while (i < n)
+    {
+        QChar c = sql[i];
+        if (c.isSpace())
+        {
+            ++i;
+            continue;
+        }
+        if (c == '-' && i + 1 < n && sql[i + 1] == '-')
+        {
+            while (i < n && sql[i] != '\n')
+                ++i;
+            continue;
+        }
+        int start = i;
+        if (c.isLetter() || c == '_')
+        {
+            while (i < n && (sql[i].isLetterOrNumber() || sql[i] == '_' || sql[i] == '$'))
+                ++i;
+            res.append({ Token::Name, sql.mid(start, i - start), start });
+        }
+        else if (c.isDigit() || (c == '.' && i + 1 < n && sql[i + 1].isDigit()))
+        {
+            while (i < n && (sql[i].isDigit() || sql[i] == '.'))
+                ++i;
+            if (i < n && (sql[i] == 'e' || sql[i] == 'E'))
+            {
+                ++i;
+                if (i < n && (sql[i] == '+' || sql[i] == '-'))
+                    ++i;
+                while (i < n && sql[i].isDigit())
+                    ++i;
+            }
+            res.append({ Token::Number, sql.mid(start, i - start), start });
+        }
+        else if (c == '\'' || c == '"')
+        {
+            // quotes are doubled within literals and names
+            QString text;
+            ++i;
+            forever
+            {
+                if (i >= n)
+                    throw ResultQuery::tr("unterminated quote at %1").arg(start + 1);
+                if (sql[i] == c)
+                {
+                    if (i + 1 < n && sql[i + 1] == c)
+                    {
+                        text += c;
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                text += sql[i++];
+            }
+            res.append({ c == '\'' ? Token::String : Token::QuotedName, text, start });
+        }
+        else
+        {
+            QString symbol;
+            for (const QString &s: symbols)
+            {
+                if (sql.midRef(i, s.size()) == s)
+                {
+                    symbol = s;
+                    break;
+                }
+            }
+            if (symbol.isEmpty())
+                throw ResultQuery::tr("unexpected character %1 at %2").arg(c).arg(i + 1);
+            i += symbol.size();
+            res.append({ Token::Symbol, symbol, start });
+        }
+    }
+    res.append({ Token::End, QString(), n });
+    return res;
+}
+
+static ExprPtr makeExpr(Expr::Kind kind, const QString &op, const QVector<ExprPtr> &args)
+{
+    ExprPtr e = std::make_shared<Expr>();
+    e->kind = kind;
+    e->op = op;
+    e->args = args;
+    QStringList texts;
+    for (const ExprPtr &a: args)
+        texts.append(a->text);
+    switch (kind)
+    {
+    case Expr::Unary:
+        e->text = QString("(%1 %2)").arg(op, texts.value(0));
+        break;
+    case Expr::Binary:
+    case Expr::Like:
+        e->text = QString("(%1 %2 %3)").arg(texts.value(0), op, texts.value(1));
+        break;
+    case Expr::IsNull:
+        e->text = QString("(%1 %2)").arg(texts.value(0), op);
+        break;
+    default:
+        e->text = QString("%1(%2)").arg(op, texts.join(", "));
+    }
+    return e;
+}
+
+namespace {
+
+class Parser
+{
+public:
+    explicit Parser(const QString &sql) : _tokens(tokenize(sql)), _pos(0) {}
+
+    Statement parse()
+    {
+        Statement st;
+        expectKeyword("select");
+        do
+        {
+            SelectItem item;
+            item.star = false;
+            if (acceptSymbol("*"))
+                item.star = true;
+            else if (isName(peek()) && isSymbol(".", 1) && isSymbol("*", 2))
+            {
+                item.star = true;
+                item.qualifier = identifier().toLower();
+                _pos += 2;
+            }
+            else
+            {
+                item.expr = expression();
+                item.alias = alias();
+            }
+            st.select.append(item);
+        }
+        while (acceptSymbol(","));
+
+        expectKeyword("from");
+        st.source = identifier();
+        st.alias = alias();
+        forever
+        {
+            Join join;
+            join.left = false;
+            if (acceptKeyword("left"))
+            {
+                join.left = true;
+                acceptKeyword("outer");
+            }
+            else if (!acceptKeyword("inner") && !isKeyword("join"))
+                break;
+            expectKeyword("join");
+            join.source = identifier();
+            join.alias = alias();
+            expectKeyword("on");
+            join.on = expression();
+            st.joins.append(join);
+        }
+        if (acceptKeyword("where"))
+            st.where = expression();
+        if (acceptKeyword("group"))
+        {
+            expectKeyword("by");
+            do
+                st.groupBy.append(expression());
+            while (acceptSymbol(","));
+        }
+        if (acceptKeyword("having"))
+            st.having = expression();
+        if (acceptKeyword("order"))
+        {
+            expectKeyword("by");
+            do
+            {
+                OrderItem item;
+                item.expr = expression();
+                item.descending = acceptKeyword("desc");
+                if (!item.descending)
+                    acceptKeyword("asc");
+                st.orderBy.append(item);
+            }
+            while (acceptSymbol(","));
+        }
+        if (acceptKeyword("limit"))
+        {
+            bool ok = false;
+            if (peek().type == Token::Number)
+                st.limit = peek().text.toLongLong(&ok);
+            if (!ok || st.limit < 0)
+                throw error(ResultQuery::tr("row count"));
+            ++_pos;
+        }
+        if (peek().type != Token::End)
+            throw error(ResultQuery::tr("end of query"));
+        return st;
+    }
+
+private:
+    QVector<Token> _tokens;
+    int _pos;
+
+    const Token& peek(int ahead = 0) const
+    {
+        return _tokens[qMin(_pos + ahead, _tokens.size() - 1)];
+    }
+    bool isKeyword(const QString &word, int ahead = 0) const
+    {
+        const Token &t = peek(ahead);
+        return t.type == Token::Name && t.text.compare(word, Qt::CaseInsensitive) == 0;
+    }
+    bool acceptKeyword(const QString &word)
+    {
+        if (!isKeyword(word))
+            return false;
+        ++_pos;
+        return true;
+    }
+    void expectKeyword(const QString &word)
+    {
+        if (!acceptKeyword(word))
+            throw error(word);
+    }
+    bool isSymbol(const QString &symbol, int ahead = 0) const
+    {
+        const Token &t = peek(ahead);
+        return t.type == Token::Symbol && t.text == symbol;
+    }
+    bool acceptSymbol(const QString &symbol)
+    {
+        if (!isSymbol(symbol))
+            return false;
+        ++_pos;
+        return true;
+    }
+    void expectSymbol(const QString &symbol)
+    {
+        if (!acceptSymbol(symbol))
+            throw error(symbol);
+    }
+    static bool isName(const Token &t)
+    {
+        return t.type == Token::QuotedName || (t.type == Token::Name && !reservedWords.contains(t.text.toLower()));
+    }
+    QString error(const QString &expected) const
+    {
+        if (peek().type == Token::End)
+            return ResultQuery::tr("%1 expected at the end of query").arg(expected);
+        return ResultQuery::tr("%1 expected at %2 instead of %3").arg(expected).arg(peek().pos + 1).arg(peek().text);
+    }
+    QString identifier()
+    {
+        if (!isName(peek()))
+            throw error(ResultQuery::tr("name"));
+        return _tokens[_pos++].text;
+    }
+    QString alias()
+    {
+        if (acceptKeyword("as"))
+            return identifier();
+        return isName(peek()) ? identifier() : QString();
+    }
+
+    ExprPtr expression()
+    {
+        ExprPtr e = conjunction();
+        while (acceptKeyword("or"))
+            e = makeExpr(Expr::Binary, "or", { e, conjunction() });
+        return e;
+    }
+    ExprPtr conjunction()
+    {
+        ExprPtr e = negation();
+        while (acceptKeyword("and"))
+            e = makeExpr(Expr::Binary, "and", { e, negation() });
+        return e;
+    }
+    ExprPtr negation()
+    {
+        if (acceptKeyword("not"))
+            return makeExpr(Expr::Unary, "not", { negation() });
+        return comparison();
+    }
+    ExprPtr comparison()
+    {
+        static const QStringList operators = { "=", "<>", "!=", "<", "<=", ">", ">=" };
+        ExprPtr e = additive();
+        if (peek().type == Token::Symbol && operators.contains(peek().text))
+        {
+            QString op = _tokens[_pos++].text;
+            return makeExpr(Expr::Binary, op == "!=" ? "<>" : op, { e, additive() });
+        }
+        if (acceptKeyword("is"))
+        {
+            bool negated = acceptKeyword("not");
+            expectKeyword("null");
+            ExprPtr res = makeExpr(Expr::IsNull, negated ? "is not null" : "is null", { e });
+            res->negated = negated;
+            return res;
+        }
+        bool negated = isKeyword("not") && (isKeyword("like", 1) || isKeyword("ilike", 1));
+        if (negated)
+            ++_pos;
+        if (isKeyword("like") || isKeyword("ilike"))
+        {
+            QString op = _tokens[_pos++].text.toLower();
+            ExprPtr res = makeExpr(Expr::Like, negated ? "not " + op : op, { e, additive() });
+            res->negated = negated;
+            return res;
+        }
+        return e;
+    }
+    ExprPtr additive()
+    {
+        ExprPtr e = multiplicative();
+        while (isSymbol("+") || isSymbol("-") || isSymbol("||"))
+        {
+            QString op = _tokens[_pos++].text;
+            e = makeExpr(Expr::Binary, op, { e, multiplicative() });
+        }
+        return e;
+    }
+    ExprPtr multiplicative()
+    {
+        ExprPtr e = unary();
+        while (isSymbol("*") || isSymbol("/") || isSymbol("%"))
+        {
+            QString op = _tokens[_pos++].text;
+            e = makeExpr(Expr::Binary, op, { e, unary() });
+        }
+        return e;
+    }
+    ExprPtr unary()
+    {
+        if (acceptSymbol("-"))
+            return makeExpr(Expr::Unary, "-", { unary() });
+        acceptSymbol("+");
+        return primary();
+    }
+    ExprPtr primary()
+    {
+        const Token &t = peek();
+        if (t.type == Token::Number || t.type == Token::String || isKeyword("null") ||
+                isKeyword("true") || isKeyword("false"))
+        {
+            ExprPtr e = std::make_shared<Expr>();
+            e->kind = Expr::Literal;
+            if (t.type == Token::Number)
+            {
+                bool ok = false;
+                qlonglong i = t.text.toLongLong(&ok);
+                e->value = ok ? QVariant(i) : QVariant(t.text.toDouble());
+                e->text = t.text;
+            }
+            else if (t.type == Token::String)
+            {
+                e->value = t.text;
+                e->text = "'" + t.text + "'";
+            }
+            else
+            {
+                if (!isKeyword("null"))
+                    e->value = isKeyword("true");
+                e->text = t.text.toLower();
+            }
+            ++_pos;
+            return e;
+        }
+        if (acceptSymbol("("))
+        {
+            ExprPtr e = expression();
+            expectSymbol(")");
+            return e;
+        }
+        if (!isName(t))
+            throw error(ResultQuery::tr("expression"));
+
+        QString name = identifier();
+        if (t.type == Token::Name && acceptSymbol("("))
+        {
+            QString function = name.toLower();
+            bool aggregate = aggregateFunctions.contains(function);
+            if (aggregate && function == "count" && acceptSymbol("*"))
+            {
+                expectSymbol(")");
+                ExprPtr e = makeExpr(Expr::Aggregate, function, {});
+                e->star = true;
+                e->text = "count(*)";
+                return e;
+            }
+            QVector<ExprPtr> args;
+            if (!acceptSymbol(")"))
+            {
+                do
+                    args.append(expression());
+                while (acceptSymbol(","));
+                expectSymbol(")");
+            }
+            if (aggregate && args.size() != 1)
+                throw ResultQuery::tr("%1 takes one argument").arg(function);
+            return makeExpr(aggregate ? Expr::Aggregate : Expr::Function, function, args);
+        }
+        ExprPtr e = std::make_shared<Expr>();
+        e->kind = Expr::Column;
+        e->name = name;
+        if (acceptSymbol("."))
+        {
+            e->qualifier = name;
+            e->name = identifier();
+        }
+        e->text = (e->qualifier.isEmpty() ? QString() : e->qualifier.toLower() + ".") + e->name.toLower();
+        return e;
+    }
+};
+
+struct Accumulator
+{
+    qint64 count = 0;
+    bool integer = true;    ///< all summed values are integers
+    qlonglong intSum = 0;
+    double sum = 0;
+    QVariant min;
+    QVariant max;
+};
+
+}
+
+static bool isInteger(QMetaType::Type type)
+{
+    switch (type)
+    {
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isNumber(QMetaType::Type type)
+{
+    return isInteger(type) || type == QMetaType::Float || type == QMetaType::Double;
+}
+
+static inline QMetaType::Type typeOf(const QVariant &value)
+{
+    return (QMetaType::Type)value.type();
+}
+
+/// text of a decimal number, like NUMERIC values stored by drivers as strings
+static bool isDecimalText(const QString &text)
+{
+    int i = 0, n = text.size(), digits = 0;
+    if (i < n && (text[i] == '-' || text[i] == '+'))
+        ++i;
+    for (; i < n && text[i].isDigit(); ++i)
+        ++digits;
+    if (i < n && text[i] == '.')
+    {
+        for (++i; i < n && text[i].isDigit(); ++i)
+            ++digits;
+    }
+    return digits && i == n;
+}
+
+/// a number or the text of a decimal number
+static bool toNumber(const QVariant &value, QMetaType::Type type, double &number)
+{
+    if (isNumber(type))
+    {
+        number = value.toDouble();
+        return true;
+    }
+    if (type != QMetaType::QString || !isDecimalText(*static_cast<const QString*>(value.constData())))
+        return false;
+    number = static_cast<const QString*>(value.constData())->toDouble();
+    return true;
+}
+
+/*!
+ * \brief compares non-null values: numbers (and decimal text) by value before other values,
+ * NaN after numbers, strings as they are, other values by their text
+ */
+static int compareValues(const QVariant &a, const QVariant &b)
+{
+    QMetaType::Type ta = typeOf(a);
+    QMetaType::Type tb = typeOf(b);
+    if (isInteger(ta) && isInteger(tb))
+    {
+        qlonglong x = a.toLongLong();
+        qlonglong y = b.toLongLong();
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    double x, y;
+    bool numberA = toNumber(a, ta, x);
+    bool numberB = toNumber(b, tb, y);
+    if (numberA != numberB)
+        return numberA ? -1 : 1;
+    if (numberA)
+    {
+        // the ordering stays strict weak for std::stable_sort
+        bool nanA = std::isnan(x), nanB = std::isnan(y);
+        if (nanA || nanB)
+            return int(nanA) - int(nanB);
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    if (ta == QMetaType::QString && tb == QMetaType::QString)
+        return QString::compare(*static_cast<const QString*>(a.constData()), *static_cast<const QString*>(b.constData()));
+    if (ta == tb)
+    {
+        switch (ta)
+        {
+        case QMetaType::QDateTime:
+            return a.toDateTime() < b.toDateTime() ? -1 : (b.toDateTime() < a.toDateTime() ? 1 : 0);
+        case QMetaType::QDate:
+            return a.toDate() < b.toDate() ? -1 : (b.toDate() < a.toDate() ? 1 : 0);
+        case QMetaType::QTime:
+            return a.toTime() < b.toTime() ? -1 : (b.toTime() < a.toTime() ? 1 : 0);
+        case QMetaType::Bool:
+            return int(a.toBool()) - int(b.toBool());
+        default:
+            break;
+        }
+    }
+    return QString::compare(TableModel::toText(a), TableModel::toText(b));
+}
+
+/// text identifying equal values within hash tables (numbers of different types are equal)
+static QString keyText(const QVariant &value)
+{
+    if (value.isNull())
+        return QString(QChar(1));
+    QMetaType::Type type = typeOf(value);
+    if (isInteger(type))
+        return QString::number(value.toLongLong());
+    if (isNumber(type))
+    {
+        double d = value.toDouble();
+        if (d == std::floor(d) && std::fabs(d) < 9e18)
+            return QString::number(qlonglong(d));
+        return QString::number(d, 'g', 17);
+    }
+    if (type == QMetaType::QString)
+        return *static_cast<const QString*>(value.constData());
+    return TableModel::toText(value);
+}
+
+static bool truth(const QVariant &value)
+{
+    return !value.isNull() && value.toBool();
+}
+
+static QVariant arithmetic(const QString &op, const QVariant &a, const QVariant &b)
+{
+    if (a.isNull() || b.isNull())
+        return QVariant();
+    if (op == "||")
+        return TableModel::toText(a) + TableModel::toText(b);
+    if (isInteger(typeOf(a)) && isInteger(typeOf(b)))
+    {
+        qlonglong x = a.toLongLong();
+        qlonglong y = b.toLongLong();
+        if ((op == "/" || op == "%") && y == 0)
+            throw ResultQuery::tr("division by zero");
+        switch (op[0].toLatin1())
+        {
+        case '+': return x + y;
+        case '-': return x - y;
+        case '*': return x * y;
+        case '/': return x / y;
+        case '%': return x % y;
+        }
+    }
+    bool okA, okB;
+    double x = a.toDouble(&okA);
+    double y = b.toDouble(&okB);
+    if (!okA || !okB)
+    {
+        throw ResultQuery::tr("operator %1 cannot be applied to %2 and %3")
+                .arg(op, TableModel::toText(a, 50), TableModel::toText(b, 50));
+    }
+    if ((op == "/" || op == "%") && y == 0)
+        throw ResultQuery::tr("division by zero");
+    switch (op[0].toLatin1())
+    {
+    case '+': return x + y;
+    case '-': return x - y;
+    case '*': return x * y;
+    case '/': return x / y;
+    case '%': return std::fmod(x, y);
+    }
+    return QVariant();
+}
+
+static QRegularExpression likeExpression(const QString &pattern, bool caseInsensitive)
+{
+    QString re;
+    for (const QChar &c: pattern)
+    {
+        if (c == '%')
+            re += ".*";
+        else if (c == '_')
+            re += ".";
+        else
+            re += QRegularExpression::escape(c);
+    }
+    return QRegularExpression("^" + re + "$", QRegularExpression::DotMatchesEverythingOption |
+                              (caseInsensitive ? QRegularExpression::CaseInsensitiveOption : QRegularExpression::NoPatternOption));
+}
+
+static Vector evaluate(const Expr &e, const Relation &r, int from, int count);
+
+static Vector callFunction(const Expr &e, const Relation &r, int from, int count)
+{
+    QVector<Vector> args;
+    for (const ExprPtr &a: e.args)
+        args.append(evaluate(*a, r, from, count));
+    auto expectArgs = [&e, &args](int min, int max) {
+        if (args.size() < min || args.size() > max)
+            throw ResultQuery::tr("wrong number of arguments of %1").arg(e.op);
+    };
+    Vector res(count);
+    if (e.op == "coalesce")
+    {
+        expectArgs(1, INT_MAX);
+        for (int i = 0; i < count; ++i)
+        {
+            for (const Vector &a: args)
+            {
+                if (!a[i].isNull())
+                {
+                    res[i] = a[i];
+                    break;
+                }
+            }
+        }
+        return res;
+    }
+    if (e.op == "lower" || e.op == "upper" || e.op == "trim" || e.op == "length")
+    {
+        expectArgs(1, 1);
+        for (int i = 0; i < count; ++i)
+        {
+            const QVariant &v = args[0][i];
+            if (v.isNull())
+                continue;
+            QString text = TableModel::toText(v);
+            if (e.op == "lower")
+                res[i] = text.toLower();
+            else if (e.op == "upper")
+                res[i] = text.toUpper();
+            else if (e.op == "trim")
+                res[i] = text.trimmed();
+            else
+                res[i] = qlonglong(text.size());
+        }
+        return res;
+    }
+    if (e.op == "substr")
+    {
+        expectArgs(2, 3);
+        for (int i = 0; i < count; ++i)
+        {
+            if (args[0][i].isNull() || args[1][i].isNull() || (args.size() > 2 && args[2][i].isNull()))
+                continue;
+            // positions start with 1
+            res[i] = TableModel::toText(args[0][i]).mid(args[1][i].toInt() - 1, args.size() > 2 ? args[2][i].toInt() : -1);
+        }
+        return res;
+    }
+    if (e.op == "abs" || e.op == "round")
+    {
+        expectArgs(1, e.op == "round" ? 2 : 1);
+        for (int i = 0; i < count; ++i)
+        {
+            const QVariant &v = args[0][i];
+            if (v.isNull())
+                continue;
+            if (isInteger(typeOf(v)))
+            {
+                res[i] = (e.op == "abs" ? qAbs(v.toLongLong()) : v.toLongLong());
+                continue;
+            }
+            bool ok;
+            double d = v.toDouble(&ok);
+            if (!ok)
+                throw ResultQuery::tr("%1 of non-numeric value %2").arg(e.op, TableModel::toText(v, 50));
+            if (e.op == "abs")
+                res[i] = std::fabs(d);
+            else
+            {
+                double scale = std::pow(10.0, args.size() > 1 ? args[1][i].toInt() : 0);
+                res[i] = std::round(d * scale) / scale;
+            }
+        }
+        return res;
+    }
+    throw ResultQuery::tr("unknown function %1").arg(e.op);
+}
+
+static Vector evaluate(const Expr &e, const Relation &r, int from, int count)
+{
+    Vector res(count);
+    switch (e.kind)
+    {
+    case Expr::Literal:
+        res.fill(e.value);
+        break;
+    case Expr::Column:
+    {
+        const Vector &column = r.columns[e.column];
+        for (int i = 0; i < count; ++i)
+            res[i] = column[from + i];
+        break;
+    }
+    case Expr::Unary:
+    {
+        Vector a = evaluate(*e.args[0], r, from, count);
+        for (int i = 0; i < count; ++i)
+        {
+            if (a[i].isNull())
+                continue;
+            if (e.op == "not")
+                res[i] = !truth(a[i]);
+            else
+                res[i] = arithmetic("-", QVariant(0LL), a[i]);
+        }
+        break;
+    }
+    case Expr::Binary:
+    {
+        Vector a = evaluate(*e.args[0], r, from, count);
+        Vector b = evaluate(*e.args[1], r, from, count);
+        if (e.op == "and" || e.op == "or")
+        {
+            // three-valued logic
+            bool isAnd = (e.op == "and");
+            for (int i = 0; i < count; ++i)
+            {
+                if ((!a[i].isNull() && truth(a[i]) != isAnd) || (!b[i].isNull() && truth(b[i]) != isAnd))
+                    res[i] = !isAnd;
+                else if (!a[i].isNull() && !b[i].isNull())
+                    res[i] = isAnd;
+            }
+        }
+        else if (e.op == "=" || e.op == "<>" || e.op == "<" || e.op == "<=" || e.op == ">" || e.op == ">=")
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (a[i].isNull() || b[i].isNull())
+                    continue;
+                int c = compareValues(a[i], b[i]);
+                if (e.op == "=")
+                    res[i] = (c == 0);
+                else if (e.op == "<>")
+                    res[i] = (c != 0);
+                else if (e.op == "<")
+                    res[i] = (c < 0);
+                else if (e.op == "<=")
+                    res[i] = (c <= 0);
+                else if (e.op == ">")
+                    res[i] = (c > 0);
+                else
+                    res[i] = (c >= 0);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < count; ++i)
+                res[i] = arithmetic(e.op, a[i], b[i]);
+        }
+        break;
+    }
+    case Expr::IsNull:
+    {
+        Vector a = evaluate(*e.args[0], r, from, count);
+        for (int i = 0; i < count; ++i)
+            res[i] = (a[i].isNull() != e.negated);
+        break;
+    }
+    case Expr::Like:
+    {
+        Vector a = evaluate(*e.args[0], r, from, count);
+        Vector p = evaluate(*e.args[1], r, from, count);
+        bool caseInsensitive = e.op.endsWith("ilike");
+        // patterns are mostly literals, so the expression is rarely rebuilt
+        QString pattern;
+        QRegularExpression re = likeExpression(pattern, caseInsensitive);
+        for (int i = 0; i < count; ++i)
+        {
+            if (a[i].isNull() || p[i].isNull())
+                continue;
+            QString text = TableModel::toText(p[i]);
+            if (text != pattern)
+            {
+                pattern = text;
+                re = likeExpression(pattern, caseInsensitive);
+            }
+            res[i] = (re.match(TableModel::toText(a[i])).hasMatch() != e.negated);
+        }
+        break;
+    }
+    case Expr::Function:
+        return callFunction(e, r, from, count);
+    case Expr::Aggregate:
+        throw ResultQuery::tr("aggregate function %1 is not allowed here").arg(e.op);
+    }
+    return res;
+}
+
+static void checkCancelled(const Relation &r)
+{
+    if (r.cancelled && *r.cancelled)
+        throw ResultQuery::tr("query cancelled");
+}
+
+static Vector evaluateAll(const Expr &e, const Relation &r)
+{
+    Vector res;
+    res.reserve(r.rows);
+    for (int from = 0; from < r.rows; from += QUERY_BATCH_ROWS)
+    {
+        checkCancelled(r);
+        res += evaluate(e, r, from, qMin(QUERY_BATCH_ROWS, r.rows - from));
+    }
+    return res;
+}
+
+/// binds column references to columns of a relation
+static void resolve(Expr &e, const Relation &r)
+{
+    if (e.kind == Expr::Column && !e.name.isEmpty())
+    {
+        e.column = r.find(e.qualifier, e.name);
+        if (e.column < 0)
+            throw ResultQuery::tr("column %1 does not exist").arg(e.text);
+    }
+    for (const ExprPtr &a: e.args)
+        resolve(*a, r);
+}
+
+/// all column references are columns of a relation
+static bool refersTo(const Expr &e, const Relation &r)
+{
+    if (e.kind == Expr::Column && !e.name.isEmpty() && r.find(e.qualifier, e.name) < 0)
+        return false;
+    for (const ExprPtr &a: e.args)
+    {
+        if (!refersTo(*a, r))
+            return false;
+    }
+    return true;
+}
+
+/// rows of a relation in the given order (-1 stands for a row of nulls)
+static Relation gather(const Relation &r, const QVector<int> &rows)
+{
+    Relation res = r;
+    res.rows = rows.size();
+    for (int c = 0; c < r.columns.size(); ++c)
+    {
+        const Vector &src = r.columns[c];
+        Vector dst(rows.size());
+        for (int i = 0; i < rows.size(); ++i)
+        {
+            if (rows[i] >= 0)
+                dst[i] = src[rows[i]];
+        }
+        res.columns[c] = dst;
+    }
+    return res;
+}
+
+static Relation filter(const Relation &r, const Expr &condition)
+{
+    QVector<int> rows;
+    for (int from = 0; from < r.rows; from += QUERY_BATCH_ROWS)
+    {
+        checkCancelled(r);
+        int count = qMin(QUERY_BATCH_ROWS, r.rows - from);
+        Vector matches = evaluate(condition, r, from, count);
+        for (int i = 0; i < count; ++i)
+        {
+            if (truth(matches[i]))
+                rows.append(from + i);
+        }
+    }
+    return gather(r, rows);
+}
+
+static QString rowKey(const QVector<Vector> &values, int row, bool &hasNull)
+{
+    QString key;
+    hasNull = false;
+    for (const Vector &v: values)
+    {
+        hasNull = hasNull || v[row].isNull();
+        key += keyText(v[row]);
+        key += QChar(0x1f);
+    }
+    return key;
+}
+
+static QVector<Vector> evaluateBatch(const QVector<ExprPtr> &exprs, const Relation &r, int from, int count)
+{
+    QVector<Vector> res;
+    for (const ExprPtr &e: exprs)
+        res.append(evaluate(*e, r, from, count));
+    return res;
+}
+
+static void splitConjunction(const ExprPtr &e, QVector<ExprPtr> &res)
+{
+    if (e->kind == Expr::Binary && e->op == "and")
+    {
+        splitConjunction(e->args[0], res);
+        splitConjunction(e->args[1], res);
+    }
+    else
+        res.append(e);
+}
+
+/// hash join: the hash table is built on the joined resultset, rows of the left side probe it
+static Relation join(const Relation &left, const Relation &right, const Join &j)
+{
+    QVector<ExprPtr> conditions, leftKeys, rightKeys, rest;
+    splitConjunction(j.on, conditions);
+    for (const ExprPtr &c: conditions)
+    {
+        if (c->kind == Expr::Binary && c->op == "=")
+        {
+            if (refersTo(*c->args[0], left) && refersTo(*c->args[1], right))
+            {
+                leftKeys.append(c->args[0]);
+                rightKeys.append(c->args[1]);
+                continue;
+            }
+            if (refersTo(*c->args[1], left) && refersTo(*c->args[0], right))
+            {
+                leftKeys.append(c->args[1]);
+                rightKeys.append(c->args[0]);
+                continue;
+            }
+        }
+        rest.append(c);
+    }
+    if (leftKeys.isEmpty())
+        throw ResultQuery::tr("join condition must compare columns of both sides: %1").arg(j.on->text);
+    if (j.left && !rest.isEmpty())
+        throw ResultQuery::tr("only equality conditions are supported by left join");
+    for (const ExprPtr &k: leftKeys)
+        resolve(*k, left);
+    for (const ExprPtr &k: rightKeys)
+        resolve(*k, right);
+
+    QHash<QString, QVector<int>> table;
+    for (int from = 0; from < right.rows; from += QUERY_BATCH_ROWS)
+    {
+        checkCancelled(right);
+        int count = qMin(QUERY_BATCH_ROWS, right.rows - from);
+        QVector<Vector> keys = evaluateBatch(rightKeys, right, from, count);
+        for (int i = 0; i < count; ++i)
+        {
+            bool hasNull;
+            QString key = rowKey(keys, i, hasNull);
+            // nulls never match
+            if (!hasNull)
+                table[key].append(from + i);
+        }
+    }
+
+    QVector<int> leftRows, rightRows;
+    for (int from = 0; from < left.rows; from += QUERY_BATCH_ROWS)
+    {
+        checkCancelled(left);
+        int count = qMin(QUERY_BATCH_ROWS, left.rows - from);
+        QVector<Vector> keys = evaluateBatch(leftKeys, left, from, count);
+        for (int i = 0; i < count; ++i)
+        {
+            bool hasNull;
+            QString key = rowKey(keys, i, hasNull);
+            auto it = (hasNull ? table.constEnd() : table.constFind(key));
+            if (it == table.constEnd())
+            {
+                if (j.left)
+                {
+                    leftRows.append(from + i);
+                    rightRows.append(-1);
+                }
+                continue;
+            }
+            for (int r: it.value())
+            {
+                leftRows.append(from + i);
+                rightRows.append(r);
+            }
+        }
+    }
+
+    Relation res = gather(left, leftRows);
+    Relation joined = gather(right, rightRows);
+    res.names += joined.names;
+    res.qualifiers += joined.qualifiers;
+    res.types += joined.types;
+    res.sqlTypes += joined.sqlTypes;
+    res.columns += joined.columns;
+    for (const ExprPtr &c: rest)
+    {
+        resolve(*c, res);
+        res = filter(res, *c);
+    }
+    return res;
+}
+
+static void collectAggregates(const ExprPtr &e, QVector<ExprPtr> &res)
+{
+    if (e->kind == Expr::Aggregate)
+    {
+        for (const ExprPtr &a: res)
+        {
+            if (a->text == e->text)
+                return;
+        }
+        res.append(e);
+        return;
+    }
+    for (const ExprPtr &a: e->args)
+        collectAggregates(a, res);
+}
+
+static void accumulate(Accumulator &acc, const QString &function, const QVariant &value)
+{
+    if (value.isNull())
+        return;
+    ++acc.count;
+    if (function == "sum" || function == "avg")
+    {
+        if (isInteger(typeOf(value)))
+        {
+            acc.intSum += value.toLongLong();
+            acc.sum += value.toDouble();
+            return;
+        }
+        bool ok;
+        acc.sum += value.toDouble(&ok);
+        acc.integer = false;
+        if (!ok)
+            throw ResultQuery::tr("%1 of non-numeric value %2").arg(function, TableModel::toText(value, 50));
+    }
+    else if (function == "min")
+    {
+        if (acc.min.isNull() || compareValues(value, acc.min) < 0)
+            acc.min = value;
+    }
+    else if (function == "max")
+    {
+        if (acc.max.isNull() || compareValues(value, acc.max) > 0)
+            acc.max = value;
+    }
+}
+
+/// one row per group: values of group by expressions followed by results of aggregates
+static Relation group(const Relation &input, const QVector<ExprPtr> &groupBy, const QVector<ExprPtr> &aggregates)
+{
+    for (const ExprPtr &g: groupBy)
+        resolve(*g, input);
+    for (const ExprPtr &a: aggregates)
+        resolve(*a, input);
+
+    Relation res;
+    res.cancelled = input.cancelled;
+    for (const ExprPtr &g: groupBy)
+    {
+        bool column = (g->kind == Expr::Column);
+        res.addColumn(column ? input.names[g->column] : g->text, column ? input.qualifiers[g->column] : QString(),
+                      column ? input.types[g->column] : QMetaType::UnknownType,
+                      column ? input.sqlTypes[g->column] : 0, Vector());
+    }
+    QHash<QString, int> groups;
+    QVector<QVector<Accumulator>> acc(aggregates.size());
+    QVector<ExprPtr> arguments;
+    for (const ExprPtr &a: aggregates)
+    {
+        if (a->star)
+        {
+            // count(*) counts rows whatever values are
+            ExprPtr one = std::make_shared<Expr>();
+            one->kind = Expr::Literal;
+            one->value = true;
+            arguments.append(one);
+        }
+        else
+            arguments.append(a->args[0]);
+    }
+    for (int from = 0; from < input.rows; from += QUERY_BATCH_ROWS)
+    {
+        checkCancelled(input);
+        int count = qMin(QUERY_BATCH_ROWS, input.rows - from);
+        QVector<Vector> keys = evaluateBatch(groupBy, input, from, count);
+        QVector<Vector> values = evaluateBatch(arguments, input, from, count);
+        for (int i = 0; i < count; ++i)
+        {
+            bool hasNull;
+            QString key = rowKey(keys, i, hasNull);
+            auto it = groups.constFind(key);
+            int g;
+            if (it == groups.constEnd())
+            {
+                g = groups.size();
+                groups.insert(key, g);
+                for (int k = 0; k < keys.size(); ++k)
+                    res.columns[k].append(keys[k][i]);
+                for (QVector<Accumulator> &a: acc)
+                    a.append(Accumulator());
+            }
+            else
+                g = it.value();
+            for (int a = 0; a < aggregates.size(); ++a)
+                accumulate(acc[a][g], aggregates[a]->op, values[a][i]);
+        }
+    }
+    res.rows = groups.size();
+    // aggregates without group by make a row even of no rows
+    if (groupBy.isEmpty() && !res.rows)
+    {
+        res.rows = 1;
+        for (QVector<Accumulator> &a: acc)
+            a.append(Accumulator());
+    }
+
+    for (int a = 0; a < aggregates.size(); ++a)
+    {
+        const QString &function = aggregates[a]->op;
+        Vector values(res.rows);
+        for (int g = 0; g < res.rows; ++g)
+        {
+            const Accumulator &x = acc[a][g];
+            if (function == "count")
+                values[g] = x.count;
+            else if (function == "min")
+                values[g] = x.min;
+            else if (function == "max")
+                values[g] = x.max;
+            else if (x.count == 0)
+                continue;
+            else if (function == "sum")
+                values[g] = (x.integer ? QVariant(x.intSum) : QVariant(x.sum));
+            else
+                values[g] = (x.integer ? double(x.intSum) : x.sum) / x.count;
+        }
+        res.addColumn(aggregates[a]->text, QString(), QMetaType::UnknownType, 0, values);
+    }
+    return res;
+}
+
+/// replaces group by expressions and aggregates with columns of grouped rows
+static ExprPtr rewrite(const ExprPtr &e, const Relation &input, const QVector<ExprPtr> &groupBy,
+                       const QVector<ExprPtr> &aggregates)
+{
+    auto bound = [](int column) {
+        ExprPtr res = std::make_shared<Expr>();
+        res->kind = Expr::Column;
+        res->column = column;
+        return res;
+    };
+    int column = (e->kind == Expr::Column && !e->name.isEmpty()) ? input.find(e->qualifier, e->name) : -1;
+    for (int g = 0; g < groupBy.size(); ++g)
+    {
+        if (groupBy[g]->text == e->text || (column >= 0 && groupBy[g]->kind == Expr::Column && groupBy[g]->column == column))
+        {
+            ExprPtr res = bound(g);
+            res->text = e->text;
+            return res;
+        }
+    }
+    if (e->kind == Expr::Aggregate)
+    {
+        for (int a = 0; a < aggregates.size(); ++a)
+        {
+            if (aggregates[a]->text == e->text)
+            {
+                ExprPtr res = bound(groupBy.size() + a);
+                res->text = e->text;
+                return res;
+            }
+        }
+    }
+    if (e->kind == Expr::Column && !e->name.isEmpty())
+        throw ResultQuery::tr("column %1 must appear in the group by clause or be used in an aggregate function").arg(e->text);
+    ExprPtr res = std::make_shared<Expr>(*e);
+    for (ExprPtr &a: res->args)
+        a = rewrite(a, input, groupBy, aggregates);
+    return res;
+}
+
+/// select list, order by and limit
+static DataTable* project(const Statement &st, const Relation &rel)
+{
+    Relation out;
+    out.rows = rel.rows;
+    QStringList aliases;    ///< of output columns
+    for (const SelectItem &item: st.select)
+    {
+        if (item.star)
+        {
+            int columns = out.columns.size();
+            for (int c = 0; c < rel.names.size(); ++c)
+            {
+                if (!item.qualifier.isEmpty() && rel.qualifiers[c] != item.qualifier)
+                    continue;
+                out.addColumn(rel.names[c], rel.qualifiers[c], rel.types[c], rel.sqlTypes[c], rel.columns[c]);
+                aliases.append(QString());
+            }
+            if (columns == out.columns.size())
+                throw ResultQuery::tr("resultset %1 does not exist").arg(item.qualifier);
+            continue;
+        }
+        const Expr &e = *item.expr;
+        resolve(*item.expr, rel);
+        bool column = (e.kind == Expr::Column);
+        out.addColumn(!item.alias.isEmpty() ? item.alias : (column ? rel.names[e.column] : e.text), QString(),
+                      column ? rel.types[e.column] : QMetaType::UnknownType, column ? rel.sqlTypes[e.column] : 0,
+                      evaluateAll(e, rel));
+        aliases.append(item.alias);
+    }
+
+    QVector<Vector> keys;
+    for (const OrderItem &item: st.orderBy)
+    {
+        const Expr &e = *item.expr;
+        int output = -1;
+        if (e.kind == Expr::Literal && isInteger(typeOf(e.value)))
+        {
+            output = e.value.toInt() - 1;
+            if (output < 0 || output >= out.columns.size())
+                throw ResultQuery::tr("order by position %1 is out of range").arg(e.text);
+        }
+        else if (e.kind == Expr::Column && !e.name.isEmpty() && e.qualifier.isEmpty())
+        {
+            for (int c = 0; c < aliases.size() && output < 0; ++c)
+            {
+                if (aliases[c].compare(e.name, Qt::CaseInsensitive) == 0)
+                    output = c;
+            }
+        }
+        if (output >= 0)
+            keys.append(out.columns[output]);
+        else
+        {
+            resolve(*item.expr, rel);
+            keys.append(evaluateAll(e, rel));
+        }
+    }
+    if (!keys.isEmpty())
+    {
+        QVector<int> order(out.rows);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&keys, &st](int a, int b) {
+            for (int k = 0; k < keys.size(); ++k)
+            {
+                const QVariant &x = keys[k][a];
+                const QVariant &y = keys[k][b];
+                bool descending = st.orderBy[k].descending;
+                if (x.isNull() || y.isNull())
+                {
+                    if (x.isNull() == y.isNull())
+                        continue;
+                    // nulls are the last ones in ascending order
+                    return y.isNull() != descending;
+                }
+                int c = compareValues(x, y);
+                if (c)
+                    return descending ? c > 0 : c < 0;
+            }
+            return false;
+        });
+        out = gather(out, order);
+    }
+    if (st.limit >= 0 && st.limit < out.rows)
+    {
+        QVector<int> first(int(st.limit));
+        std::iota(first.begin(), first.end(), 0);
+        out = gather(out, first);
+    }
+
+    DataTable *res = new DataTable();
+    for (int c = 0; c < out.columns.size(); ++c)
+    {
+        // types of computed values are taken from the values
+        QMetaType::Type type = out.types[c];
+        for (int r = 0; r < out.rows && type == QMetaType::UnknownType; ++r)
+        {
+            if (!out.columns[c][r].isNull())
+                type = typeOf(out.columns[c][r]);
+        }
+        if (type == QMetaType::UnknownType)
+            type = QMetaType::QString;
+        res->addColumn(out.names[c], type, out.sqlTypes[c], 0, 0, 1, isNumber(type) ? Qt::AlignRight : Qt::AlignLeft);
+    }
+    for (int r = 0; r < out.rows; ++r)
+    {
+        DataRow &row = res->addRow();
+        for (int c = 0; c < out.columns.size(); ++c)
+            row[c] = out.columns[c][r];
+    }
+    return res;
+}
+
+ResultQuery::ResultQuery(QObject *parent) : QObject(parent), _cancelled(false)
+{
+}
+
+ResultQuery::~ResultQuery()
+{
+}
+
+void ResultQuery::prepare(const QString &sql)
+{
+    _statement.reset(new Statement(Parser(sql).parse()));
+}
+
+void ResultQuery::addSource(const QString &name, const DataTable *table)
+{
+    std::shared_ptr<Relation> r = std::make_shared<Relation>();
+    QVector<DataRow*> rows = table->rows();
+    r->rows = rows.size();
+    for (int c = 0; c < table->columnCount(); ++c)
+    {
+        DataColumn &column = table->getColumn(c);
+        Vector values;
+        values.reserve(rows.size());
+        for (const DataRow *row: rows)
+            values.append(row->at(c));
+        r->addColumn(column.name(), name.toLower(), column.variantType(), column.sqlType(), values);
+    }
+    _sources.insert(name.toLower(), r);
+}
+
+QStringList ResultQuery::sources() const
+{
+    QStringList res;
+    if (!_statement)
+        return res;
+    res.append(_statement->source.toLower());
+    for (const Join &j: _statement->joins)
+    {
+        if (!res.contains(j.source.toLower()))
+            res.append(j.source.toLower());
+    }
+    return res;
+}
+
+void ResultQuery::cancel()
+{
+    _cancelled = true;
+}
+
+DataTable *ResultQuery::execute() const
+{
+    if (!_statement)
+        throw tr("no query to execute");
+    const Statement &st = *_statement;
+    auto source = [this](const QString &name, const QString &alias) {
+        auto it = _sources.constFind(name.toLower());
+        if (it == _sources.constEnd())
+            throw tr("resultset %1 does not exist").arg(name);
+        Relation r = **it;
+        r.cancelled = &_cancelled;
+        for (QString &q: r.qualifiers)
+            q = (alias.isEmpty() ? name : alias).toLower();
+        return r;
+    };
+
+    Relation rel = source(st.source, st.alias);
+    for (const Join &j: st.joins)
+        rel = join(rel, source(j.source, j.alias), j);
+    if (st.where)
+    {
+        resolve(*st.where, rel);
+        rel = filter(rel, *st.where);
+    }
+
+    QVector<ExprPtr> aggregates;
+    for (const SelectItem &item: st.select)
+    {
+        if (!item.star)
+            collectAggregates(item.expr, aggregates);
+    }
+    if (st.having)
+        collectAggregates(st.having, aggregates);
+    for (const OrderItem &item: st.orderBy)
+        collectAggregates(item.expr, aggregates);
+    bool grouped = !st.groupBy.isEmpty() || !aggregates.isEmpty();
+    // expressions over grouped rows
+    auto bind = [&](const ExprPtr &e, const Relation &input) {
+        return grouped ? rewrite(e, input, st.groupBy, aggregates) : e;
+    };
+    if (grouped)
+    {
+        Relation input = rel;
+        rel = group(input, st.groupBy, aggregates);
+        QVector<ExprPtr> exprs;
+        for (const SelectItem &item: st.select)
+        {
+            if (item.star)
+                throw tr("* cannot be selected from grouped rows");
+            exprs.append(bind(item.expr, input));
+        }
+        ExprPtr having = st.having ? bind(st.having, input) : nullptr;
+        if (having)
+            rel = filter(rel, *having);
+        QStringList aliases;
+        for (const SelectItem &item: st.select)
+            aliases.append(item.alias.toLower());
+        QVector<ExprPtr> order;
+        for (const OrderItem &item: st.orderBy)
+        {
+            // aliases and ordinals are not expressions over input rows
+            bool byOutput = (item.expr->kind == Expr::Literal ||
+                             (item.expr->kind == Expr::Column && item.expr->qualifier.isEmpty() &&
+                              (aliases.contains(item.expr->name.toLower()) || input.find(QString(), item.expr->name) < 0)));
+            order.append(byOutput ? item.expr : bind(item.expr, input));
+        }
+        Statement bound = st;
+        for (int i = 0; i < bound.select.size(); ++i)
+            bound.select[i].expr = exprs[i];
+        for (int i = 0; i < bound.orderBy.size(); ++i)
+            bound.orderBy[i].expr = order[i];
+        bound.groupBy.clear();
+        bound.having.reset();
+        bound.where.reset();
+        bound.joins.clear();
+        return project(bound, rel);
+    }
+    else if (st.having)
+        throw tr("having requires group by or aggregates");
+    return project(st, rel);
+}
+
+DataTable *ResultQuery::query(const QString &sql, const QVariantList &resultsets)
+{
+    _lastError.clear();
+    try
+    {
+        _sources.clear();
+        for (int i = 0; i < resultsets.size(); ++i)
+        {
+            DataTable *table = qobject_cast<DataTable*>(resultsets[i].value<QObject*>());
+            if (!table)
+                throw tr("argument %1 is not a resultset").arg(i + 2);
+            addSource(QString("r%1").arg(i + 1), table);
+        }
+        prepare(sql);
+        return execute();
+    }
+    catch (const QString &err)
+    {
+        _lastError = err;
+    }
+    return nullptr;
+}
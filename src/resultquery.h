@@ -0,0 +1,75 @@
+#ifndef RESULTQUERY_H
+#define RESULTQUERY_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QVariantList>
+#include <atomic>
+#include <memory>
+
+class DataTable;
+
+namespace MiniSql
+{
+struct Statement;
+struct Relation;
+}
+
+/*!
+ * \brief a small SQL engine over fetched resultsets
+ *
+ * Supports select lists with expressions and aliases, [left] joins on equality
+ * conditions (hash joins), where, group by with count/sum/avg/min/max, having,
+ * order by and limit:
+ * \code
+ * select r1.name, count(*) n from r1 join r2 on r1.id = r2.parent_id
+ * where r2.amount > 0 group by r1.name order by n desc limit 10
+ * \endcode
+ * Values are copied into columns and expressions are evaluated over batches
+ * of rows, one column at a time. Resultsets are not touched while executing,
+ * so the query may run in background.
+ */
+class ResultQuery : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ResultQuery(QObject *parent = 0);
+    ~ResultQuery();
+
+    /*!
+     * \brief parse a query
+     * \throw QString on syntax errors
+     */
+    void prepare(const QString &sql);
+    QStringList sources() const;    ///< lowercase names of resultsets the prepared query refers to
+    /*!
+     * \brief copy values of a resultset (in the thread the resultset belongs to)
+     * \param name the name the resultset is referred by in queries (case insensitive)
+     */
+    void addSource(const QString &name, const DataTable *table);
+    /*!
+     * \brief execute the prepared query
+     * \throw QString on errors (also if cancelled)
+     * \return resultset (the caller takes ownership)
+     */
+    DataTable* execute() const;
+    void cancel();              ///< the query stops after the current batch of rows (thread safe)
+
+public slots: // to use from QJSEngine
+    /*!
+     * \brief blocking query from scripts
+     * \param resultsets referred as r1, r2 and so on in queries
+     * \return resultset or nullptr on errors
+     */
+    DataTable* query(const QString &sql, const QVariantList &resultsets);
+    QString lastError() const { return _lastError; }
+
+private:
+    QString _lastError;
+    std::atomic<bool> _cancelled;
+    std::unique_ptr<MiniSql::Statement> _statement;
+    QHash<QString, std::shared_ptr<MiniSql::Relation>> _sources;   ///< by lowercase names
+};
+
+#endif // RESULTQUERY_H
@@ -0,0 +1,79 @@
+#include "rowfilter.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include <QtConcurrent>
+#include <QThread>
+#include <vector>
+
+// rows checked by a single task
+#define FILTER_CHUNK_ROWS 20000
+
+RowFilter::RowFilter(const QString &text, bool regExp) :
+    _text(text), _regExp(regExp)
+{
+    if (_regExp)
+        _re = QRegularExpression(text, QRegularExpression::CaseInsensitiveOption |
+                                 QRegularExpression::UseUnicodePropertiesOption);
+    else
+        _matcher = QStringMatcher(text, Qt::CaseInsensitive);
+}
+
+bool RowFilter::refines(const RowFilter &other) const
+{
+    // a longer substring is found only where a shorter one is
+    return !_regExp && !other._regExp && !other.isEmpty() &&
+            _text.contains(other._text, Qt::CaseInsensitive);
+}
+
+bool RowFilter::matches(const DataRow &row, int columnCount) const
+{
+    for (int c = 0; c < columnCount; ++c)
+    {
+        const QVariant &value = row.at(c);
+        if (value.isNull())
+            continue;
+        // strings are searched in place, other values as displayed
+        QString text;
+        const QString *str = &text;
+        if ((QMetaType::Type)value.type() == QMetaType::QString)
+            str = static_cast<const QString*>(value.constData());
+        else
+            text = TableModel::toText(value);
+        if (_regExp ? _re.match(*str).hasMatch() : _matcher.indexIn(*str) >= 0)
+            return true;
+    }
+    return false;
+}
+
+QVector<int> RowFilter::filter(const QVector<DataRow*> &rows,
+                               const QVector<int> &candidates,
+                               int columnCount,
+                               const RowFilter &filter,
+                               std::shared_ptr<std::atomic<bool>> cancelled)
+{
+    struct Chunk
+    {
+        int from, to;
+    };
+    QVector<Chunk> chunks;
+    for (int from = 0; from < candidates.size(); from += FILTER_CHUNK_ROWS)
+        chunks.append({ from, qMin(from + FILTER_CHUNK_ROWS, candidates.size()) });
+
+    std::vector<char> matched(candidates.size(), 0);
+    QtConcurrent::blockingMap(chunks, [&](const Chunk &chunk) {
+        if (*cancelled)
+            return;
+        for (int i = chunk.from; i < chunk.to; ++i)
+            matched[i] = filter.matches(*rows[candidates[i]], columnCount);
+    });
+    if (*cancelled)
+        return QVector<int>();
+
+    QVector<int> res;
+    for (int i = 0; i < candidates.size(); ++i)
+    {
+        if (matched[i])
+            res.append(candidates[i]);
+    }
+    return res;
+}
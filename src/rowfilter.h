@@ -0,0 +1,54 @@
+#ifndef ROWFILTER_H
+#define ROWFILTER_H
+
+#include <QString>
+#include <QStringMatcher>
+#include <QRegularExpression>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class DataRow;
+
+/*!
+ * \brief quick filter of resultset rows by a substring or a regular expression
+ *
+ * A row matches if the text of any of its non-NULL values does.
+ * Substrings are looked for case-insensitively by QStringMatcher.
+ */
+class RowFilter
+{
+public:
+    RowFilter() = default;
+    RowFilter(const QString &text, bool regExp);
+
+    bool isEmpty() const { return _text.isEmpty(); }
+    bool isValid() const { return !_regExp || _re.isValid(); }
+    QString text() const { return _text; }
+    bool isRegExp() const { return _regExp; }
+    /*!
+     * \brief rows matching this filter match another one as well (so only they need to be checked)
+     */
+    bool refines(const RowFilter &other) const;
+    bool matches(const DataRow &row, int columnCount) const;
+
+    /*!
+     * \brief select matching rows in parallel (blocking, to be called from a worker)
+     * \param rows all rows of the resultset, they must not be deleted until it returns
+     * \param candidates numbers of rows to check
+     * \return numbers of matching rows in the same order as candidates (empty if cancelled)
+     */
+    static QVector<int> filter(const QVector<DataRow*> &rows,
+                               const QVector<int> &candidates,
+                               int columnCount,
+                               const RowFilter &filter,
+                               std::shared_ptr<std::atomic<bool>> cancelled);
+
+private:
+    QString _text;
+    bool _regExp = false;
+    QStringMatcher _matcher;
+    QRegularExpression _re;
+};
+
+#endif // ROWFILTER_H
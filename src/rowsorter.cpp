@@ -0,0 +1,307 @@
+#include "rowsorter.h"
+#include "datatable.h"
+#include <QtConcurrent>
+#include <QThread>
+#include <QDateTime>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// rows are not split into chunks smaller than this (threads cost more than they save)
+#define SORT_MIN_CHUNK_ROWS 50000
+// not null values checked to sort text as numbers or timestamps
+#define SORT_KIND_SAMPLE 100
+
+namespace {
+
+struct Range
+{
+    int from, to;
+};
+
+struct Merge
+{
+    int from, middle, to;
+};
+
+template <typename T>
+inline int compareValues(const T &a, const T &b)
+{
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+}
+
+/*!
+ * \brief timestamp as text, like PostgreSQL timestamptz values ("2024-01-31 12:00:00.5+02")
+ */
+static bool parseTimestamp(const QString &text, qint64 &msecs)
+{
+    QString s = text.trimmed();
+    if (s.length() < 10 || s[4] != '-' || s[7] != '-')
+        return false;
+    if (s.length() > 10 && s[10] == ' ')
+        s[10] = 'T';
+    // hour offsets are completed with minutes
+    int len = s.length();
+    if (len > 19 && (s[len - 3] == '+' || s[len - 3] == '-') && s[len - 2].isDigit() && s[len - 1].isDigit())
+        s += ":00";
+    QDateTime dt = QDateTime::fromString(s, Qt::ISODate);
+    if (!dt.isValid())
+        return false;
+    msecs = dt.toMSecsSinceEpoch();
+    return true;
+}
+
+QVector<int> RowSorter::sort(const QVector<DataRow*> &rows,
+                             const QVector<Key> &keys,
+                             const QVector<QMetaType::Type> &types,
+                             std::shared_ptr<std::atomic<bool>> cancelled)
+{
+    int n = rows.size();
+    int chunkCount = qBound(1, n / SORT_MIN_CHUNK_ROWS, qMax(1, QThread::idealThreadCount()));
+    QVector<Range> chunks;
+    for (int i = 0; i < chunkCount; ++i)
+        chunks.append({ int(qint64(n) * i / chunkCount), int(qint64(n) * (i + 1) / chunkCount) });
+
+    // typed key arrays, filled by chunks in parallel
+    std::vector<KeyColumn> keyColumns(keys.size());
+    for (int k = 0; k < keys.size(); ++k)
+    {
+        KeyColumn &kc = keyColumns[k];
+        kc.column = keys[k].column;
+        kc.kind = kindOf(rows, kc.column, types.value(kc.column, QMetaType::QString));
+        kc.order = keys[k].order;
+        kc.nullsFirst = keys[k].nullsFirst;
+        kc.nulls.assign(n, 0);
+        switch (kc.kind)
+        {
+        case Kind::Integer:
+            kc.integers.resize(n);
+            break;
+        case Kind::Unsigned:
+            kc.unsignedIntegers.resize(n);
+            break;
+        case Kind::Real:
+        case Kind::NumericText:
+        case Kind::TimestampText:
+            kc.reals.resize(n);
+            break;
+        case Kind::Text:
+            kc.texts.resize(n);
+            break;
+        case Kind::Bytes:
+            kc.bytes.resize(n);
+            break;
+        }
+    }
+    for (KeyColumn &kc: keyColumns)
+    {
+        QtConcurrent::blockingMap(chunks, [&kc, &rows](const Range &r) {
+            extract(kc, rows, r.from, r.to);
+        });
+        if (*cancelled)
+            return QVector<int>();
+    }
+
+    // stable sort of every chunk, then stable pairwise merges
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    auto less = [&keyColumns](int a, int b) {
+        return compare(keyColumns, a, b) < 0;
+    };
+    QtConcurrent::blockingMap(chunks, [&order, &less](const Range &r) {
+        std::stable_sort(order.begin() + r.from, order.begin() + r.to, less);
+    });
+    while (chunks.size() > 1)
+    {
+        if (*cancelled)
+            return QVector<int>();
+        QVector<Merge> merges;
+        QVector<Range> merged;
+        for (int i = 0; i + 1 < chunks.size(); i += 2)
+        {
+            merges.append({ chunks[i].from, chunks[i].to, chunks[i + 1].to });
+            merged.append({ chunks[i].from, chunks[i + 1].to });
+        }
+        if (chunks.size() % 2)
+            merged.append(chunks.last());
+        QtConcurrent::blockingMap(merges, [&order, &less](const Merge &m) {
+            std::inplace_merge(order.begin() + m.from, order.begin() + m.middle, order.begin() + m.to, less);
+        });
+        chunks.swap(merged);
+    }
+    if (*cancelled)
+        return QVector<int>();
+    return QVector<int>::fromStdVector(order);
+}
+
+RowSorter::Kind RowSorter::kindOf(const QVector<DataRow*> &rows, int column, QMetaType::Type type)
+{
+    // drivers store some types (numeric, timestamptz) as text, so the stored values decide
+    int sampled = 0;
+    bool numbers = true, timestamps = true;
+    for (int r = 0; r < rows.size() && sampled < SORT_KIND_SAMPLE; ++r)
+    {
+        const QVariant &value = rows[r]->at(column);
+        if (value.isNull())
+            continue;
+        if (!sampled++)
+            type = (QMetaType::Type)value.type();
+        if (type != QMetaType::QString)
+            break;
+        const QString &text = *static_cast<const QString*>(value.constData());
+        bool ok = false;
+        if (numbers)
+            text.toDouble(&ok);
+        numbers = numbers && ok;
+        qint64 msecs;
+        timestamps = timestamps && parseTimestamp(text, msecs);
+        if (!numbers && !timestamps)
+            break;
+    }
+    if (type == QMetaType::QString && sampled)
+    {
+        if (numbers)
+            return Kind::NumericText;
+        if (timestamps)
+            return Kind::TimestampText;
+    }
+    switch (type)
+    {
+    case QMetaType::Bool:
+    case QMetaType::Char:
+    case QMetaType::SChar:
+    case QMetaType::Short:
+    case QMetaType::Int:
+    case QMetaType::Long:
+    case QMetaType::LongLong:
+    case QMetaType::QDate:
+    case QMetaType::QTime:
+    case QMetaType::QDateTime:
+        return Kind::Integer;
+    case QMetaType::UChar:
+    case QMetaType::UShort:
+    case QMetaType::UInt:
+    case QMetaType::ULong:
+    case QMetaType::ULongLong:
+        return Kind::Unsigned;
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return Kind::Real;
+    case QMetaType::QByteArray:
+        return Kind::Bytes;
+    default:
+        return Kind::Text;
+    }
+}
+
+void RowSorter::extract(KeyColumn &key, const QVector<DataRow*> &rows, int from, int to)
+{
+    for (int r = from; r < to; ++r)
+    {
+        const QVariant &value = rows[r]->at(key.column);
+        if (value.isNull())
+        {
+            key.nulls[r] = 1;
+            continue;
+        }
+        switch (key.kind)
+        {
+        case Kind::Integer:
+            // temporal values are sorted by their numeric representation
+            switch ((QMetaType::Type)value.type())
+            {
+            case QMetaType::QDateTime:
+                key.integers[r] = value.toDateTime().toMSecsSinceEpoch();
+                break;
+            case QMetaType::QDate:
+                key.integers[r] = value.toDate().toJulianDay();
+                break;
+            case QMetaType::QTime:
+                key.integers[r] = value.toTime().msecsSinceStartOfDay();
+                break;
+            default:
+                key.integers[r] = value.toLongLong();
+                break;
+            }
+            break;
+        case Kind::Unsigned:
+            key.unsignedIntegers[r] = value.toULongLong();
+            break;
+        case Kind::Real:
+            key.reals[r] = value.toDouble();
+            break;
+        case Kind::NumericText:
+        {
+            // values which are not numbers go with NaN
+            bool ok;
+            double d = value.toString().toDouble(&ok);
+            key.reals[r] = ok ? d : std::numeric_limits<double>::quiet_NaN();
+            break;
+        }
+        case Kind::TimestampText:
+        {
+            qint64 msecs;
+            key.reals[r] = parseTimestamp(value.toString(), msecs) ? double(msecs)
+                                                                 : std::numeric_limits<double>::quiet_NaN();
+            break;
+        }
+        case Kind::Text:
+            key.texts[r] = value.toString();
+            break;
+        case Kind::Bytes:
+            key.bytes[r] = value.toByteArray();
+            break;
+        }
+    }
+}
+
+int RowSorter::compare(const std::vector<KeyColumn> &keys, int a, int b)
+{
+    for (const KeyColumn &key: keys)
+    {
+        bool nullA = key.nulls[a], nullB = key.nulls[b];
+        if (nullA || nullB)
+        {
+            if (nullA == nullB)
+                continue;
+            return (nullA == key.nullsFirst) ? -1 : 1;
+        }
+        int res = 0;
+        switch (key.kind)
+        {
+        case Kind::Integer:
+            res = compareValues(key.integers[a], key.integers[b]);
+            break;
+        case Kind::Unsigned:
+            res = compareValues(key.unsignedIntegers[a], key.unsignedIntegers[b]);
+            break;
+        case Kind::Real:
+        case Kind::NumericText:
+        case Kind::TimestampText:
+        {
+            // NaN follows numbers in any order, so that the ordering stays strict weak
+            bool nanA = std::isnan(key.reals[a]), nanB = std::isnan(key.reals[b]);
+            if (nanA || nanB)
+            {
+                if (nanA == nanB)
+                    continue;
+                return nanA ? 1 : -1;
+            }
+            res = compareValues(key.reals[a], key.reals[b]);
+            break;
+        }
+        case Kind::Text:
+            res = key.texts[a].compare(key.texts[b]);
+            break;
+        case Kind::Bytes:
+            res = compareValues(key.bytes[a], key.bytes[b]);
+            break;
+        }
+        if (res)
+            return (key.order == Qt::AscendingOrder) == (res < 0) ? -1 : 1;
+    }
+    return 0;
+}
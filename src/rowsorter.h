@@ -0,0 +1,66 @@
+#ifndef ROWSORTER_H
+#define ROWSORTER_H
+
+#include <QVector>
+#include <QMetaType>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class DataRow;
+
+/*!
+ * \brief multi-key stable sort of resultset rows producing a permutation
+ *
+ * Key values are extracted into typed arrays (integers, reals, texts, bytes) once,
+ * then row chunks are sorted by the thread pool and merged pairwise in parallel.
+ * The kind of a key is taken from stored values: text of numbers (like NUMERIC)
+ * and timestamps (like timestamptz) is sorted by value. NaN follows numbers.
+ */
+class RowSorter
+{
+public:
+    struct Key
+    {
+        int column;
+        Qt::SortOrder order;
+        bool nullsFirst;    ///< NULLs precede values regardless of the order
+    };
+
+    /*!
+     * \brief sort rows (blocking, to be called from a worker)
+     * \param rows rows to sort, they must not be deleted until it returns
+     * \param types variant types of the resultset's columns
+     * \param cancelled checked between phases
+     * \return row numbers in sorted order (empty if cancelled)
+     */
+    static QVector<int> sort(const QVector<DataRow*> &rows,
+                             const QVector<Key> &keys,
+                             const QVector<QMetaType::Type> &types,
+                             std::shared_ptr<std::atomic<bool>> cancelled);
+
+private:
+    enum class Kind { Integer, Unsigned, Real, NumericText, TimestampText, Text, Bytes };
+    struct KeyColumn
+    {
+        int column;
+        Kind kind;
+        Qt::SortOrder order;
+        bool nullsFirst;
+        std::vector<char> nulls;
+        std::vector<qint64> integers;
+        std::vector<quint64> unsignedIntegers;
+        std::vector<double> reals;
+        std::vector<QString> texts;
+        std::vector<QByteArray> bytes;
+    };
+
+    /*!
+     * \param type the declared type, used if there are no values
+     */
+    static Kind kindOf(const QVector<DataRow*> &rows, int column, QMetaType::Type type);
+    static void extract(KeyColumn &key, const QVector<DataRow*> &rows, int from, int to);
+    static int compare(const std::vector<KeyColumn> &keys, int a, int b);
+};
+
+#endif // ROWSORTER_H
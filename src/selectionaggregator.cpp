@@ -0,0 +1,282 @@
+#include "selectionaggregator.h"
+#include "tablemodel.h"
+#include <QTableView>
+#include <QtConcurrent>
+#include <cstring>
+#include <limits>
+
+// distinct values are not counted beyond this number (their hashes are kept in memory)
+#define DISTINCT_MAX_VALUES 1000000
+
+static quint64 numberHash(double value)
+{
+    // numbers of all types are hashed as doubles, so 1 and 1.0 are the same value (as are 0 and -0)
+    if (value == 0)
+        value = 0;
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static quint64 textHash(const QString &text)
+{
+    return (quint64(qHash(text, 0x9e3779b9u)) << 32) | qHash(text, 0x85ebca6bu);
+}
+
+/// adds if the sum stays within qint64 (signed overflow is undefined)
+static bool addInteger(qint64 &sum, qint64 value)
+{
+    if (value > 0 ? sum > std::numeric_limits<qint64>::max() - value : sum < std::numeric_limits<qint64>::min() - value)
+        return false;
+    sum += value;
+    return true;
+}
+
+static void addDistinct(SelectionAggregator::Stats &stats, quint64 hash)
+{
+    if (stats.distinct.size() < DISTINCT_MAX_VALUES)
+        stats.distinct.insert(hash);
+    else if (!stats.distinctOverflow && !stats.distinct.contains(hash))
+        stats.distinctOverflow = true;
+}
+
+void SelectionAggregator::Stats::merge(const Stats &other)
+{
+    cells += other.cells;
+    values += other.values;
+    if (other.numbers)
+    {
+        min = numbers ? qMin(min, other.min) : other.min;
+        max = numbers ? qMax(max, other.max) : other.max;
+        numbers += other.numbers;
+        integers = integers && other.integers && addInteger(intSum, other.intSum);
+        sum += other.sum;
+    }
+    // the smaller set is inserted into the larger one
+    if (distinct.size() < other.distinct.size())
+    {
+        QSet<quint64> larger = other.distinct;
+        distinct.swap(larger.unite(distinct));
+    }
+    else
+        distinct.unite(other.distinct);
+    distinctOverflow = distinctOverflow || other.distinctOverflow || distinct.size() > DISTINCT_MAX_VALUES;
+}
+
+QString SelectionAggregator::Stats::toString() const
+{
+    QStringList res;
+    res << tr("Count: %1").arg(values);
+    res << tr("Distinct: %1%2").arg(distinct.size()).arg(distinctOverflow ? "+" : "");
+    if (numbers)
+    {
+        res << tr("Sum: %1").arg(integers ? QString::number(intSum) : QString::number(sum, 'g', 15));
+        res << tr("Avg: %1").arg(QString::number((integers ? double(intSum) : sum) / numbers, 'g', 15));
+        res << tr("Min: %1").arg(QString::number(min, 'g', 15));
+        res << tr("Max: %1").arg(QString::number(max, 'g', 15));
+    }
+    return res.join("   ");
+}
+
+SelectionAggregator::SelectionAggregator(QObject *parent) :
+    QObject(parent),
+    _cancelled(std::make_shared<std::atomic<bool>>(false)),
+    _generation(0), _jobGeneration(0), _jobRunning(false)
+{
+    connect(&_watcher, &QFutureWatcher<Stats>::finished, this, &SelectionAggregator::onJobFinished);
+}
+
+SelectionAggregator::~SelectionAggregator()
+{
+    *_cancelled = true;
+    _watcher.waitForFinished();
+}
+
+void SelectionAggregator::setView(QTableView *view)
+{
+    if (view && view == _view)
+        return;
+    for (const QMetaObject::Connection &c: _connections)
+        disconnect(c);
+    _connections.clear();
+    _view = nullptr;
+    if (view && qobject_cast<TableModel*>(view->model()) && view->selectionModel())
+    {
+        _view = view;
+        _connections << connect(view->selectionModel(), &QItemSelectionModel::selectionChanged,
+                                this, &SelectionAggregator::onSelectionChanged);
+        // selection is cleared silently when the model is reset (e.g. by a filter)
+        _connections << connect(view->model(), &QAbstractItemModel::modelReset,
+                                this, &SelectionAggregator::restart);
+        _connections << connect(view, &QObject::destroyed, this, [this]() { setView(nullptr); });
+    }
+    restart();
+}
+
+void SelectionAggregator::onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    if (!deselected.isEmpty())
+    {
+        restart();
+        return;
+    }
+    // only newly selected cells are passed here
+    add(selected);
+    startJob();
+    publish();
+}
+
+void SelectionAggregator::onJobFinished()
+{
+    _jobRunning = false;
+    if (_jobGeneration == _generation)
+        _stats.merge(_watcher.result());
+    startJob();
+    publish();
+}
+
+void SelectionAggregator::restart()
+{
+    ++_generation;
+    *_cancelled = true;
+    _cancelled = std::make_shared<std::atomic<bool>>(false);
+    _stats = Stats();
+    _pending.clear();
+    if (_view)
+        add(_view->selectionModel()->selection());
+    startJob();
+    publish();
+}
+
+void SelectionAggregator::add(const QItemSelection &selection)
+{
+    const TableModel *model = qobject_cast<const TableModel*>(_view ? _view->model() : nullptr);
+    if (!model)
+        return;
+    // values are shared with the resultset - taking them is cheap
+    for (const QItemSelectionRange &range: selection)
+    {
+        if (!range.isValid())
+            continue;
+        // columns of numeric sql types are right-aligned; drivers return DECIMAL and NUMERIC as text
+        QVector<bool> numeric;
+        for (int c = range.left(); c <= range.right(); ++c)
+            numeric.append(model->table()->getColumn(c).hAlignment() == Qt::AlignRight);
+        _pending.append({ model->rows(range.top(), range.bottom()), range.left(), range.right(), numeric });
+    }
+}
+
+void SelectionAggregator::startJob()
+{
+    // a job at a time: figures of the next one are merged into the result of the previous
+    if (_jobRunning || _pending.isEmpty())
+        return;
+    QVector<Block> blocks;
+    blocks.swap(_pending);
+    _jobGeneration = _generation;
+    _jobRunning = true;
+    std::shared_ptr<std::atomic<bool>> cancelled = _cancelled;
+    _watcher.setFuture(QtConcurrent::run([blocks, cancelled]() {
+        return aggregate(blocks, cancelled);
+    }));
+}
+
+void SelectionAggregator::publish()
+{
+    bool busy = _jobRunning || !_pending.isEmpty();
+    if (!busy && _stats.cells < 2)
+    {
+        emit changed(QString());
+        return;
+    }
+    QString text = _stats.cells ? _stats.toString() : QString();
+    if (busy)
+        text.append(text.isEmpty() ? "" : "   ").append(tr("calculating..."));
+    emit changed(text);
+}
+
+SelectionAggregator::Stats SelectionAggregator::aggregate(const QVector<Block> &blocks,
+                                                          std::shared_ptr<std::atomic<bool>> cancelled)
+{
+    Stats res;
+    for (const Block &block: blocks)
+    {
+        res.cells += qint64(block.rows.size()) * (block.right - block.left + 1);
+        // column by column: values of a column are of the same type mostly
+        for (int c = block.left; c <= block.right; ++c)
+        {
+            if (*cancelled)
+                return Stats();
+            bool numeric = block.numeric[c - block.left];
+            for (const DataRow &row: block.rows)
+            {
+                const QVariant &value = row.at(c);
+                if (value.isNull())
+                    continue;
+                ++res.values;
+                double number;
+                qint64 integer = 0;
+                bool isInteger = true;
+                switch ((QMetaType::Type)value.type())
+                {
+                case QMetaType::Char:
+                case QMetaType::SChar:
+                case QMetaType::Short:
+                case QMetaType::Int:
+                case QMetaType::Long:
+                case QMetaType::LongLong:
+                    integer = value.toLongLong();
+                    number = double(integer);
+                    break;
+                case QMetaType::UChar:
+                case QMetaType::UShort:
+                case QMetaType::UInt:
+                case QMetaType::ULong:
+                case QMetaType::ULongLong:
+                    integer = qint64(value.toULongLong());
+                    number = double(value.toULongLong());
+                    isInteger = value.toULongLong() <= quint64(std::numeric_limits<qint64>::max());
+                    break;
+                case QMetaType::Float:
+                case QMetaType::Double:
+                    number = value.toDouble();
+                    isInteger = false;
+                    break;
+                case QMetaType::QString:
+                {
+                    bool ok = false;
+                    const QString &text = *static_cast<const QString*>(value.constData());
+                    if (numeric)
+                    {
+                        integer = text.toLongLong(&ok);
+                        if (ok)
+                            number = double(integer);
+                        else
+                        {
+                            number = text.toDouble(&ok);
+                            isInteger = false;
+                        }
+                    }
+                    if (ok)
+                        break;
+                    addDistinct(res, textHash(text));
+                    continue;
+                }
+                default:
+                    addDistinct(res, textHash(TableModel::toText(value)));
+                    continue;
+                }
+                addDistinct(res, numberHash(number));
+                if (!res.numbers++)
+                    res.min = res.max = number;
+                else if (number < res.min)
+                    res.min = number;
+                else if (number > res.max)
+                    res.max = number;
+                res.integers = res.integers && isInteger && addInteger(res.intSum, integer);
+                res.sum += number;
+            }
+        }
+    }
+    return res;
+}
@@ -0,0 +1,82 @@
+#ifndef SELECTIONAGGREGATOR_H
+#define SELECTIONAGGREGATOR_H
+
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QFutureWatcher>
+#include <QItemSelection>
+#include <atomic>
+#include <memory>
+#include "datatable.h"
+
+class QTableView;
+
+/*!
+ * \brief count, distinct, sum, average, min and max of cells selected in a result grid
+ *
+ * Values are aggregated by a worker thread. While a selection only grows just
+ * the added cells are processed and merged into the figures known so far, so
+ * extending a large selection does not start over. Deselecting cells does.
+ */
+class SelectionAggregator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        qint64 cells = 0;       ///< selected cells
+        qint64 values = 0;      ///< non-NULL values
+        qint64 numbers = 0;
+        bool integers = true;   ///< all numbers are integers (intSum is exact)
+        qint64 intSum = 0;
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+        QSet<quint64> distinct; ///< 64-bit hashes of values
+        bool distinctOverflow = false;
+
+        void merge(const Stats &other);
+        QString toString() const;
+    };
+
+    explicit SelectionAggregator(QObject *parent = 0);
+    ~SelectionAggregator();
+
+    /*!
+     * \brief follow selection of a grid showing a TableModel (nullptr stops following)
+     */
+    void setView(QTableView *view);
+
+signals:
+    void changed(const QString &summary);   ///< empty if less than two cells are selected
+
+private:
+    struct Block
+    {
+        QVector<DataRow> rows;
+        int left;
+        int right;
+        QVector<bool> numeric;  ///< columns left to right are of numeric sql types
+    };
+
+    QPointer<QTableView> _view;
+    QList<QMetaObject::Connection> _connections;
+    Stats _stats;
+    QVector<Block> _pending;
+    QFutureWatcher<Stats> _watcher;
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+    int _generation;    ///< incremented when figures start over
+    int _jobGeneration;
+    bool _jobRunning;   ///< its result is not merged yet
+
+    void onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
+    void onJobFinished();
+    void restart();
+    void add(const QItemSelection &selection);
+    void startJob();
+    void publish();
+    static Stats aggregate(const QVector<Block> &blocks, std::shared_ptr<std::atomic<bool>> cancelled);
+};
+
+#endif // SELECTIONAGGREGATOR_H
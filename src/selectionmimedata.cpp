@@ -0,0 +1,187 @@
+#include "selectionmimedata.h"
+#include "tablemodel.h"
+#include <QtConcurrent>
+#include <algorithm>
+
+static const char* const formatMimeTypes[] = {
+    "text/csv",
+    "text/tab-separated-values",
+    "application/json",
+    "text/markdown"
+};
+
+SelectionMimeData::SelectionMimeData(const TableModel *model, const QItemSelection &selection,
+                                     const QVector<bool> &quoted, Format primary) :
+    _quoted(quoted), _primary(primary)
+{
+    QList<QItemSelectionRange> ranges = selection;
+    std::sort(ranges.begin(), ranges.end(), [](const QItemSelectionRange &a, const QItemSelectionRange &b) {
+        return a.top() < b.top() || (a.top() == b.top() && a.left() < b.left());
+    });
+    for (const QItemSelectionRange &range: ranges)
+        _blocks.append({ model->rows(range.top(), range.bottom()), range.left(), range.right() });
+    for (int c = 0; c < model->columnCount(); ++c)
+        _names.append(model->headerData(c, Qt::Horizontal).toString());
+
+    _primaryText = QtConcurrent::run([this]() {
+        return render(_primary);
+    });
+}
+
+SelectionMimeData::~SelectionMimeData()
+{
+    _primaryText.waitForFinished();
+}
+
+QStringList SelectionMimeData::formats() const
+{
+    QStringList res;
+    res << "text/plain";
+    for (const char *mimeType: formatMimeTypes)
+        res << mimeType;
+    return res;
+}
+
+bool SelectionMimeData::hasFormat(const QString &mimeType) const
+{
+    return formatOf(mimeType) >= 0;
+}
+
+QVariant SelectionMimeData::retrieveData(const QString &mimeType, QVariant::Type type) const
+{
+    int format = formatOf(mimeType);
+    if (format < 0)
+        return QMimeData::retrieveData(mimeType, type);
+    QString text;
+    if (mimeType == "text/plain" || format == _primary)
+        text = _primaryText.result();
+    else
+    {
+        auto it = _rendered.find(format);
+        if (it == _rendered.end())
+            it = _rendered.insert(format, render(Format(format)));
+        text = it.value();
+    }
+    if (mimeType == "text/plain")
+        return text;
+    return text.toUtf8();
+}
+
+int SelectionMimeData::formatOf(const QString &mimeType) const
+{
+    if (mimeType == "text/plain")
+        return _primary;
+    for (int f = Csv; f <= Markdown; ++f)
+    {
+        if (mimeType == formatMimeTypes[f])
+            return f;
+    }
+    return -1;
+}
+
+QString SelectionMimeData::render(Format format) const
+{
+    QString res;
+    if (format == Json)
+        res.append('[');
+    for (const Block &block: _blocks)
+    {
+        switch (format)
+        {
+        case Csv:
+            renderCsv(block, res);
+            break;
+        case Tsv:
+            renderTsv(block, res);
+            break;
+        case Json:
+            renderJson(block, res);
+            break;
+        case Markdown:
+            renderMarkdown(block, res);
+            break;
+        }
+    }
+    if (format == Json)
+        res.append(res.length() > 1 ? "\n]" : "]");
+    return res;
+}
+
+void SelectionMimeData::renderCsv(const Block &block, QString &res) const
+{
+    for (const DataRow &row: block.rows)
+    {
+        for (int c = block.left; c <= block.right; ++c)
+        {
+            if (c > block.left)
+                res.append(',');
+            QString val = TableModel::toText(row.at(c));
+            if (_quoted.value(c))
+                res.append('"').append(val.replace('"', "\"\"")).append('"');
+            else
+                res.append(val);
+        }
+        res.append(QChar::CarriageReturn);
+    }
+}
+
+void SelectionMimeData::renderTsv(const Block &block, QString &res) const
+{
+    // there is no escaping in TSV - separators within values are replaced
+    for (const DataRow &row: block.rows)
+    {
+        for (int c = block.left; c <= block.right; ++c)
+        {
+            if (c > block.left)
+                res.append('\t');
+            QString val = TableModel::toText(row.at(c));
+            for (QChar &ch: val)
+            {
+                if (ch == '\t' || ch == '\n' || ch == '\r')
+                    ch = ' ';
+            }
+            res.append(val);
+        }
+        res.append('\n');
+    }
+}
+
+void SelectionMimeData::renderJson(const Block &block, QString &res) const
+{
+    // an array of objects, one per row
+    for (const DataRow &row: block.rows)
+    {
+        if (res.length() > 1)
+            res.append(',');
+        res.append("\n{");
+        for (int c = block.left; c <= block.right; ++c)
+        {
+            if (c > block.left)
+                res.append(", ");
+            res.append(TableModel::toJson(_names.value(c))).append(": ").append(TableModel::toJson(row.at(c)));
+        }
+        res.append('}');
+    }
+}
+
+void SelectionMimeData::renderMarkdown(const Block &block, QString &res) const
+{
+    res.append('|');
+    for (int c = block.left; c <= block.right; ++c)
+        res.append(' ').append(_names.value(c)).append(" |");
+    res.append("\n|");
+    for (int c = block.left; c <= block.right; ++c)
+        res.append(" --- |");
+    res.append('\n');
+    for (const DataRow &row: block.rows)
+    {
+        res.append('|');
+        for (int c = block.left; c <= block.right; ++c)
+        {
+            QString val = TableModel::toText(row.at(c));
+            val.replace('|', "\\|").replace("\r\n", "<br>").replace('\n', "<br>").replace('\r', "<br>");
+            res.append(' ').append(val).append(" |");
+        }
+        res.append('\n');
+    }
+}
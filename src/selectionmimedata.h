@@ -0,0 +1,64 @@
+#ifndef SELECTIONMIMEDATA_H
+#define SELECTIONMIMEDATA_H
+
+#include <QMimeData>
+#include <QItemSelection>
+#include <QFuture>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "datatable.h"
+
+class TableModel;
+
+/*!
+ * \brief clipboard payload of a result grid selection
+ *
+ * Selected rows are shared with the model at the moment of copying (values are
+ * not duplicated), texts are rendered by selection ranges. The text of the
+ * primary format is rendered by a worker right away, other formats are rendered
+ * when requested by a paste.
+ */
+class SelectionMimeData : public QMimeData
+{
+    Q_OBJECT
+public:
+    enum Format { Csv, Tsv, Json, Markdown };
+
+    /*!
+     * \param quoted per column: CSV values must be quoted
+     * \param primary format of the plain text
+     */
+    SelectionMimeData(const TableModel *model, const QItemSelection &selection,
+                      const QVector<bool> &quoted, Format primary);
+    ~SelectionMimeData();
+
+    virtual QStringList formats() const override;
+    virtual bool hasFormat(const QString &mimeType) const override;
+
+protected:
+    virtual QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override;
+
+private:
+    struct Block
+    {
+        QVector<DataRow> rows;
+        int left, right;    ///< columns range
+    };
+
+    QVector<Block> _blocks;
+    QStringList _names;
+    QVector<bool> _quoted;
+    Format _primary;
+    QFuture<QString> _primaryText;
+    mutable QHash<int, QString> _rendered;  ///< secondary formats rendered so far
+
+    QString render(Format format) const;
+    void renderCsv(const Block &block, QString &res) const;
+    void renderTsv(const Block &block, QString &res) const;
+    void renderJson(const Block &block, QString &res) const;
+    void renderMarkdown(const Block &block, QString &res) const;
+    int formatOf(const QString &mimeType) const;
+};
+
+#endif // SELECTIONMIMEDATA_H
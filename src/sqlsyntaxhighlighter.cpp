@@ -3,17 +3,104 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QTimer>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QPlainTextEdit>
+#include <QTextEdit>
+#include <QScrollBar>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 #include "sqlsyntaxhighlighter.h"
 
+// the state of blocks waiting for background tokenizing
+#define PENDING_STATE -2
+// time limit of a highlighting pass (ms)
+#define HIGHLIGHT_PASS_TIME 20
+// pause between background passes (ms), so that input is processed meanwhile
+#define HIGHLIGHT_IDLE_INTERVAL 5
+// blocks considered visible until the editor is scrolled
+#define HIGHLIGHT_INITIAL_VISIBLE_BLOCKS 200
+// blocks of this length and longer are tokenized in background
+#define HIGHLIGHT_BACKGROUND_LENGTH 10000
+// background results are applied together, at most once a frame (ms)
+#define HIGHLIGHT_FRAME_INTERVAL 16
+// characters tokenized between checks for cancelling
+#define HIGHLIGHT_CANCEL_CHECK 0xFFFF
+
+struct SqlSyntaxHighlighter::Lexicon
+{
+    enum class LastWordOption { Yes, No, MayBe };
+    struct WordInfo
+    {
+        char formatIndex;
+        LastWordOption isLastWord;
+    };
+    KeywordTable keywords;          ///< words of phrases follow previous words
+    QVector<WordInfo> keywordInfo;  ///< by keyword entries
+
+    KeywordTable functions;
+    std::bitset<0x10000> delimiters;    ///< by UTF-16 code units
+    bool tsqlBrackets;
+    int mixedFormat;                ///< ascii and non-ascii characters within a word
+};
+
+/*!
+ * \brief tokens of a long block, kept by the document
+ */
+class SqlSyntaxHighlighter::BlockTokens : public QTextBlockUserData
+{
+public:
+    explicit BlockTokens(const std::shared_ptr<const Lexicon> &lexicon) :
+        lexicon(lexicon), revision(-1), entryState(-1), state(-1), job(0), jobRevision(-1), jobEntryState(-1) {}
+    ~BlockTokens()
+    {
+        if (cancelled)
+            cancelled->store(true);
+    }
+
+    std::shared_ptr<const Lexicon> lexicon;     ///< tokens of other highlighters are not used
+    int revision;                   ///< of the block the tokens are for
+    int entryState;
+    int state;
+    QVector<Token> tokens;
+
+    int job;                        ///< the last background job
+    int jobRevision;
+    int jobEntryState;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+// the first delimiters, they do not break phrases
+static inline bool isSpace(QChar c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
 SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject *parent) :
-    QSyntaxHighlighter(parent)
+    QSyntaxHighlighter(parent), _passActive(false),
+    _visibleFirst(0), _visibleLast(HIGHLIGHT_INITIAL_VISIBLE_BLOCKS), _lastJob(0)
 {
+    _idleTimer = new QTimer(this);
+    _idleTimer->setSingleShot(true);
+    _idleTimer->setInterval(HIGHLIGHT_IDLE_INTERVAL);
+    connect(_idleTimer, &QTimer::timeout, this, &SqlSyntaxHighlighter::continueHighlighting);
+    if (QAbstractScrollArea *editor = qobject_cast<QAbstractScrollArea*>(parent))
+        connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &SqlSyntaxHighlighter::highlightVisible);
+    _applyTimer = new QTimer(this);
+    _applyTimer->setSingleShot(true);
+    _applyTimer->setInterval(HIGHLIGHT_FRAME_INTERVAL);
+    connect(_applyTimer, &QTimer::timeout, this, &SqlSyntaxHighlighter::applyReadyTokens);
+    std::shared_ptr<Lexicon> lexicon = std::make_shared<Lexicon>();
+
     /*
      * QTextCharFormat::setFontCapitalization does not work
      * https://bugreports.qt.io/browse/QTBUG-32619
      */
 
-    delimiters = " \t\r\n``'\";:()[]<>{}/\\^&|!?~,.-+*%=" + settings["add_separators"].toString();
+    const QString separators = " \t\r\n``'\";:()[]<>{}/\\^&|!?~,.-+*%=" + settings["add_separators"].toString();
+    for (const QChar &c: separators)
+        lexicon->delimiters.set(c.unicode());
 
     auto get_format = [](
             const QJsonValue node,
@@ -43,7 +130,7 @@ SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject
     formats.append(get_format(settings["literal"], "envelope", Qt::red));  // 0 - literal
 
     format = get_format(settings["identifier"], "envelope", Qt::black);
-    tsqlBrackets = settings["identifier"].toObject()["brackets"].toBool(false);
+    lexicon->tsqlBrackets = settings["identifier"].toObject()["brackets"].toBool(false);
     formats.append(format);  // 1 - ""
     formats.append(format);  // 2 - []
 
@@ -60,8 +147,9 @@ SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject
     {
         QString kw = v.toString();
         if (!kw.isEmpty())
-            functions.insert(kw, 7);
+            lexicon->functions.insert(-1, kw);
     }
+    lexicon->functions.compile();
 
     // keywords, operator-like functions, data types and so on
     QJsonArray kwPartition = settings["keyword"].toArray();
@@ -73,46 +161,266 @@ SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject
         {
             QString kw = v.toString();
             QStringList words = kw.split(' ', QString::SkipEmptyParts);
-            QHash <QString, WordInfo> *curLevel = &keywords;
-            LastWordOption *lwo = nullptr;
+            int parent = -1;
             for (int i = 0; i < words.length(); ++i)
             {
-                QString w = words.at(i);
-                auto it = curLevel->find(w);
-                if (it != curLevel->end())
+                int entry = lexicon->keywords.insert(parent, words.at(i));
+                parent = entry;
+                if (entry < lexicon->keywordInfo.size())
                 {
-                    lwo = &it.value().isLastWord;
-                    curLevel = &it.value().nextWords;
-                    if (i < words.length() - 1 && *lwo == LastWordOption::Yes)
-                        *lwo = LastWordOption::MayBe;
-                    else if (i == words.length() - 1 && *lwo == LastWordOption::No)
-                        *lwo = LastWordOption::MayBe;
+                    Lexicon::WordInfo &info = lexicon->keywordInfo[entry];
+                    if (i < words.length() - 1 && info.isLastWord == Lexicon::LastWordOption::Yes)
+                        info.isLastWord = Lexicon::LastWordOption::MayBe;
+                    else if (i == words.length() - 1 && info.isLastWord == Lexicon::LastWordOption::No)
+                        info.isLastWord = Lexicon::LastWordOption::MayBe;
 
                     if (i == words.length() - 1)
-                        it.value().formatIndex = ind;
+                        info.formatIndex = ind;
                     continue;
                 }
 
                 if (i < words.length() - 1)
-                    it = curLevel->insert(w, { -1, LastWordOption::No, {}});
+                    lexicon->keywordInfo.append({ -1, Lexicon::LastWordOption::No });
                 else
-                    it = curLevel->insert(w, { ind, LastWordOption::Yes, {}});
-
-                lwo = &it.value().isLastWord;
-                curLevel = &it.value().nextWords;
+                    lexicon->keywordInfo.append({ ind, Lexicon::LastWordOption::Yes });
             }
         }
         formats.append(get_format(p, "code", Qt::black));
     }
+    lexicon->keywords.compile();
+
+    QTextCharFormat mixed;
+    mixed.setUnderlineColor(Qt::red);
+    mixed.setUnderlineStyle(QTextCharFormat::DotLine);
+    lexicon->mixedFormat = formats.size();
+    formats.append(mixed);
+    _lexicon = lexicon;
+}
+
+void SqlSyntaxHighlighter::startPass()
+{
+    if (_passActive)
+        return;
+    _passActive = true;
+    _passTimer.start();
+    QTimer::singleShot(0, this, [this]() { _passActive = false; });
+}
+
+bool SqlSyntaxHighlighter::isVisible(int blockNumber) const
+{
+    return blockNumber >= _visibleFirst && blockNumber <= _visibleLast;
+}
+
+void SqlSyntaxHighlighter::markDirty(const QTextBlock &block)
+{
+    if (_scanFrom.isNull() || _scanFrom.document() != block.document() || block.position() < _scanFrom.position())
+        _scanFrom = QTextCursor(block);
+    if (!_idleTimer->isActive())
+        _idleTimer->start();
 }
 
 void SqlSyntaxHighlighter::highlightBlock(const QString &text)
 {
+    startPass();
+    QTextBlock block = currentBlock();
+    bool known = (previousBlockState() != PENDING_STATE);
+    if (known && (_passTimer.elapsed() < HIGHLIGHT_PASS_TIME || isVisible(block.blockNumber())))
+    {
+        if (!_scanFrom.isNull() && _scanFrom.block() == block)
+            _scanFrom = QTextCursor();
+        // following blocks wait for background tokenizing
+        if (!highlightText(text, previousBlockState(), false))
+        {
+            setCurrentBlockState(PENDING_STATE);
+            markDirty(block);
+        }
+        return;
+    }
+    // the state is kept, so that QSyntaxHighlighter does not go on with following blocks,
+    // and the rest is rehighlighted in background steps
+    int state = currentBlockState();
+    if (isVisible(block.blockNumber()))
+    {
+        // visible text is highlighted anyway (it is done again when the previous block is ready)
+        highlightText(text, known ? previousBlockState() : -1, true);
+    }
+    else
+    {
+        // the text is not changed, its formats are still valid
+        for (const QTextLayout::FormatRange &r: block.layout()->formats())
+            setFormat(r.start, r.length, r.format);
+    }
+    setCurrentBlockState(state);
+    // a block following a pending one is rehighlighted when tokens are ready
+    if (known)
+        markDirty(block);
+}
+
+void SqlSyntaxHighlighter::continueHighlighting()
+{
+    QTextDocument *doc = document();
+    if (!doc || _scanFrom.isNull() || _scanFrom.document() != doc)
+    {
+        _scanFrom = QTextCursor();
+        return;
+    }
+    QTextBlock block = _scanFrom.block();
+    // resumed when tokens are ready
+    if (isWaiting(block))
+        return;
+    _scanFrom = QTextCursor();
+    // blocks are highlighted one after another while their states change, until the pass is over
+    _passActive = false;
+    startPass();
+    rehighlightBlock(block);
+}
+
+void SqlSyntaxHighlighter::highlightVisible()
+{
+    QTextDocument *doc = document();
+    QAbstractScrollArea *editor = qobject_cast<QAbstractScrollArea*>(parent());
+    if (!doc || !editor)
+        return;
+    QPoint bottomRight(editor->viewport()->width(), editor->viewport()->height());
+    QTextBlock first, last;
+    if (QPlainTextEdit *plain = qobject_cast<QPlainTextEdit*>(editor))
+    {
+        first = plain->cursorForPosition(QPoint(0, 0)).block();
+        last = plain->cursorForPosition(bottomRight).block();
+    }
+    else if (QTextEdit *rich = qobject_cast<QTextEdit*>(editor))
+    {
+        first = rich->cursorForPosition(QPoint(0, 0)).block();
+        last = rich->cursorForPosition(bottomRight).block();
+    }
+    if (!first.isValid() || !last.isValid() || first.document() != doc)
+        return;
+    _visibleFirst = first.blockNumber();
+    _visibleLast = last.blockNumber();
+    if (_scanFrom.isNull() || _scanFrom.document() != doc)
+        return;
+    // blocks beyond the scanned ones may have never been highlighted
+    QTextBlock block = _scanFrom.block();
+    if (block.blockNumber() < _visibleFirst)
+        block = first;
+    if (block.blockNumber() <= _visibleLast)
+    {
+        startPass();
+        rehighlightBlock(block);
+    }
+}
+
+bool SqlSyntaxHighlighter::highlightText(const QString &text, int previousState, bool provisional)
+{
+    if (text.length() < HIGHLIGHT_BACKGROUND_LENGTH)
+    {
+        Tokenized res = tokenize(*_lexicon, text, previousState, nullptr);
+        applyTokens(res.tokens);
+        setCurrentBlockState(res.state);
+        return true;
+    }
+
+    BlockTokens *data = static_cast<BlockTokens*>(currentBlockUserData());
+    if (!data || data->lexicon != _lexicon)
+    {
+        data = new BlockTokens(_lexicon);
+        setCurrentBlockUserData(data);
+    }
+    // formats of the previous text are kept until the new ones are ready
+    applyTokens(data->tokens);
+    int revision = currentBlock().revision();
+    if (data->revision == revision && data->entryState == previousState)
+    {
+        setCurrentBlockState(data->state);
+        return true;
+    }
+    if (!provisional && !(_running.contains(data->job) &&
+                          data->jobRevision == revision && data->jobEntryState == previousState))
+        tokenizeInBackground(data, text, previousState);
+    return false;
+}
+
+void SqlSyntaxHighlighter::applyTokens(const QVector<Token> &tokens)
+{
+    for (const Token &t: tokens)
+        setFormat(t.start, t.length, formats.at(t.format));
+}
+
+void SqlSyntaxHighlighter::tokenizeInBackground(BlockTokens *data, const QString &text, int previousState)
+{
+    if (data->cancelled)
+        data->cancelled->store(true);
+    data->cancelled = std::make_shared<std::atomic<bool>>(false);
+    data->job = ++_lastJob;
+    data->jobRevision = currentBlock().revision();
+    data->jobEntryState = previousState;
+    _running.insert(data->job);
+
+    int job = data->job;
+    QTextBlock block = currentBlock();
+    std::shared_ptr<std::atomic<bool>> cancelled = data->cancelled;
+    QFutureWatcher<Tokenized> *watcher = new QFutureWatcher<Tokenized>(this);
+    connect(watcher, &QFutureWatcher<Tokenized>::finished, this, [this, watcher, job, block, data, cancelled]() {
+        watcher->deleteLater();
+        _running.remove(job);
+        // the data (deleted with its block) and the block are not touched if they may be gone,
+        // QTextBlock::isValid() does not detect a deleted block
+        if (*cancelled)
+            return;
+        if (block.document() != document() || block.userData() != data || data->job != job)
+            return;
+        Tokenized res = watcher->result();
+        data->tokens = res.tokens;
+        data->state = res.state;
+        data->revision = data->jobRevision;
+        data->entryState = data->jobEntryState;
+        data->cancelled.reset();
+        _ready.append(block.position());
+        if (!_applyTimer->isActive())
+            _applyTimer->start();
+    });
+    // text is a copy, the lexicon is not changed anymore
+    std::shared_ptr<const Lexicon> lexicon = _lexicon;
+    watcher->setFuture(QtConcurrent::run([lexicon, text, previousState, cancelled]() {
+        return tokenize(*lexicon, text, previousState, cancelled.get());
+    }));
+}
+
+void SqlSyntaxHighlighter::applyReadyTokens()
+{
+    QTextDocument *doc = document();
+    QList<int> positions;
+    positions.swap(_ready);
+    for (int position: positions)
+    {
+        // blocks may be shifted or deleted by edits since tokens were ready
+        QTextBlock block = doc ? doc->findBlock(position) : QTextBlock();
+        if (!block.isValid())
+            continue;
+        // highlighting continues from the block, as far as the pass allows
+        _passActive = false;
+        startPass();
+        rehighlightBlock(block);
+    }
+    if (!_scanFrom.isNull() && !_idleTimer->isActive())
+        _idleTimer->start();
+}
+
+bool SqlSyntaxHighlighter::isWaiting(const QTextBlock &block) const
+{
+    const BlockTokens *data = static_cast<const BlockTokens*>(block.userData());
+    return data && data->lexicon == _lexicon && _running.contains(data->job);
+}
+
+SqlSyntaxHighlighter::Tokenized SqlSyntaxHighlighter::tokenize(const Lexicon &lexicon, const QString &text, int previousState,
+                                                               const std::atomic<bool> *cancelled)
+{
+    Tokenized res;
     int firstWordStartPos = -1;
-    const WordInfo *lastWordInfo = nullptr;
+    int lastWord = -1;      // keyword entry of an incomplete phrase
     QString::ConstIterator i = text.constBegin();
     QChar prevChar;
-    int mode = (previousBlockState() == -1 ? 0xFF : previousBlockState());
+    int mode = (previousState == -1 ? 0xFF : previousState);
     int len = 1, pos = 1;
     do
     {
@@ -124,7 +432,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                 mode = 0;
             else if (*i == '"')
                 mode = 1;
-            else if (*i == '[' && tsqlBrackets)
+            else if (*i == '[' && lexicon.tsqlBrackets)
                 mode = 2;
             else if (*i == '*' && prevChar == '/')
             {
@@ -137,26 +445,23 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                 mode = 4;
                 ++len;
             }
-            else if (delimiters.contains(prevChar) || prevChar.isNull())
+            else if (lexicon.delimiters.test(prevChar.unicode()) || prevChar.isNull())
             {
                 if ((*i).isDigit())
                     mode = 5;
                 else if (// typical start of word
                          (*i).isLetter() || *i == '_' ||
                          // tsql-like vars, temp tables and so on
-                         ((*i == '@' || *i == '$' || *i == '#') && !delimiters.contains(*i))
+                         ((*i == '@' || *i == '$' || *i == '#') && !lexicon.delimiters.test((*i).unicode()))
                         )
                     mode = 9;
             }
 
-            if (mode != 0xFF)
-                setCurrentBlockState(mode);
-
             break;
         case 0:
             if (*i == '\'')
             {
-                setFormat(pos - len, len, formats.at(mode));
+                res.tokens.append({ pos - len, len, mode });
                 mode = 0xFF;
             }
             break;
@@ -164,18 +469,18 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             if (*i == '"')
             {
                 // check for data type (e.g. "char") or other quoted SINGLE word
-                auto const it = keywords.find(text.mid(pos - len, len).toLower());
-                if (it != keywords.end() && it.value().formatIndex >= 0)
-                    setFormat(pos - len, len, formats.at(it.value().formatIndex));
+                int entry = lexicon.keywords.find(-1, text.midRef(pos - len, len));
+                if (entry >= 0 && lexicon.keywordInfo.at(entry).formatIndex >= 0)
+                    res.tokens.append({ pos - len, len, lexicon.keywordInfo.at(entry).formatIndex });
                 else
-                    setFormat(pos - len, len, formats.at(mode));
+                    res.tokens.append({ pos - len, len, mode });
                 mode = 0xFF;
             }
             break;
         case 2:
             if (*i == ']')
             {
-                setFormat(pos - len, len, formats.at(mode));
+                res.tokens.append({ pos - len, len, mode });
                 mode = 0xFF;
             }
             break;
@@ -188,26 +493,24 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
 
             if ((static_cast<unsigned int>(mode) & 0xFFFFFF00) == 0)
             {
-                setFormat(pos - len, len, formats.at(mode));
+                res.tokens.append({ pos - len, len, mode });
                 mode = 0xFF;
             }
-            else
-                setCurrentBlockState(mode);
             break;
         case 4:
             if (*i == '\n' || (*i).isNull())
             {
-                setFormat(pos - len, len, formats.at(mode));
+                res.tokens.append({ pos - len, len, mode });
                 mode = 0xFF;
-                lastWordInfo = nullptr;
+                lastWord = -1;
             }
             break;
         case 5:
             if (!(*i).isDigit() && *i != '.')
             {
-                if (delimiters.contains(*i) || (*i).isNull())
+                if (lexicon.delimiters.test((*i).unicode()) || (*i).isNull())
                 {
-                    setFormat(pos - len, len - 1, formats.at(mode));
+                    res.tokens.append({ pos - len, len - 1, mode });
                     --i; --pos;
                 }
                 mode = 0xFF;
@@ -215,63 +518,62 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             break;
         case 9:
         {
-            int delimPos = delimiters.indexOf(*i);
-            if (delimPos >= 0 || (*i).isNull())
+            if (lexicon.delimiters.test((*i).unicode()) || (*i).isNull())
             {
-                QString word = text.mid(pos - len, len - 1).toLower();
+                QStringRef word = text.midRef(pos - len, len - 1);
                 int delta = 0;
 
                 // skip space characters to detect possible trailing '('
-                while (delimPos >= 0 && delimPos < 4)
-                    delimPos = delimiters.indexOf(*(i + ++delta));
+                while (isSpace(*(i + delta)))
+                    ++delta;
+                // phrases are broken by other delimiters
+                bool phraseEnd = lexicon.delimiters.test((*(i + delta)).unicode());
 
-                if (*(i + delta) == '(' && functions.constFind(word) != functions.constEnd())
+                if (*(i + delta) == '(' && lexicon.functions.find(-1, word) >= 0)
                     // function
-                    setFormat(pos - len, len - 1, formats.at(7));
+                    res.tokens.append({ pos - len, len - 1, 7 });
                 else
                 {
                     // ms sql variable
                     if (word.at(0) == '@' && len > 2 && word.at(1) != '@')
-                        setFormat(pos - len, len - 1, formats.at(6));
+                        res.tokens.append({ pos - len, len - 1, 6 });
 
                     auto processFirstWord = [&](bool standalone = false) {
-                        auto const it = keywords.find(word);
-                        if (it != keywords.end())
+                        int entry = lexicon.keywords.find(-1, word);
+                        if (entry >= 0)
                         {
-                            if (it.value().isLastWord != LastWordOption::No)
-                                setFormat(pos - len, len - 1, formats.at(it.value().formatIndex));
+                            const Lexicon::WordInfo &info = lexicon.keywordInfo.at(entry);
+                            if (info.isLastWord != Lexicon::LastWordOption::No)
+                                res.tokens.append({ pos - len, len - 1, info.formatIndex });
 
-                            if (!standalone && it.value().isLastWord != LastWordOption::Yes)
+                            if (!standalone && info.isLastWord != Lexicon::LastWordOption::Yes)
                             {
                                 firstWordStartPos = pos - len;
-                                lastWordInfo = &(it.value());
+                                lastWord = entry;
                             }
                         }
                         // ascii and non-ascii character within single word
                         else if ((mode >> 16) == 3)
                         {
-                            QTextCharFormat format;
-                            format.setUnderlineColor(Qt::red);
-                            format.setUnderlineStyle(QTextCharFormat::DotLine);
-                            setFormat(pos - len, len - 1, format);
+                            res.tokens.append({ pos - len, len - 1, lexicon.mixedFormat });
                         }
                     };
 
                     // precess data types (may be multi-word)
-                    if (!lastWordInfo)
+                    if (lastWord < 0)
                     {
                         processFirstWord();
                     }
                     else
                     {
-                        auto const it = lastWordInfo->nextWords.find(word);
-                        if (it != lastWordInfo->nextWords.end())
+                        int entry = lexicon.keywords.find(lastWord, word);
+                        if (entry >= 0)
                         {
-                            if (it.value().isLastWord != LastWordOption::No)
-                                setFormat(firstWordStartPos, pos - firstWordStartPos - 1, formats.at(it.value().formatIndex));
+                            if (lexicon.keywordInfo.at(entry).isLastWord != Lexicon::LastWordOption::No)
+                                res.tokens.append({ firstWordStartPos, pos - firstWordStartPos - 1, lexicon.keywordInfo.at(entry).formatIndex });
                             else
                             {
-                                lastWordInfo = &(it.value());
+                                lastWord = entry;
                                 // apply "default" color untill end of phrase get found
                                 processFirstWord(true);
                             }
@@ -279,14 +581,14 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                         else
                         {
                             // incomplete phrase - restart search
-                            lastWordInfo = nullptr;
+                            lastWord = -1;
                             processFirstWord();
                         }
                     }
                 }
 
-                if (delimPos > 2)
-                    lastWordInfo = nullptr;
+                if (phraseEnd)
+                    lastWord = -1;
 
                 --i; --pos;
                 mode = 0xFF;
@@ -303,7 +605,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             break;
         }
         default:
-            setFormat(pos - len, len - 1, formats.at(mode & 0xFF));
+            res.tokens.append({ pos - len, len - 1, mode & 0xFF });
             break;
         }
         prevChar = *i;
@@ -315,18 +617,20 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             break;
         }
         ++i; ++pos;
+        // the text may be changed already
+        if ((pos & HIGHLIGHT_CANCEL_CHECK) == 0 && cancelled && cancelled->load())
+            break;
     }
     while (true);
 
     if (mode != 0xFF)
     {
-        setFormat(pos - len, len - 1, formats.at(mode & 0xFF));
+        res.tokens.append({ pos - len, len - 1, mode & 0xFF });
         if ((mode & 0xFF) > 3)
             mode = 0xFF;
     }
 
-    if (currentBlockState() != mode)
-        setCurrentBlockState(mode);
-
+    res.state = mode;
+    return res;
 }
 
@@ -2,7 +2,32 @@
 #define SQLSYNTAXHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QElapsedTimer>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QSet>
+#include <bitset>
+#include <atomic>
+#include <memory>
+#include "keywordtable.h"
 
+class QTimer;
+
+/*!
+ * \brief incremental SQL highlighter
+ *
+ * A block state is the lexer state at the end of the block (a mode and a nesting
+ * level of comments), so a change is rehighlighted until the state of a block
+ * stays the same. Every pass of highlighting is limited in time: blocks beyond
+ * the limit keep their states and formats, so the pass stops there, and the
+ * rest is rehighlighted in background steps from the first of them. Visible
+ * blocks are highlighted at once, and again when the background steps reach them.
+ *
+ * Long blocks (like one-line dumps) are tokenized in background: the lexer works
+ * on a copy of the text and produces format ranges, which are applied on the next
+ * frame if the block has not changed meanwhile. Until then the block keeps formats
+ * of its previous text and following blocks are pending.
+ */
 class SqlSyntaxHighlighter : public QSyntaxHighlighter
 {
 	Q_OBJECT
@@ -12,20 +37,58 @@ public:
 protected:
 	virtual void highlightBlock(const QString &text);
 
+private slots:
+    void highlightVisible();    ///< pending blocks within the editor viewport
+    void continueHighlighting();
+    void applyReadyTokens();
+
 private:
-    enum class LastWordOption { Yes, No, MayBe };
-    struct WordInfo
+    struct Token
+    {
+        int start;
+        int length;
+        int format;                 ///< index in formats
+    };
+    struct Tokenized
     {
-        char formatIndex;
-        LastWordOption isLastWord;
-        QHash <QString, WordInfo> nextWords;
+        QVector<Token> tokens;
+        int state;                  ///< the lexer state at the end of text
     };
-    QHash <QString, WordInfo> keywords;
+    class BlockTokens;
+    struct Lexicon;
+
+    /*!
+     * \brief highlight the current block
+     * \param provisional do not start tokenizing in background
+     * \return false while the block is being tokenized in background
+     */
+    bool highlightText(const QString &text, int previousState, bool provisional);
+    void applyTokens(const QVector<Token> &tokens);
+    void tokenizeInBackground(BlockTokens *data, const QString &text, int previousState);
+    void startPass();
+    void markDirty(const QTextBlock &block);    ///< background steps start from this block or an earlier one
+    bool isVisible(int blockNumber) const;
+    bool isWaiting(const QTextBlock &block) const;
+    /*!
+     * \brief the lexer, safe to run in any thread
+     * \param cancelled checked from time to time, may be nullptr
+     */
+    static Tokenized tokenize(const Lexicon &lexicon, const QString &text, int previousState,
+                              const std::atomic<bool> *cancelled);
+
+    QTimer *_idleTimer;
+    QElapsedTimer _passTimer;
+    bool _passActive;           ///< highlightBlock calls within one event loop iteration make a pass
+    int _visibleFirst, _visibleLast;    ///< editor viewport as of the last scrolling
+    QTextCursor _scanFrom;      ///< the first block to rehighlight in background, follows edits (null if there is none)
+
+    QTimer *_applyTimer;
+    QList<int> _ready;          ///< positions of blocks tokenized in background, to rehighlight
+    QSet<int> _running;         ///< background jobs
+    int _lastJob;
 
     QVector<QTextCharFormat> formats;
-    QHash<QString, char> functions;
-    QString delimiters;
-    bool tsqlBrackets;
+    std::shared_ptr<const Lexicon> _lexicon;    ///< shared with background jobs
 };
 
 #endif // SQLSYNTAXHIGHLIGHTER_H
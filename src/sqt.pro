@@ -1,4 +1,4 @@
-QT  += widgets qml
+QT  += widgets qml concurrent
 
 TARGET = sqt
 TEMPLATE = app
@@ -23,7 +23,24 @@ SOURCES += main.cpp\
     pgconnection.cpp \
     pgparams.cpp \
     sqlsyntaxhighlighter.cpp \
-    scripting.cpp
+    scripting.cpp \
+    valueviewer.cpp \
+    batchsplitter.cpp \
+    odbcparams.cpp \
+    columnsizer.cpp \
+    rowsorter.cpp \
+    rowfilter.cpp \
+    selectionmimedata.cpp \
+    tableexporter.cpp \
+    arrowwriter.cpp \
+    arrowtablemodel.cpp \
+    selectionaggregator.cpp \
+    tablediff.cpp \
+    diffmodel.cpp \
+    tablecomparer.cpp \
+    resulthistory.cpp \
+    resultquery.cpp \
+    keywordtable.cpp
 
 HEADERS  += mainwindow.h \
     dbobjectsmodel.h \
@@ -44,7 +61,25 @@ HEADERS  += mainwindow.h \
     pgtypes.h \
     pgparams.h \
     sqlsyntaxhighlighter.h \
-    scripting.h
+    scripting.h \
+    valueviewer.h \
+    batchsplitter.h \
+    odbcparams.h \
+    columnsizer.h \
+    rowsorter.h \
+    rowfilter.h \
+    selectionmimedata.h \
+    tableexporter.h \
+    arrowformat.h \
+    arrowwriter.h \
+    arrowtablemodel.h \
+    selectionaggregator.h \
+    tablediff.h \
+    diffmodel.h \
+    tablecomparer.h \
+    resulthistory.h \
+    resultquery.h \
+    keywordtable.h
 
 FORMS    += mainwindow.ui \
     logindialog.ui \
@@ -0,0 +1,360 @@
+#include "tablecomparer.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include <QtConcurrent>
+
+// ranges with no more rows than this on either side are fetched instead of being split
+#define COMPARE_LEAF_ROWS 1000
+// a mismatching range is split into this number of parts
+#define COMPARE_SPLIT_PARTS 16
+// the whole table is split into this number of ranges per connection at once
+#define COMPARE_ROOT_PARTS_PER_CONNECTION 4
+// max rows of mismatching ranges transferred from both servers
+#define COMPARE_MAX_TRANSFERRED_ROWS 2000000
+
+TableComparer::TableComparer(QObject *parent) :
+    QObject(parent), _connections(1), _checksums(false), _portable(false), _busy(0),
+    _leftRows(new DataTable()), _rightRows(new DataTable()),
+    _cancelled(false), _running(0), _ranges(0), _rows(0)
+{
+}
+
+TableComparer::~TableComparer()
+{
+    cancel();
+    // workers use members and delete their connections themselves
+    _pool.waitForDone();
+}
+
+TableComparer::Dialect TableComparer::dialect(DbConnection *con)
+{
+    QString name = con->dbmsName();
+    if (name == "PostgreSQL")
+        return PostgreSql;
+    if (name.contains("SQL Server", Qt::CaseInsensitive))
+        return SqlServer;
+    return Generic;
+}
+
+void TableComparer::start(DbConnection *left, const QString &leftTable, DbConnection *right, const QString &rightTable,
+                          const QString &key, const QStringList &columns, int connections)
+{
+    _left.prototype.reset(left->clone());
+    _left.table = leftTable;
+    _left.dialect = dialect(left);
+    _right.prototype.reset(right->clone());
+    _right.table = rightTable;
+    _right.dialect = dialect(right);
+    _key = key;
+    _columns = columns;
+    _connections = qMax(1, connections);
+    // checksums of different servers are computed over the text form of values
+    _checksums = (_left.dialect != Generic && _right.dialect != Generic);
+    _portable = (_checksums && _left.dialect != _right.dialect);
+
+    _queue.clear();
+    _queue.enqueue({ QVariant(), QVariant(), true });
+    _busy = 0;
+    _error.clear();
+    _cancelled = false;
+    _ranges = 0;
+    _rows = 0;
+    if (_portable && _columns.isEmpty())
+    {
+        _error = tr("compared columns must be listed to compare tables of different servers");
+        _queue.clear();
+    }
+    _running = _connections;
+    _pool.setMaxThreadCount(_connections);
+    for (int i = 0; i < _connections; ++i)
+        QtConcurrent::run(&_pool, this, &TableComparer::work);
+}
+
+void TableComparer::cancel()
+{
+    QMutexLocker lock(&_mutex);
+    _cancelled = true;
+    for (DbConnection *con: _active)
+        con->cancel();
+    _wakeUp.wakeAll();
+}
+
+DataTable *TableComparer::takeLeftRows()
+{
+    return _leftRows.release();
+}
+
+DataTable *TableComparer::takeRightRows()
+{
+    return _rightRows.release();
+}
+
+void TableComparer::work()
+{
+    // connections are created in the worker thread as they watch their sockets
+    std::unique_ptr<DbConnection> left(_left.prototype->clone());
+    std::unique_ptr<DbConnection> right(_right.prototype->clone());
+    QString lastError;
+    connect(left.get(), &DbConnection::error, [&lastError](const QString &msg) { lastError = msg; });
+    connect(right.get(), &DbConnection::error, [&lastError](const QString &msg) { lastError = msg; });
+    {
+        QMutexLocker lock(&_mutex);
+        _active << left.get() << right.get();
+    }
+
+    QString err;
+    if (!left->open() || !right->open())
+        err = lastError.isEmpty() ? tr("cannot connect") : lastError;
+    while (err.isEmpty())
+    {
+        Range range;
+        {
+            QMutexLocker lock(&_mutex);
+            // an empty queue is not the end while other workers may split their ranges
+            while (_queue.isEmpty() && _busy && !_cancelled && _error.isEmpty())
+                _wakeUp.wait(&_mutex);
+            if (_queue.isEmpty() || _cancelled || !_error.isEmpty())
+                break;
+            range = _queue.dequeue();
+            ++_busy;
+        }
+        try
+        {
+            process(left.get(), right.get(), range);
+        }
+        catch (const QString &e)
+        {
+            err = lastError.isEmpty() ? e : lastError;
+        }
+        {
+            QMutexLocker lock(&_mutex);
+            --_busy;
+            _wakeUp.wakeAll();
+        }
+        emit progress(_ranges, _rows);
+    }
+
+    {
+        QMutexLocker lock(&_mutex);
+        _active.removeOne(left.get());
+        _active.removeOne(right.get());
+        if (!err.isEmpty() && _error.isEmpty())
+            _error = err;
+        _wakeUp.wakeAll();
+    }
+    left.reset();
+    right.reset();
+    if (--_running == 0)
+        emit finished(_cancelled ? tr("comparison cancelled") : _error);
+}
+
+void TableComparer::process(DbConnection *left, DbConnection *right, const Range &range)
+{
+    QVector<QVariant> bounds;
+    if (range.root)
+    {
+        checkKey(left, _left);
+        checkKey(right, _right);
+        int parts = _connections * COMPARE_ROOT_PARTS_PER_CONNECTION;
+        bounds = boundaries(left, _left, range, parts);
+        if (bounds.isEmpty())
+            bounds = boundaries(right, _right, range, parts);
+    }
+    else
+    {
+        Summary l = summary(left, _left, range);
+        Summary r = summary(right, _right, range);
+        ++_ranges;
+        if (l.count == r.count && (l.count == 0 || (_checksums && l.checksum == r.checksum)))
+            return;
+        if (qMax(l.count, r.count) > COMPARE_LEAF_ROWS)
+        {
+            bounds = (l.count >= r.count ? boundaries(left, _left, range, COMPARE_SPLIT_PARTS)
+                                         : boundaries(right, _right, range, COMPARE_SPLIT_PARTS));
+        }
+    }
+
+    // the first boundary is the lowest key of the range, the rest ones split it
+    // (a range of equal keys cannot be split, it is fetched)
+    if (!range.from.isNull())
+    {
+        while (bounds.size() > 1 && bounds[1] == range.from)
+            bounds.removeAt(1);
+    }
+    if (bounds.size() < 2)
+    {
+        if (range.root && bounds.isEmpty())
+            return;
+        std::unique_ptr<DataTable> l(fetch(left, _left, range));
+        std::unique_ptr<DataTable> r(fetch(right, _right, range));
+        QMutexLocker lock(&_mutex);
+        _leftRows->takeRows(l.get());
+        _rightRows->takeRows(r.get());
+        return;
+    }
+    QMutexLocker lock(&_mutex);
+    QVariant from = range.from;
+    for (int i = 1; i < bounds.size(); ++i)
+    {
+        _queue.enqueue({ from, bounds[i], false });
+        from = bounds[i];
+    }
+    _queue.enqueue({ from, range.to, false });
+}
+
+QString TableComparer::compared() const
+{
+    return _columns.isEmpty() ? QString() : _columns.join(", ");
+}
+
+QString TableComparer::where(const Side &side, const Range &range, QVector<QVariant> &params) const
+{
+    QStringList conditions;
+    auto placeholder = [&side, &params]() {
+        return side.dialect == PostgreSql ? QString("$%1").arg(params.size()) : QString("?");
+    };
+    if (!range.from.isNull())
+    {
+        params.append(range.from);
+        conditions.append(QString("%1 >= %2").arg(_key, placeholder()));
+    }
+    if (!range.to.isNull())
+    {
+        params.append(range.to);
+        conditions.append(QString("%1 < %2").arg(_key, placeholder()));
+    }
+    return conditions.isEmpty() ? QString() : " where " + conditions.join(" and ");
+}
+
+DataTable *TableComparer::query(DbConnection *con, const QString &sql, const QVector<QVariant> &params)
+{
+    if (_cancelled)
+        throw tr("comparison cancelled");
+    if (!con->execute(sql, &params) || con->_resultsets.isEmpty())
+    {
+        con->clearResultsets();
+        throw tr("query failed: %1").arg(sql);
+    }
+    DataTable *res = con->_resultsets.takeLast();
+    con->clearResultsets();
+    return res;
+}
+
+TableComparer::Summary TableComparer::summary(DbConnection *con, const Side &side, const Range &range)
+{
+    QVector<QVariant> params;
+    QString cond = where(side, range, params);
+    QString sql;
+    switch (_checksums ? side.dialect : Generic)
+    {
+    case PostgreSql:
+        if (_portable)
+        {
+            sql = QString("select count(*), coalesce(sum(('x' || substr(md5(%1), 1, 14))::bit(56)::bigint), 0)::text "
+                          "from %2 t%3")
+                    .arg(canonicalText(side), side.table, cond);
+            break;
+        }
+        // 60-bit prefixes of row md5 hashes are summed up, so the checksum does not depend on the order of rows
+        sql = QString("select count(*), coalesce(sum(('x' || substr(md5(%1::text), 1, 15))::bit(60)::bigint), 0)::text "
+                      "from %2 t%3")
+                .arg(_columns.isEmpty() ? QString("t") : QString("row(%1)").arg(compared()), side.table, cond);
+        break;
+    case SqlServer:
+    {
+        // 7 bytes of row md5 hashes are converted to bigint as big-endian numbers (like the hex prefix
+        // in PostgreSQL) and summed up; checksum_agg(binary_checksum()) misses swapped and repeated values
+        QString text;
+        if (_portable)
+            text = canonicalText(side);
+        else if (_columns.isEmpty())
+            text = "cast((select t.* for xml raw) as nvarchar(max))";
+        else
+        {
+            QStringList values;
+            for (const QString &column: _columns)
+                values.append(QString("coalesce(cast(%1 as nvarchar(max)), N'\\N')").arg(column));
+            text = QString("concat(%1, N'')").arg(values.join(", N'|', "));
+        }
+        sql = QString("select count_big(*), cast(coalesce(sum(cast(cast(substring(hashbytes('MD5', %1), 1, 7) as bigint) "
+                      "as decimal(38, 0))), 0) as varchar(40)) from %2 t%3")
+                .arg(text, side.table, cond);
+        break;
+    }
+    case Generic:
+        sql = QString("select count(*) from %1 t%2").arg(side.table, cond);
+        break;
+    }
+
+    std::unique_ptr<DataTable> table(query(con, sql, params));
+    QVector<DataRow*> rows = table->rows();
+    if (rows.isEmpty())
+        throw tr("no summary of %1").arg(side.table);
+    return { rows[0]->at(0).toLongLong(), table->columnCount() > 1 ? rows[0]->at(1).toString() : QString() };
+}
+
+QString TableComparer::canonicalText(const Side &side) const
+{
+    // values are joined by their text form, hashed as UTF-8 on both servers
+    QStringList values;
+    for (const QString &column: _columns)
+    {
+        if (side.dialect == PostgreSql)
+            values.append(QString("coalesce((%1)::text, '\\N')").arg(column));
+        else
+            values.append(QString("coalesce(cast(%1 as varchar(max)) collate Latin1_General_100_BIN2_UTF8, '\\N')")
+                          .arg(column));
+    }
+    return QString("concat_ws('|', %1)").arg(values.join(", "));
+}
+
+void TableComparer::checkKey(DbConnection *con, const Side &side)
+{
+    QString sql = QString("select count(*), count(%1), count(distinct %1) from %2 t").arg(_key, side.table);
+    std::unique_ptr<DataTable> table(query(con, sql, QVector<QVariant>()));
+    QVector<DataRow*> rows = table->rows();
+    if (rows.isEmpty())
+        throw tr("no summary of %1").arg(side.table);
+    if (rows[0]->at(1).toLongLong() != rows[0]->at(0).toLongLong())
+        throw tr("%1 has rows with null %2").arg(side.table, _key);
+    if (rows[0]->at(2).toLongLong() != rows[0]->at(1).toLongLong())
+        throw tr("%1 is not unique within %2").arg(_key, side.table);
+}
+
+QVector<QVariant> TableComparer::boundaries(DbConnection *con, const Side &side, const Range &range, int parts)
+{
+    QVector<QVariant> params;
+    QString sql = QString("select min(k) from (select %1 as k, ntile(%2) over (order by %1) as part from %3 t%4) s "
+                          "group by part order by 1")
+            .arg(_key).arg(parts).arg(side.table, where(side, range, params));
+    std::unique_ptr<DataTable> table(query(con, sql, params));
+    QVector<QVariant> res;
+    for (const DataRow *row: table->rows())
+    {
+        if (!row->at(0).isNull() && (res.isEmpty() || row->at(0) != res.last()))
+            res.append(row->at(0));
+    }
+    return res;
+}
+
+DataTable *TableComparer::fetch(DbConnection *con, const Side &side, const Range &range)
+{
+    QVector<QVariant> params;
+    QString columns = "*";
+    if (!_columns.isEmpty())
+    {
+        // the key is needed to match rows
+        columns = (_columns.contains(_key, Qt::CaseInsensitive) ? compared() : _key + ", " + compared());
+    }
+    QString sql = QString("select %1 from %2 t%3 order by %4")
+            .arg(columns, side.table, where(side, range, params), _key);
+    DataTable *res = query(con, sql, params);
+    if ((_rows += res->rowCount()) > COMPARE_MAX_TRANSFERRED_ROWS)
+    {
+        delete res;
+        throw _checksums ? tr("more than %1 rows are in mismatching ranges").arg(COMPARE_MAX_TRANSFERRED_ROWS)
+                         : tr("tables cannot be compared by checksums and have more than %1 rows")
+                           .arg(COMPARE_MAX_TRANSFERRED_ROWS);
+    }
+    return res;
+}
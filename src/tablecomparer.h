@@ -0,0 +1,114 @@
+#ifndef TABLECOMPARER_H
+#define TABLECOMPARER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QThreadPool>
+#include <QVariant>
+#include <atomic>
+#include <memory>
+
+class DbConnection;
+class DataTable;
+
+/*!
+ * \brief server-side comparison of two tables, possibly of different servers
+ *
+ * Both tables are split into ranges of a unique key. Row counts and checksums of
+ * a range are computed by servers and only ranges that differ are split further,
+ * so just rows of small mismatching ranges are transferred. Ranges are processed
+ * by several workers, each one having its own pair of connections.
+ *
+ * Checksums are available for PostgreSQL and SQL Server (2016 or later): row MD5
+ * hashes are summed up, so they do not depend on the order of rows. Tables of different
+ * servers are checksummed over the text form of listed columns (SQL Server 2019
+ * or later, values must have the same text form on both servers, as strings
+ * and integers do). Otherwise only row counts are compared and ranges are split
+ * down to small ones, until too many rows are transferred.
+ */
+class TableComparer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TableComparer(QObject *parent = 0);
+    ~TableComparer();
+
+    /*!
+     * \brief start comparing in background
+     *
+     * Connections are used only as prototypes (they are cloned by workers).
+     * \param key column unique and not null within both tables (checked before comparing)
+     * \param columns compared columns (whole rows if empty)
+     * \param connections number of parallel connections to every server
+     */
+    void start(DbConnection *left, const QString &leftTable, DbConnection *right, const QString &rightTable,
+               const QString &key, const QStringList &columns, int connections);
+    void cancel();
+    /*!
+     * \brief rows of mismatching ranges, available when finished (the caller takes ownership)
+     */
+    DataTable* takeLeftRows();
+    DataTable* takeRightRows();
+
+signals:
+    void progress(qint64 ranges, qint64 rows);  ///< ranges compared and rows transferred so far
+    void finished(const QString &error);        ///< error is empty on success
+
+private:
+    enum Dialect { Generic, PostgreSql, SqlServer };
+    struct Side
+    {
+        std::unique_ptr<DbConnection> prototype;
+        QString table;
+        Dialect dialect;
+    };
+    struct Range
+    {
+        QVariant from;  ///< inclusive, unbounded if null
+        QVariant to;    ///< exclusive, unbounded if null
+        bool root;
+    };
+    struct Summary
+    {
+        qint64 count;
+        QString checksum;
+    };
+
+    Side _left, _right;
+    QString _key;
+    QStringList _columns;
+    int _connections;
+    bool _checksums;
+    bool _portable;                     ///< checksums of different servers
+
+    QThreadPool _pool;
+    QMutex _mutex;
+    QWaitCondition _wakeUp;
+    QQueue<Range> _queue;
+    int _busy;                          ///< workers processing a range (they may enqueue more)
+    QString _error;
+    QList<DbConnection*> _active;       ///< connections of workers, to cancel their queries
+    std::unique_ptr<DataTable> _leftRows, _rightRows;
+    std::atomic<bool> _cancelled;
+    std::atomic<int> _running;
+    std::atomic<qint64> _ranges, _rows;
+
+    void work();
+    void process(DbConnection *left, DbConnection *right, const Range &range);
+    Summary summary(DbConnection *con, const Side &side, const Range &range);
+    void checkKey(DbConnection *con, const Side &side);     ///< \throw QString if the key is not unique or null
+    QString canonicalText(const Side &side) const;          ///< text of compared columns to be hashed
+    /*!
+     * \brief distinct not null keys starting parts of the range
+     */
+    QVector<QVariant> boundaries(DbConnection *con, const Side &side, const Range &range, int parts);
+    DataTable* fetch(DbConnection *con, const Side &side, const Range &range);
+    DataTable* query(DbConnection *con, const QString &sql, const QVector<QVariant> &params);
+    QString where(const Side &side, const Range &range, QVector<QVariant> &params) const;
+    QString compared() const;
+    static Dialect dialect(DbConnection *con);
+};
+
+#endif // TABLECOMPARER_H
@@ -0,0 +1,325 @@
+#include "tablediff.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include <QtConcurrent>
+#include <algorithm>
+#include <QMutex>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+// rows hashed by a worker at once
+#define DIFF_HASH_CHUNK_ROWS 20000
+// rows are distributed among this number of partitions by the highest bits of key hashes
+#define DIFF_PARTITION_BITS 6
+// max memory taken by hashes at once, partitions are compared in several passes over rows if needed
+#define DIFF_MEMORY_BUDGET (512 * 1024 * 1024)
+
+namespace {
+
+struct Entry
+{
+    quint64 key;    ///< hash of key columns
+    quint64 row;    ///< hash of all compared columns (the same as key if there are no key columns)
+    int index;
+
+    bool operator<(const Entry &other) const
+    {
+        return key < other.key || (key == other.key && index < other.index);
+    }
+};
+
+struct Partition
+{
+    QVector<Entry> left;
+    QVector<Entry> right;
+    QVector<TableDiff::Row> rows;
+    qint64 equal;
+};
+
+}
+
+static bool isInteger(QMetaType::Type type)
+{
+    switch (type)
+    {
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isNumber(QMetaType::Type type)
+{
+    return isInteger(type) || type == QMetaType::Float || type == QMetaType::Double;
+}
+
+/*!
+ * \brief exact integer value of a number
+ * \param bits two's complement value
+ * \return false for fractional or out of range floating point values
+ */
+static bool toInteger(const QVariant &value, QMetaType::Type type, quint64 &bits, bool &negative)
+{
+    switch (type)
+    {
+    case QMetaType::UShort:
+    case QMetaType::UInt:
+    case QMetaType::ULong:
+    case QMetaType::ULongLong:
+        bits = value.toULongLong();
+        negative = false;
+        return true;
+    case QMetaType::Float:
+    case QMetaType::Double:
+    {
+        double d = value.toDouble();
+        // 2^63 and 2^64 are exact doubles
+        if (d != std::floor(d) || d < -9223372036854775808.0 || d >= 18446744073709551616.0)
+            return false;
+        negative = (d < 0);
+        bits = (d < 9223372036854775808.0) ? quint64(qint64(d)) : quint64(d);
+        return true;
+    }
+    default:
+    {
+        qint64 v = value.toLongLong();
+        bits = quint64(v);
+        negative = (v < 0);
+        return true;
+    }
+    }
+}
+
+static inline quint64 mix(quint64 h)
+{
+    // splitmix64 finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/// consistent with TableDiff::equal: equal values have equal hashes
+static quint64 valueHash(const QVariant &value)
+{
+    if (value.isNull())
+        return 0x9e3779b97f4a7c15ULL;
+    QMetaType::Type type = (QMetaType::Type)value.type();
+    if (isNumber(type))
+    {
+        // integers by their 64-bit value, so that integral doubles hash the same
+        quint64 bits;
+        bool negative;
+        if (!toInteger(value, type, bits, negative))
+        {
+            double d = value.toDouble();
+            memcpy(&bits, &d, sizeof(bits));
+        }
+        return mix(bits);
+    }
+    QString text = (type == QMetaType::QString ? *static_cast<const QString*>(value.constData())
+                                               : TableModel::toText(value));
+    return mix((quint64(qHash(text, 0x9e3779b9u)) << 32) | qHash(text, 0x85ebca6bu));
+}
+
+static bool rowsEqual(const DataRow &l, const DataRow &r,
+                      const QVector<int> &leftColumns, const QVector<int> &rightColumns)
+{
+    for (int c = 0; c < leftColumns.size(); ++c)
+    {
+        if (!TableDiff::equal(l.at(leftColumns[c]), r.at(rightColumns[c])))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief hash rows and append entries to partitions
+ * \param from, to range of partitions taking entries, the others are skipped
+ */
+static void hashRows(const QVector<DataRow> &rows, const QVector<int> &columns, const QVector<int> &keys,
+                     QVector<Partition> &partitions, int from, int to, bool left, const std::atomic<bool> &cancelled)
+{
+    struct Chunk
+    {
+        int from, to;
+    };
+    QVector<Chunk> chunks;
+    for (int from = 0; from < rows.size(); from += DIFF_HASH_CHUNK_ROWS)
+        chunks.append({ from, qMin(from + DIFF_HASH_CHUNK_ROWS, rows.size()) });
+
+    QMutex guard;
+    QtConcurrent::blockingMap(chunks, [&](const Chunk &chunk) {
+        if (cancelled)
+            return;
+        QVector<QVector<Entry>> local(to - from);
+        QVector<quint64> hashes(columns.size());
+        for (int i = chunk.from; i < chunk.to; ++i)
+        {
+            const DataRow &row = rows[i];
+            quint64 rowHash = 0;
+            for (int c = 0; c < columns.size(); ++c)
+            {
+                hashes[c] = valueHash(row.at(columns[c]));
+                rowHash = mix(rowHash + hashes[c]);
+            }
+            quint64 keyHash = 0;
+            for (int k: keys)
+                keyHash = mix(keyHash + hashes[k]);
+            if (keys.isEmpty())
+                keyHash = rowHash;
+            int p = int(keyHash >> (64 - DIFF_PARTITION_BITS));
+            if (p >= from && p < to)
+                local[p - from].append({ keyHash, rowHash, i });
+        }
+        QMutexLocker locker(&guard);
+        for (int p = from; p < to; ++p)
+        {
+            if (left)
+                partitions[p].left += local[p - from];
+            else
+                partitions[p].right += local[p - from];
+        }
+    });
+}
+
+bool TableDiff::equal(const QVariant &a, const QVariant &b)
+{
+    if (a.isNull() || b.isNull())
+        return a.isNull() && b.isNull();
+    QMetaType::Type ta = (QMetaType::Type)a.type();
+    QMetaType::Type tb = (QMetaType::Type)b.type();
+    if (isNumber(ta) || isNumber(tb))
+    {
+        if (!isNumber(ta) || !isNumber(tb))
+            return false;
+        quint64 ba, bb;
+        bool na, nb;
+        bool ia = toInteger(a, ta, ba, na);
+        bool ib = toInteger(b, tb, bb, nb);
+        if (ia || ib)
+            return ia && ib && ba == bb && na == nb;
+        return a.toDouble() == b.toDouble();
+    }
+    if (ta == tb)
+        return a == b;
+    return TableModel::toText(a) == TableModel::toText(b);
+}
+
+/// merge join of a partition
+static void mergePartition(Partition &p, const QVector<DataRow> &left, const QVector<DataRow> &right,
+                           const QVector<int> &leftColumns, const QVector<int> &rightColumns,
+                           const QVector<int> &keys, const std::atomic<bool> &cancelled)
+{
+    p.equal = 0;
+    if (cancelled)
+        return;
+    std::sort(p.left.begin(), p.left.end());
+    std::sort(p.right.begin(), p.right.end());
+    // merge join: runs of equal keys are paired in the order of rows
+    int i = 0, j = 0;
+    while (i < p.left.size() || j < p.right.size())
+    {
+        if (j == p.right.size() || (i < p.left.size() && p.left[i].key < p.right[j].key))
+        {
+            p.rows.append({ p.left[i++].index, -1, TableDiff::OnlyLeft });
+            continue;
+        }
+        if (i == p.left.size() || p.right[j].key < p.left[i].key)
+        {
+            p.rows.append({ -1, p.right[j++].index, TableDiff::OnlyRight });
+            continue;
+        }
+        quint64 key = p.left[i].key;
+        int leftEnd = i, rightEnd = j;
+        while (leftEnd < p.left.size() && p.left[leftEnd].key == key)
+            ++leftEnd;
+        while (rightEnd < p.right.size() && p.right[rightEnd].key == key)
+            ++rightEnd;
+        for (; i < leftEnd && j < rightEnd; ++i, ++j)
+        {
+            const Entry &l = p.left[i];
+            const Entry &r = p.right[j];
+            bool same = (l.row == r.row && rowsEqual(left[l.index], right[r.index], leftColumns, rightColumns));
+            if (same)
+                ++p.equal;
+            else if (!keys.isEmpty())
+                p.rows.append({ l.index, r.index, TableDiff::Changed });
+            else
+            {
+                // a hash collision of different rows
+                p.rows.append({ l.index, -1, TableDiff::OnlyLeft });
+                p.rows.append({ -1, r.index, TableDiff::OnlyRight });
+            }
+        }
+        for (; i < leftEnd; ++i)
+            p.rows.append({ p.left[i].index, -1, TableDiff::OnlyLeft });
+        for (; j < rightEnd; ++j)
+            p.rows.append({ -1, p.right[j].index, TableDiff::OnlyRight });
+    }
+    // entries are not needed anymore
+    p.left = QVector<Entry>();
+    p.right = QVector<Entry>();
+}
+
+TableDiff::Result TableDiff::compare(const QVector<DataRow> &left, const QVector<DataRow> &right,
+                                     const QVector<int> &leftColumns, const QVector<int> &rightColumns,
+                                     const QVector<int> &keys, std::shared_ptr<std::atomic<bool>> cancelled)
+{
+    Result res;
+    const int partitionCount = 1 << DIFF_PARTITION_BITS;
+    // hashes are spread evenly, a pass takes entries of a part of partitions
+    qint64 entryBytes = (qint64(left.size()) + right.size()) * qint64(sizeof(Entry)) * 5 / 4;
+    int passes = int((entryBytes + DIFF_MEMORY_BUDGET - 1) / DIFF_MEMORY_BUDGET);
+    if (passes > partitionCount)
+    {
+        res.error = QObject::tr("resultsets are too large to compare (%1 MB of hashes, the budget is %2 MB per pass)")
+                .arg(entryBytes >> 20).arg(qint64(DIFF_MEMORY_BUDGET) >> 20);
+        return res;
+    }
+    passes = qMax(passes, 1);
+    QVector<Partition> partitions(partitionCount);
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        int from = pass * partitionCount / passes;
+        int to = (pass + 1) * partitionCount / passes;
+        hashRows(left, leftColumns, keys, partitions, from, to, true, *cancelled);
+        hashRows(right, rightColumns, keys, partitions, from, to, false, *cancelled);
+        if (*cancelled)
+        {
+            res.cancelled = true;
+            return res;
+        }
+        QtConcurrent::blockingMap(partitions.begin() + from, partitions.begin() + to, [&](Partition &p) {
+            mergePartition(p, left, right, leftColumns, rightColumns, keys, *cancelled);
+        });
+        if (*cancelled)
+        {
+            res.cancelled = true;
+            return res;
+        }
+    }
+
+    for (const Partition &p: partitions)
+    {
+        res.rows += p.rows;
+        res.equal += p.equal;
+    }
+    std::sort(res.rows.begin(), res.rows.end(), [](const Row &a, const Row &b) {
+        int al = a.left < 0 ? INT_MAX : a.left;
+        int bl = b.left < 0 ? INT_MAX : b.left;
+        return al < bl || (al == bl && a.right < b.right);
+    });
+    return res;
+}
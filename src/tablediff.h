@@ -0,0 +1,53 @@
+#ifndef TABLEDIFF_H
+#define TABLEDIFF_H
+
+#include <QVector>
+#include <QVariant>
+#include <atomic>
+#include <memory>
+
+class DataRow;
+
+/*!
+ * \brief hash-partitioned comparison of two resultsets
+ *
+ * Rows of both sides are hashed in parallel, distributed among partitions by
+ * their key hash and each partition is sorted and merge-joined by a worker of
+ * the global thread pool. Only hashes and row numbers are kept (24 bytes per
+ * row), values are compared just for rows with equal hashes. If hashes of all
+ * rows exceed the memory budget, partitions are hashed and compared in several
+ * passes over the rows.
+ */
+class TableDiff
+{
+public:
+    enum Kind : char { OnlyLeft, OnlyRight, Changed };
+    struct Row
+    {
+        int left;       ///< -1 for rows only on the right
+        int right;      ///< -1 for rows only on the left
+        Kind kind;
+    };
+    struct Result
+    {
+        QVector<Row> rows;  ///< differences ordered by the left row, then rows only on the right
+        qint64 equal = 0;   ///< rows found on both sides as they are
+        bool cancelled = false;
+        QString error;      ///< the comparison is not done
+    };
+
+    /*!
+     * \brief compare rows (blocking, to be called from a worker)
+     * \param leftColumns, rightColumns compared columns, pairwise
+     * \param keys indexes within leftColumns/rightColumns identifying rows (whole rows are matched if empty)
+     */
+    static Result compare(const QVector<DataRow> &left, const QVector<DataRow> &right,
+                          const QVector<int> &leftColumns, const QVector<int> &rightColumns,
+                          const QVector<int> &keys, std::shared_ptr<std::atomic<bool>> cancelled);
+    /*!
+     * \brief values are equal (numbers are compared by value whatever their types are)
+     */
+    static bool equal(const QVariant &a, const QVariant &b);
+};
+
+#endif // TABLEDIFF_H
@@ -0,0 +1,343 @@
+#include "tableexporter.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include "arrowwriter.h"
+#include <QtConcurrent>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QThread>
+
+// text is written to the file by chunks of this size (chars)
+#define EXPORT_BUFFER_SIZE (1024 * 1024)
+// how long to wait for more rows of a resultset being fetched (ms)
+#define EXPORT_POLL_INTERVAL 50
+// rows per INSERT statement
+#define SQL_INSERT_BATCH_ROWS 1000
+
+typedef void (*ValueWriter)(const QVariant &value, QString &out);
+
+static bool isNumber(QMetaType::Type type)
+{
+    switch (type)
+    {
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void csvText(const QString &text, QString &out)
+{
+    // quoted only when needed (RFC 4180)
+    for (QChar ch: text)
+    {
+        if (ch == ',' || ch == '"' || ch == '\n' || ch == '\r')
+        {
+            out.append('"').append(QString(text).replace('"', "\"\"")).append('"');
+            return;
+        }
+    }
+    out.append(text);
+}
+
+static void plainNumber(const QVariant &value, QString &out)
+{
+    if (!value.isNull())
+        out.append(value.toString());
+}
+
+static void csvValue(const QVariant &value, QString &out)
+{
+    if (!value.isNull())
+        csvText(TableModel::toText(value), out);
+}
+
+static void tsvText(QString text, QString &out)
+{
+    // there is no escaping in TSV - separators within values are replaced
+    for (QChar &ch: text)
+    {
+        if (ch == '\t' || ch == '\n' || ch == '\r')
+            ch = ' ';
+    }
+    out.append(text);
+}
+
+static void tsvValue(const QVariant &value, QString &out)
+{
+    if (!value.isNull())
+        tsvText(TableModel::toText(value), out);
+}
+
+static void jsonValue(const QVariant &value, QString &out)
+{
+    out.append(TableModel::toJson(value));
+}
+
+static void sqlNumber(const QVariant &value, QString &out)
+{
+    out.append(value.isNull() ? QString("NULL") : value.toString());
+}
+
+static void sqlBool(const QVariant &value, QString &out)
+{
+    out.append(value.isNull() ? "NULL" : value.toBool() ? "TRUE" : "FALSE");
+}
+
+static void sqlValue(const QVariant &value, QString &out)
+{
+    if (value.isNull())
+        out.append("NULL");
+    else
+        out.append('\'').append(TableModel::toText(value).replace('\'', "''")).append('\'');
+}
+
+static ValueWriter writerFor(TableExporter::Format format, QMetaType::Type type)
+{
+    switch (format)
+    {
+    case TableExporter::Csv:
+        return isNumber(type) ? plainNumber : csvValue;
+    case TableExporter::Tsv:
+        return isNumber(type) ? plainNumber : tsvValue;
+    case TableExporter::JsonLines:
+        return jsonValue;
+    case TableExporter::SqlInsert:
+        return isNumber(type) ? sqlNumber : type == QMetaType::Bool ? sqlBool : sqlValue;
+    case TableExporter::Arrow:
+        break;
+    }
+    return csvValue;
+}
+
+TableExporter::TableExporter(QObject *parent) :
+    QObject(parent), _inputFinished(true), _cancelled(false)
+{
+}
+
+TableExporter::~TableExporter()
+{
+    cancel();
+    _future.waitForFinished();
+}
+
+int TableExporter::formatOf(const QString &name)
+{
+    QString fmt = name.toLower();
+    if (fmt == "csv" || fmt == "txt")
+        return Csv;
+    if (fmt == "tsv" || fmt == "tab")
+        return Tsv;
+    if (fmt == "jsonl" || fmt == "ndjson" || fmt == "json")
+        return JsonLines;
+    if (fmt == "sql")
+        return SqlInsert;
+    if (fmt == "arrow" || fmt == "feather" || fmt == "ipc")
+        return Arrow;
+    return -1;
+}
+
+void TableExporter::start(const DataTable *table, const QString &fileName, Format format,
+                          const QString &tableName, bool inputFinished)
+{
+    _inputFinished = inputFinished;
+    _cancelled = false;
+    _future = QtConcurrent::run([this, table, fileName, format, tableName]() {
+        QString err = write(table, fileName, format, tableName, _inputFinished, _cancelled,
+                            [this](qint64 rows) { emit progress(rows); });
+        emit finished(err);
+    });
+}
+
+void TableExporter::finishInput()
+{
+    _inputFinished = true;
+}
+
+void TableExporter::cancel()
+{
+    _cancelled = true;
+}
+
+QString TableExporter::write(const DataTable *table, const QString &fileName, Format format,
+                             const QString &tableName)
+{
+    std::atomic<bool> inputFinished(true), cancelled(false);
+    return write(table, fileName, format, tableName, inputFinished, cancelled, nullptr);
+}
+
+QString TableExporter::exportTable(DataTable *table, const QString &fileName,
+                                   const QString &format, const QString &tableName)
+{
+    if (!table)
+        return tr("no resultset to export");
+    int fmt = formatOf(format.isEmpty() ? QFileInfo(fileName).suffix() : format);
+    if (fmt < 0)
+        return tr("unknown export format: %1").arg(format.isEmpty() ? fileName : format);
+    return write(table, fileName, Format(fmt),
+                 tableName.isEmpty() ? QFileInfo(fileName).completeBaseName() : tableName);
+}
+
+QString TableExporter::write(const DataTable *table, const QString &fileName, Format format,
+                             const QString &tableName, const std::atomic<bool> &inputFinished,
+                             const std::atomic<bool> &cancelled, std::function<void(qint64)> progress)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return file.errorString();
+    if (format == Arrow)
+    {
+        QString err = ArrowWriter::write(table, file, inputFinished, cancelled, progress);
+        if (!err.isEmpty())
+        {
+            file.cancelWriting();
+            return err;
+        }
+        if (!file.commit())
+            return file.errorString();
+        return QString();
+    }
+
+    // everything depending on columns only is prepared once
+    int columns = table->columnCount();
+    QVector<ValueWriter> writers;
+    QStringList names;
+    for (int c = 0; c < columns; ++c)
+    {
+        DataColumn &column = table->getColumn(c);
+        writers.append(writerFor(format, column.variantType()));
+        names.append(column.name());
+    }
+    QString out;
+    out.reserve(EXPORT_BUFFER_SIZE + EXPORT_BUFFER_SIZE / 4);
+    QStringList keys;
+    switch (format)
+    {
+    case Csv:
+    case Tsv:
+        for (int c = 0; c < columns; ++c)
+        {
+            if (c)
+                out.append(format == Csv ? ',' : '\t');
+            if (format == Csv)
+                csvText(names[c], out);
+            else
+                tsvText(names[c], out);
+        }
+        out.append(format == Csv ? "\r\n" : "\n");
+        break;
+    case JsonLines:
+        for (int c = 0; c < columns; ++c)
+            keys.append(TableModel::toJson(names[c]) + ": ");
+        break;
+    case SqlInsert:
+    {
+        QStringList quoted;
+        for (const QString &name: names)
+            quoted.append('"' + QString(name).replace('"', "\"\"") + '"');
+        keys.append("insert into " + tableName + " (" + quoted.join(", ") + ") values\n");
+        break;
+    }
+    case Arrow:
+        break;
+    }
+
+    auto flush = [&file, &out]() {
+        QByteArray bytes = out.toUtf8();
+        out.resize(0);
+        return file.write(bytes) == bytes.size();
+    };
+
+    qint64 written = 0;
+    forever
+    {
+        // checked before taking rows so that the last rows are not missed
+        bool last = inputFinished;
+        // the list is a snapshot: rows appended later do not affect it
+        QVector<DataRow*> rows = table->rows();
+        for (; written < rows.size(); ++written)
+        {
+            const DataRow &row = *rows[written];
+            switch (format)
+            {
+            case Csv:
+            case Tsv:
+                for (int c = 0; c < columns; ++c)
+                {
+                    if (c)
+                        out.append(format == Csv ? ',' : '\t');
+                    writers[c](row.at(c), out);
+                }
+                out.append(format == Csv ? "\r\n" : "\n");
+                break;
+            case JsonLines:
+                out.append('{');
+                for (int c = 0; c < columns; ++c)
+                {
+                    if (c)
+                        out.append(", ");
+                    out.append(keys[c]);
+                    writers[c](row.at(c), out);
+                }
+                out.append("}\n");
+                break;
+            case SqlInsert:
+                if (written % SQL_INSERT_BATCH_ROWS == 0)
+                    out.append(keys.first()).append('(');
+                else
+                    out.append(",\n(");
+                for (int c = 0; c < columns; ++c)
+                {
+                    if (c)
+                        out.append(", ");
+                    writers[c](row.at(c), out);
+                }
+                out.append(')');
+                if (written % SQL_INSERT_BATCH_ROWS == SQL_INSERT_BATCH_ROWS - 1)
+                    out.append(";\n");
+                break;
+            case Arrow:
+                break;
+            }
+            if (out.length() >= EXPORT_BUFFER_SIZE)
+            {
+                if (!flush())
+                    return file.errorString();
+                if (progress)
+                    progress(written + 1);
+                if (cancelled)
+                {
+                    file.cancelWriting();
+                    return tr("export cancelled");
+                }
+            }
+        }
+        if (cancelled)
+        {
+            file.cancelWriting();
+            return tr("export cancelled");
+        }
+        if (last)
+            break;
+        QThread::msleep(EXPORT_POLL_INTERVAL);
+    }
+    if (format == SqlInsert && written % SQL_INSERT_BATCH_ROWS)
+        out.append(";\n");
+    if (!flush())
+        return file.errorString();
+    if (progress)
+        progress(written);
+    if (!file.commit())
+        return file.errorString();
+    return QString();
+}
@@ -0,0 +1,74 @@
+#ifndef TABLEEXPORTER_H
+#define TABLEEXPORTER_H
+
+#include <QObject>
+#include <QFuture>
+#include <atomic>
+#include <functional>
+
+class DataTable;
+
+/*!
+ * \brief writes resultset rows to a file (CSV, TSV, JSON Lines, SQL INSERT batches or Arrow IPC)
+ *
+ * Rows are written by a worker thread. If the resultset is still being fetched
+ * the worker follows it until finishInput() is called, so an export may start
+ * right after the first rows arrive.
+ */
+class TableExporter : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format { Csv, Tsv, JsonLines, SqlInsert, Arrow };
+
+    explicit TableExporter(QObject *parent = 0);
+    ~TableExporter();
+
+    /*!
+     * \brief format by its name ("csv", "tsv", "jsonl", "sql", "arrow") or by a file extension
+     * \return -1 if unknown
+     */
+    static int formatOf(const QString &name);
+    /*!
+     * \brief start writing rows in background
+     * \param table rows are read from it, it must outlive the exporter
+     * \param tableName target table of SQL INSERT statements
+     * \param inputFinished false if rows are still being appended to the table
+     */
+    void start(const DataTable *table, const QString &fileName, Format format,
+               const QString &tableName, bool inputFinished);
+    void finishInput();     ///< no more rows are appended to the table
+    void cancel();          ///< the file is not created
+    bool isRunning() const { return _future.isRunning(); }
+
+    /*!
+     * \brief write all rows of a table (blocking)
+     * \return error message (empty on success)
+     */
+    static QString write(const DataTable *table, const QString &fileName, Format format,
+                         const QString &tableName);
+
+public slots: // to use from QJSEngine
+    /*!
+     * \brief blocking export of a resultset from scripts
+     * \param format format name, the file extension is used if it is empty
+     * \return error message (empty on success)
+     */
+    QString exportTable(DataTable *table, const QString &fileName,
+                        const QString &format = QString(), const QString &tableName = QString());
+
+signals:
+    void progress(qint64 rows);
+    void finished(const QString &error);
+
+private:
+    std::atomic<bool> _inputFinished;
+    std::atomic<bool> _cancelled;
+    QFuture<void> _future;
+
+    static QString write(const DataTable *table, const QString &fileName, Format format,
+                         const QString &tableName, const std::atomic<bool> &inputFinished,
+                         const std::atomic<bool> &cancelled, std::function<void(qint64)> progress);
+};
+
+#endif // TABLEEXPORTER_H
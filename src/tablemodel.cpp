@@ -2,15 +2,145 @@
 #include "tablemodel.h"
 #include <QBrush>
 #include <QDateTime>
+#include <QtConcurrent>
+
+// max length of the text displayed within a cell (the whole value is available via RawDataRole)
+#define CELL_PREVIEW_LENGTH 1000
+// rows exposed to views at once: the first portion is shown right away,
+// the rest grows on scrolling by steps proportional to the exposed part (but bounded)
+#define EXPOSE_ROWS_STEP 10000
+#define EXPOSE_ROWS_MAX_STEP 1000000
+// capacity of rendered cell texts cache (in characters)
+#define DISPLAY_CACHE_COST 4000000
+
+// formatters below avoid QDateTime::toString(format) which parses the format on every call
+
+static inline QChar* putNumber(QChar *out, int value, int digits)
+{
+    for (int i = digits - 1; i >= 0; --i, value /= 10)
+        out[i] = QLatin1Char('0' + value % 10);
+    return out + digits;
+}
+
+static QChar* putTime(QChar *out, const QTime &time)
+{
+    out = putNumber(out, time.hour(), 2);
+    *out++ = QLatin1Char(':');
+    out = putNumber(out, time.minute(), 2);
+    *out++ = QLatin1Char(':');
+    out = putNumber(out, time.second(), 2);
+    *out++ = QLatin1Char('.');
+    return putNumber(out, time.msec(), 3);
+}
+
+// hh:mm:ss.zzz
+static QString formatTime(const QVariant &value, int)
+{
+    QTime time = qvariant_cast<QTime>(value);
+    if (!time.isValid())
+        return QString();
+    QString text(12, Qt::Uninitialized);
+    putTime(text.data(), time);
+    return text;
+}
+
+// yyyy-MM-dd[ hh:mm:ss.zzz] (time part is omitted at midnight)
+static QString formatDateTime(const QVariant &value, int)
+{
+    QDateTime dt = qvariant_cast<QDateTime>(value);
+    QDate date = dt.date();
+    if (!date.isValid() || date.year() < 0 || date.year() > 9999)
+        return dt.toString("yyyy-MM-dd hh:mm:ss.zzz");
+    QTime time = dt.time();
+    bool midnight = time.msecsSinceStartOfDay() == 0;
+    QString text(midnight ? 10 : 23, Qt::Uninitialized);
+    QChar *out = putNumber(text.data(), date.year(), 4);
+    *out++ = QLatin1Char('-');
+    out = putNumber(out, date.month(), 2);
+    *out++ = QLatin1Char('-');
+    out = putNumber(out, date.day(), 2);
+    if (!midnight)
+    {
+        *out++ = QLatin1Char(' ');
+        putTime(out, time);
+    }
+    return text;
+}
+
+// the same as postgresql's bytea hex output,
+// only the preview part gets encoded when truncated
+static QString formatBytes(const QVariant &value, int maxLength)
+{
+    QByteArray bytes = value.toByteArray();
+    if (maxLength < 0 || bytes.size() * 2 + 2 <= maxLength)
+        return "\\x" + QString::fromLatin1(bytes.toHex());
+    return "\\x" + QString::fromLatin1(bytes.left(qMax(0, maxLength / 2 - 1)).toHex()) + QChar(0x2026);
+}
+
+static QString formatString(const QVariant &value, int maxLength)
+{
+    QString text = value.toString();
+    if (maxLength < 0 || text.length() <= maxLength)
+        return text;
+    return text.left(maxLength) + QChar(0x2026);
+}
+
+static QString jsonString(const QString &text)
+{
+    QString res;
+    res.reserve(text.length() + 2);
+    res.append('"');
+    for (QChar ch: text)
+    {
+        switch (ch.unicode())
+        {
+        case '"':
+            res.append("\\\"");
+            break;
+        case '\\':
+            res.append("\\\\");
+            break;
+        case '\n':
+            res.append("\\n");
+            break;
+        case '\r':
+            res.append("\\r");
+            break;
+        case '\t':
+            res.append("\\t");
+            break;
+        default:
+            if (ch.unicode() < 0x20)
+                res.append(QString("\\u%1").arg(ch.unicode(), 4, 16, QChar('0')));
+            else
+                res.append(ch);
+        }
+    }
+    res.append('"');
+    return res;
+}
 
 TableModel::TableModel(QObject *parent) :
-    QAbstractItemModel(parent)
+    QAbstractItemModel(parent), _exposedRows(0), _displayCache(DISPLAY_CACHE_COST), _orderGeneration(0),
+    _filterCheckedRows(0)
 {
     _table = new DataTable();
+    _sortWatcher = new QFutureWatcher<QVector<int>>(this);
+    connect(_sortWatcher, &QFutureWatcher<QVector<int>>::finished, this, [this]() {
+        if (_sortCancelled && !*_sortCancelled)
+            applyRowOrder(_sortWatcher->result());
+    });
+    _filterWatcher = new QFutureWatcher<QVector<int>>(this);
+    connect(_filterWatcher, &QFutureWatcher<QVector<int>>::finished, this, [this]() {
+        if (_filterCancelled && !*_filterCancelled)
+            applyFilter(_filterWatcher->result());
+    });
 }
 
 TableModel::~TableModel()
 {
+    cancelSort();
+    cancelFilter();
     delete _table;
 }
 
@@ -21,7 +151,7 @@ QModelIndex TableModel::parent(const QModelIndex &) const
 
 int TableModel::rowCount(const QModelIndex &) const
 {
-    return _table->rowCount();
+    return _exposedRows;
 }
 
 int TableModel::columnCount(const QModelIndex &) const
@@ -43,35 +173,107 @@ QVariant TableModel::data(const QModelIndex &index, int role) const
     {
     case Qt::SizeHintRole:
     {
-        QVariant &res = _table->getRow(index.row())[index.column()];
-        if (!res.isNull() && res.toString().length() > 200)
+        // called for every measured cell - avoid converting large values
+        const QVariant &res = _table->getRow(tableRow(index.row())).at(index.column());
+        int length = 0;
+        if ((QMetaType::Type)res.type() == QMetaType::QString)
+            length = static_cast<const QString*>(res.constData())->length();
+        else if ((QMetaType::Type)res.type() == QMetaType::QByteArray)
+            length = static_cast<const QByteArray*>(res.constData())->size() * 2;
+        if (length > 200)
             return QSize(500, -1);
         return QVariant();
     }
     case Qt::TextAlignmentRole:
         return _table->getColumn(index.column()).hAlignment() + Qt::AlignVCenter;
     case Qt::BackgroundRole:
-        if (_table->getRow(index.row())[index.column()].isNull())
+        if (_table->getRow(tableRow(index.row())).at(index.column()).isNull())
             return QBrush(QColor(0, 0, 0, 15));
         return QVariant();
+    case RawDataRole:
+        return _table->getRow(tableRow(index.row())).at(index.column());
     case Qt::DisplayRole:
-        QVariant &res = _table->getRow(index.row())[index.column()];
-        if ((QMetaType::Type)res.type() == QMetaType::QTime)
-        {
-            return qvariant_cast<QTime>(res).toString("hh:mm:ss.zzz");
-        }
-        else if ((QMetaType::Type)res.type() == QMetaType::QDateTime)
-        {
-            QDateTime dt = qvariant_cast<QDateTime>(res);
-            if (dt.time().msecsTo(QTime(0, 0)) == 0)
-                return qvariant_cast<QDateTime>(res).toString("yyyy-MM-dd");
-            return qvariant_cast<QDateTime>(res).toString("yyyy-MM-dd hh:mm:ss.zzz");
-        }
-        return _table->getRow(index.row())[index.column()];
+        const QVariant &res = _table->getRow(tableRow(index.row())).at(index.column());
+        QMetaType::Type type = (QMetaType::Type)res.type();
+        if (res.isNull() ||
+                (type == QMetaType::QString &&
+                 static_cast<const QString*>(res.constData())->length() <= CELL_PREVIEW_LENGTH))
+            return res;
+        const ColumnFormat &cf = _formats.at(index.column());
+        Formatter format = (type == cf.type ? cf.format : formatter(type));
+        if (!format)
+            return res;
+        quint64 key = (quint64(tableRow(index.row())) << 32) | quint32(index.column());
+        if (const QString *text = _displayCache.object(key))
+            return *text;
+        QString text = format(res, CELL_PREVIEW_LENGTH);
+        _displayCache.insert(key, new QString(text), qMax(1, text.length()));
+        return text;
     }
     return QVariant();
 }
 
+TableModel::Formatter TableModel::formatter(QMetaType::Type type)
+{
+    switch (type)
+    {
+    case QMetaType::QTime:
+        return formatTime;
+    case QMetaType::QDateTime:
+        return formatDateTime;
+    case QMetaType::QByteArray:
+        return formatBytes;
+    case QMetaType::QString:
+        return formatString;
+    default:
+        return nullptr;
+    }
+}
+
+QString TableModel::toText(const QVariant &value, int maxLength)
+{
+    Formatter format = formatter((QMetaType::Type)value.type());
+    if (format)
+        return format(value, maxLength);
+    return value.toString();
+}
+
+QString TableModel::toJson(const QVariant &value)
+{
+    if (value.isNull())
+        return "null";
+    switch ((QMetaType::Type)value.type())
+    {
+    case QMetaType::Bool:
+        return value.toBool() ? "true" : "false";
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return value.toString();
+    case QMetaType::Float:
+    case QMetaType::Double:
+    {
+        double d = value.toDouble();
+        return qIsFinite(d) ? QString::number(d, 'g', 17) : "null";
+    }
+    default:
+        // the same text as displayed
+        return jsonString(toText(value));
+    }
+}
+
+void TableModel::resetDisplayCache()
+{
+    _displayCache.clear();
+    if (_exposedRows && columnCount())
+        emit dataChanged(index(0, 0), index(_exposedRows - 1, columnCount() - 1), QVector<int>() << Qt::DisplayRole);
+}
+
 Qt::ItemFlags TableModel::flags(const QModelIndex &index) const
 {
     if (!index.isValid())
@@ -89,6 +291,201 @@ QVariant TableModel::headerData(int section, Qt::Orientation orientation, int ro
     return QString::number(section + 1);
 }
 
+bool TableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && _exposedRows < availableRows();
+}
+
+void TableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid())
+        return;
+    exposeRows(qBound(EXPOSE_ROWS_STEP, _exposedRows, EXPOSE_ROWS_MAX_STEP));
+}
+
+void TableModel::exposeRows(int count)
+{
+    int rows = qMin(count, availableRows() - _exposedRows);
+    if (rows <= 0)
+        return;
+    beginInsertRows(QModelIndex(), _exposedRows, _exposedRows + rows - 1);
+    _exposedRows += rows;
+    endInsertRows();
+}
+
+void TableModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= columnCount())
+    {
+        sortBy(QVector<RowSorter::Key>());
+        return;
+    }
+    // NULLs are larger than any value (as in PostgreSQL)
+    sortBy(QVector<RowSorter::Key>() << RowSorter::Key{ column, order, order == Qt::DescendingOrder });
+}
+
+void TableModel::addSortKey(int column, Qt::SortOrder order)
+{
+    QVector<RowSorter::Key> keys;
+    for (const RowSorter::Key &key: _sortKeys)
+    {
+        if (key.column != column)
+            keys.append(key);
+    }
+    keys.append({ column, order, order == Qt::DescendingOrder });
+    sortBy(keys);
+}
+
+void TableModel::sortBy(const QVector<RowSorter::Key> &keys)
+{
+    cancelSort();
+    _sortKeys = keys;
+    if (keys.isEmpty())
+    {
+        applyRowOrder(QVector<int>());
+        return;
+    }
+    QVector<QMetaType::Type> types;
+    for (int c = 0; c < _table->columnCount(); ++c)
+        types.append(_table->getColumn(c).variantType());
+    // the worker gets its own list of rows, the rows are kept until the sort is over (see cancelSort)
+    _sortCancelled = std::make_shared<std::atomic<bool>>(false);
+    _sortWatcher->setFuture(QtConcurrent::run(&RowSorter::sort, _table->rows(), keys, types, _sortCancelled));
+}
+
+void TableModel::cancelSort()
+{
+    if (_sortCancelled)
+        *_sortCancelled = true;
+    _sortWatcher->waitForFinished();
+}
+
+void TableModel::applyRowOrder(QVector<int> order)
+{
+    ++_orderGeneration;
+    if (!_filter.isEmpty())
+    {
+        beginResetModel();
+        _rowOrder.swap(order);
+        _filterRows = inViewOrder(_filterRows);
+        endResetModel();
+        return;
+    }
+    emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+    QModelIndexList from = persistentIndexList();
+    if (!from.isEmpty())
+    {
+        // selection and current cell follow their rows
+        QVector<int> position(order.size());
+        for (int i = 0; i < order.size(); ++i)
+            position[order[i]] = i;
+        QModelIndexList to;
+        for (const QModelIndex &idx: from)
+        {
+            int row = tableRow(idx.row());
+            if (row < position.size())
+                row = position[row];
+            to.append(row < _exposedRows ? index(row, idx.column()) : QModelIndex());
+        }
+        changePersistentIndexList(from, to);
+    }
+    _rowOrder.swap(order);
+    emit layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+}
+
+QVector<DataRow> TableModel::rows(int first, int last) const
+{
+    QVector<DataRow> res;
+    res.reserve(last - first + 1);
+    for (int r = first; r <= last; ++r)
+        res.append(_table->getRow(tableRow(r)));
+    return res;
+}
+
+int TableModel::availableRows() const
+{
+    return _filter.isEmpty() ? _table->rowCount() : _filterRows.size();
+}
+
+bool TableModel::setFilter(const QString &text, bool regExp)
+{
+    RowFilter filter(text, regExp);
+    if (!filter.isValid())
+        return false;
+    cancelFilter();
+    _pendingFilter.filter = filter;
+    _pendingFilter.checkedRows = _table->rowCount();
+    _pendingFilter.orderGeneration = _orderGeneration;
+    if (filter.isEmpty())
+    {
+        applyFilter(QVector<int>());
+        return true;
+    }
+    // typing more text narrows the previous match set,
+    // rows taken while a replaced filter was running have not been checked by it
+    QVector<int> candidates;
+    if (filter.refines(_filter))
+    {
+        candidates = _filterRows;
+        for (int r = _filterCheckedRows; r < _pendingFilter.checkedRows; ++r)
+            candidates.append(r);
+    }
+    else
+    {
+        candidates.reserve(_pendingFilter.checkedRows);
+        for (int r = 0; r < _pendingFilter.checkedRows; ++r)
+            candidates.append(sortedRow(r));
+    }
+    _filterCancelled = std::make_shared<std::atomic<bool>>(false);
+    _filterWatcher->setFuture(QtConcurrent::run(&RowFilter::filter, _table->rows(), candidates,
+                                                columnCount(), filter, _filterCancelled));
+    return true;
+}
+
+void TableModel::cancelFilter()
+{
+    if (_filterCancelled)
+        *_filterCancelled = true;
+    _filterWatcher->waitForFinished();
+}
+
+void TableModel::applyFilter(QVector<int> rows)
+{
+    beginResetModel();
+    _filter = _pendingFilter.filter;
+    if (_pendingFilter.orderGeneration != _orderGeneration)
+        rows = inViewOrder(rows);
+    _filterRows.swap(rows);
+    if (!_filter.isEmpty())
+    {
+        // rows taken while the filter was running (unsorted tail)
+        for (int r = _pendingFilter.checkedRows; r < _table->rowCount(); ++r)
+        {
+            if (_filter.matches(_table->getRow(r), columnCount()))
+                _filterRows.append(r);
+        }
+    }
+    _filterCheckedRows = _table->rowCount();
+    _exposedRows = qMin(availableRows(), EXPOSE_ROWS_STEP);
+    endResetModel();
+}
+
+QVector<int> TableModel::inViewOrder(const QVector<int> &rows) const
+{
+    std::vector<char> selected(_table->rowCount(), 0);
+    for (int r: rows)
+        selected[r] = 1;
+    QVector<int> res;
+    res.reserve(rows.size());
+    for (int r = 0; r < int(selected.size()); ++r)
+    {
+        int row = sortedRow(r);
+        if (selected[row])
+            res.append(row);
+    }
+    return res;
+}
+
 void TableModel::take(DataTable *srcTable)
 {
     // columns are not altered in another thread - no need to use mutex
@@ -97,22 +494,45 @@ void TableModel::take(DataTable *srcTable)
         clear();
         beginInsertColumns(QModelIndex(), 0, srcTable->columnCount() - 1);
         for (int c = 0; c < srcTable->columnCount(); ++c)
-            _table->addColumn(new DataColumn(srcTable->getColumn(c)));
+        {
+            DataColumn &column = srcTable->getColumn(c);
+            _table->addColumn(new DataColumn(column));
+            _formats.append({ column.variantType(), formatter(column.variantType()) });
+        }
         endInsertColumns();
     }
-    int rows = srcTable->rowCount();
-    if (rows)
+    // rows are stored silently - views only learn about them in bounded steps
+    // (the first one right away, the rest via fetchMore when scrolled to the end)
+    int rowcount = _table->rowCount();
+    _table->takeRows(srcTable);
+    // new rows are checked by the applied filter, unless another one is on the way
+    if (!_filter.isEmpty() && !_filterWatcher->isRunning())
     {
-        int rowcount = _table->rowCount();
-        beginInsertRows(QModelIndex(), rowcount, rowcount + rows - 1);
-        _table->takeRows(srcTable);
-        endInsertRows();
+        for (int r = rowcount; r < _table->rowCount(); ++r)
+        {
+            if (_filter.matches(_table->getRow(r), columnCount()))
+                _filterRows.append(r);
+        }
+        _filterCheckedRows = _table->rowCount();
     }
+    if (_exposedRows < EXPOSE_ROWS_STEP)
+        exposeRows(EXPOSE_ROWS_STEP - _exposedRows);
 }
 
 void TableModel::clear()
 {
     beginResetModel();
+    cancelSort();
+    cancelFilter();
+    _rowOrder.clear();
+    _sortKeys.clear();
+    ++_orderGeneration;
+    _filter = RowFilter();
+    _filterRows.clear();
+    _filterCheckedRows = 0;
     _table->clear();
+    _exposedRows = 0;
+    _formats.clear();
+    _displayCache.clear();
     endResetModel();
 }
@@ -2,12 +2,19 @@
 #define TABLEMODEL_H
 
 #include <QAbstractItemModel>
+#include <QCache>
+#include <QFutureWatcher>
+#include "rowsorter.h"
+#include "rowfilter.h"
 
 class DataTable;
+class DataRow;
 class TableModel : public QAbstractItemModel
 {
     Q_OBJECT
 public:
+    enum Roles { RawDataRole = Qt::UserRole }; ///< stored value as is (not truncated)
+
     explicit TableModel(QObject *parent = 0);
     ~TableModel();
 
@@ -18,12 +25,92 @@ public:
     virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     virtual Qt::ItemFlags flags(const QModelIndex &index) const override;
     virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    virtual bool canFetchMore(const QModelIndex &parent) const override;
+    virtual void fetchMore(const QModelIndex &parent) override;
+    /*!
+     * \brief sort by a single column (a negative column restores the fetch order)
+     */
+    virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    /*!
+     * \brief start sorting rows by several keys in background
+     *
+     * Views keep showing the previous order until the new one is ready.
+     * Rows taken after sorting has started are appended unsorted.
+     */
+    void sortBy(const QVector<RowSorter::Key> &keys);
+    /*!
+     * \brief sort by one more column (it becomes the least significant key)
+     */
+    void addSortKey(int column, Qt::SortOrder order);
+    QVector<RowSorter::Key> sortKeys() const { return _sortKeys; }
+    /*!
+     * \brief start selecting rows containing the text in any column in background
+     *
+     * A filter extending the applied substring only checks rows matching it.
+     * An empty text shows all rows.
+     * \return false if the regular expression is invalid
+     */
+    bool setFilter(const QString &text, bool regExp = false);
+    const RowFilter& filter() const { return _filter; }
     void take(DataTable *srcTable);
     void clear();
     const DataTable* table() const { return _table; }
+    /*!
+     * \brief copies of rows in view order (values are shared, not duplicated)
+     */
+    QVector<DataRow> rows(int first, int last) const;
+    /*!
+     * \brief text representation of a stored value
+     * \param maxLength truncate long values (-1 means full value)
+     */
+    static QString toText(const QVariant &value, int maxLength = -1);
+    /*!
+     * \brief JSON representation of a stored value (numbers and NULLs as is, other values as displayed text)
+     */
+    static QString toJson(const QVariant &value);
+    /*!
+     * \brief drop rendered cell texts and repaint views (display settings have changed)
+     */
+    void resetDisplayCache();
 
 private:
+    typedef QString (*Formatter)(const QVariant &value, int maxLength);
+    struct ColumnFormat
+    {
+        QMetaType::Type type;   ///< value type the formatter is made for
+        Formatter format;       ///< nullptr - values are displayed as is
+    };
+
     DataTable *_table;
+    int _exposedRows;   ///< rows reported to views (the rest is exposed by fetchMore on demand)
+    QVector<ColumnFormat> _formats;   ///< display formatter per column, chosen once by column type
+    mutable QCache<quint64, QString> _displayCache;   ///< recently rendered cell texts by (table row, column)
+    QVector<int> _rowOrder;     ///< table row by view row (empty - fetch order)
+    QVector<RowSorter::Key> _sortKeys;
+    QFutureWatcher<QVector<int>> *_sortWatcher;
+    std::shared_ptr<std::atomic<bool>> _sortCancelled;   ///< cancellation flag of the running sort
+    int _orderGeneration;       ///< incremented on every change of _rowOrder
+    RowFilter _filter;
+    QVector<int> _filterRows;   ///< table rows matching _filter in view order
+    int _filterCheckedRows;     ///< table rows checked by _filter (rows taken while another filter runs are not)
+    struct
+    {
+        RowFilter filter;
+        int checkedRows;        ///< rows taken later are checked when the result is applied
+        int orderGeneration;    ///< candidates were in this order
+    } _pendingFilter;
+    QFutureWatcher<QVector<int>> *_filterWatcher;
+    std::shared_ptr<std::atomic<bool>> _filterCancelled;
+    int sortedRow(int row) const { return row < _rowOrder.size() ? _rowOrder.at(row) : row; }
+    int tableRow(int row) const { return _filter.isEmpty() ? sortedRow(row) : _filterRows.at(row); }
+    int availableRows() const;
+    void cancelSort();
+    void applyRowOrder(QVector<int> order);
+    void cancelFilter();
+    void applyFilter(QVector<int> rows);
+    QVector<int> inViewOrder(const QVector<int> &rows) const;
+    void exposeRows(int count);
+    static Formatter formatter(QMetaType::Type type);
     
 };
 
@@ -0,0 +1,78 @@
+#include "valueviewer.h"
+#include "tablemodel.h"
+#include <QPlainTextEdit>
+#include <QVBoxLayout>
+#include <QTimer>
+
+#define HEX_BYTES_PER_LINE 16
+#define HEX_LINES_PER_CHUNK 4096
+
+ValueViewer::ValueViewer(const QVariant &value, QWidget *parent) :
+    QDialog(parent), _streamTimer(nullptr), _offset(0)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    _text = new QPlainTextEdit(this);
+    _text->setReadOnly(true);
+    _text->setWordWrapMode(QTextOption::NoWrap);
+    QFont font("Consolas, monospace, Menlo, Lucida Console, Liberation Mono, DejaVu Sans Mono, Bitstream Vera Sans Mono, Courier New, serif");
+    font.setStyleHint(QFont::TypeWriter);
+    _text->setFont(font);
+    layout->addWidget(_text);
+    resize(700, 500);
+
+    if ((QMetaType::Type)value.type() == QMetaType::QByteArray)
+    {
+        _bytes = value.toByteArray();
+        setWindowTitle(tr("Binary value (%1 bytes)").arg(_bytes.size()));
+        _streamTimer = new QTimer(this);
+        connect(_streamTimer, &QTimer::timeout, this, &ValueViewer::appendHexChunk);
+        appendHexChunk();
+    }
+    else
+    {
+        QString text = TableModel::toText(value);
+        setWindowTitle(tr("Text value (%1 characters)").arg(text.length()));
+        _text->setPlainText(text);
+    }
+}
+
+void ValueViewer::appendHexChunk()
+{
+    static const char hex[] = "0123456789abcdef";
+    int end = qMin(_bytes.size(), _offset + HEX_BYTES_PER_LINE * HEX_LINES_PER_CHUNK);
+    const uchar *data = reinterpret_cast<const uchar*>(_bytes.constData());
+
+    // offset (8) + hex (3 per byte) + separator (2) + ascii (1 per byte) + \n
+    QString chunk;
+    chunk.reserve((end - _offset) / HEX_BYTES_PER_LINE * (HEX_BYTES_PER_LINE * 4 + 12) + 80);
+    for (int line = _offset; line < end; line += HEX_BYTES_PER_LINE)
+    {
+        if (line)
+            chunk.append('\n');
+        chunk.append(QString("%1 ").arg(line, 8, 16, QChar('0')));
+        for (int i = line; i < line + HEX_BYTES_PER_LINE; ++i)
+        {
+            chunk.append(' ');
+            if (i < end)
+            {
+                chunk.append(QChar(hex[data[i] >> 4]));
+                chunk.append(QChar(hex[data[i] & 0x0f]));
+            }
+            else
+                chunk.append("  ");
+        }
+        chunk.append("  ");
+        for (int i = line; i < line + HEX_BYTES_PER_LINE && i < end; ++i)
+            chunk.append(data[i] >= 0x20 && data[i] < 0x7f ? QChar(data[i]) : QChar('.'));
+    }
+    _offset = end;
+
+    QTextCursor c(_text->document());
+    c.movePosition(QTextCursor::End);
+    c.insertText(chunk);
+
+    if (_offset < _bytes.size())
+        _streamTimer->start(0);
+    else
+        _streamTimer->stop();
+}
@@ -0,0 +1,30 @@
+#ifndef VALUEVIEWER_H
+#define VALUEVIEWER_H
+
+#include <QDialog>
+#include <QVariant>
+
+class QPlainTextEdit;
+class QTimer;
+
+/*!
+ * \brief The ValueViewer class shows the whole value of a resultset cell.
+ *
+ * Binary values are rendered as a hex dump chunk by chunk (on a timer),
+ * so the dialog opens immediately even for large blobs.
+ */
+class ValueViewer : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit ValueViewer(const QVariant &value, QWidget *parent = 0);
+
+private:
+    QPlainTextEdit *_text;
+    QTimer *_streamTimer;
+    QByteArray _bytes;
+    int _offset;
+    void appendHexChunk();
+};
+
+#endif // VALUEVIEWER_H